@@ -0,0 +1,221 @@
+// Stem render benchmark: N mono streams as N separate CqtReverb objects, processed one after another, against one
+// CqtReverbBank on a worker pool, with the same input and parameters. Both have to give the same output bit for bit.
+//
+//   HarmonicReverbBankBench [--streams 1,8,32,64] [--threads 4] [--block-size 512] [--sample-rate 48000]
+//                           [--seconds 10] [--internal-rate 0]
+//
+// Input is generated outside the timed calls, so the times are processing only.
+
+#include "../include/CqtReverb.h"
+#include "../include/CqtReverbBank.h"
+#include "../include/RealtimeWorkerPool.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+constexpr unsigned BankBenchBins{12};
+constexpr unsigned BankBenchOctaves{9};
+
+using Engine = CqtReverb<BankBenchBins, BankBenchOctaves>;
+using Bank = CqtReverbBank<BankBenchBins, BankBenchOctaves>;
+
+namespace
+{
+    struct Settings
+    {
+        std::vector<unsigned> streamCounts{1u, 8u, 32u, 64u};
+        unsigned threads{std::max(1u, std::thread::hardware_concurrency())};
+        int blockSize{512};
+        double sampleRate{48000.};
+        double seconds{10.};
+        double internalRate{0.};
+    };
+
+    std::vector<unsigned> parseList(const char* text)
+    {
+        std::vector<unsigned> values;
+        std::string item;
+        for(const char* c = text; ; c++)
+        {
+            if(*c == ',' || *c == '\0')
+            {
+                if(!item.empty())
+                    values.push_back(static_cast<unsigned>(std::strtoul(item.c_str(), nullptr, 10)));
+                item.clear();
+                if(*c == '\0')
+                    break;
+            }
+            else
+            {
+                item += *c;
+            }
+        }
+        return values;
+    }
+
+    bool parseArguments(const int argc, char** argv, Settings& settings)
+    {
+        for(int i_arg = 1; i_arg < argc; i_arg++)
+        {
+            const std::string name = argv[i_arg];
+            if(name == "--help" || i_arg + 1 >= argc)
+                return false;
+            const char* value = argv[++i_arg];
+            if(name == "--streams")
+                settings.streamCounts = parseList(value);
+            else if(name == "--threads")
+                settings.threads = std::max(1u, static_cast<unsigned>(std::strtoul(value, nullptr, 10)));
+            else if(name == "--block-size")
+                settings.blockSize = std::max(1, std::atoi(value));
+            else if(name == "--sample-rate")
+                settings.sampleRate = std::atof(value);
+            else if(name == "--seconds")
+                settings.seconds = std::atof(value);
+            else if(name == "--internal-rate")
+                settings.internalRate = std::atof(value);
+            else
+                return false;
+        }
+        return !settings.streamCounts.empty() && settings.sampleRate > 0. && settings.seconds > 0.;
+    }
+
+    // Stems differ in pitch and in the noise added, so streams do not run the same partials
+    void generateBlock(const unsigned stream, const size_t position, const double sampleRate, float* const block, const int nSamples)
+    {
+        const double twoPi = 6.283185307179586;
+        const double root = 55. * std::pow(2., static_cast<double>(stream % 24u) / 12.);
+        uint32_t noise = 0x9e3779b9u * (stream + 1u) + static_cast<uint32_t>(position);
+        for(int i_sample = 0; i_sample < nSamples; i_sample++)
+        {
+            const double t = static_cast<double>(position + static_cast<size_t>(i_sample)) / sampleRate;
+            noise = noise * 1664525u + 1013904223u;
+            const float uniform = static_cast<float>(noise >> 8) / static_cast<float>(1u << 24) * 2.f - 1.f;
+            block[i_sample] = static_cast<float>(0.2 * (std::sin(twoPi * root * t) + std::sin(twoPi * root * 1.5 * t))) + 0.05f * uniform;
+        }
+    }
+
+    template <typename Target>
+    void setParameters(Target& target)
+    {
+        target.setAttack(0.3);
+        target.setDecay(0.9);
+        target.setOctaveShift(1.);
+        target.setOctaveMix(0.3);
+        target.setColour(0.5);
+        target.setSparsity(1.);
+    }
+
+    // FNV-1a over the sample bits, compares the outputs without keeping them
+    void hashBlock(uint64_t& hash, const float* const block, const int nSamples)
+    {
+        for(int i_sample = 0; i_sample < nSamples; i_sample++)
+        {
+            uint32_t bits = 0u;
+            std::memcpy(&bits, block + i_sample, sizeof(bits));
+            hash = (hash ^ bits) * 0x100000001b3ull;
+        }
+    }
+
+    struct Result
+    {
+        double seconds{0.};
+        std::vector<uint64_t> hashes;
+    };
+
+    // Runs process(inputs, outputs) for every block and times only those calls
+    template <typename Process>
+    Result run(const Settings& settings, const unsigned nStreams, Process process)
+    {
+        std::vector<std::vector<float>> inputs(nStreams, std::vector<float>(settings.blockSize)), outputs(nStreams, std::vector<float>(settings.blockSize));
+        std::vector<const float*> inputPointers(nStreams);
+        std::vector<float*> outputPointers(nStreams);
+        for(unsigned i_stream = 0u; i_stream < nStreams; i_stream++)
+        {
+            inputPointers[i_stream] = inputs[i_stream].data();
+            outputPointers[i_stream] = outputs[i_stream].data();
+        }
+
+        Result result;
+        result.hashes.assign(nStreams, 0xcbf29ce484222325ull);
+        const size_t nSamples = static_cast<size_t>(settings.seconds * settings.sampleRate);
+        for(size_t position = 0u; position + static_cast<size_t>(settings.blockSize) <= nSamples; position += static_cast<size_t>(settings.blockSize))
+        {
+            for(unsigned i_stream = 0u; i_stream < nStreams; i_stream++)
+                generateBlock(i_stream, position, settings.sampleRate, inputs[i_stream].data(), settings.blockSize);
+            const auto start = std::chrono::steady_clock::now();
+            process(inputPointers.data(), outputPointers.data());
+            result.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            for(unsigned i_stream = 0u; i_stream < nStreams; i_stream++)
+                hashBlock(result.hashes[i_stream], outputs[i_stream].data(), settings.blockSize);
+        }
+        return result;
+    }
+
+    bool runStreams(const Settings& settings, const unsigned nStreams, RealtimeWorkerPool& pool)
+    {
+        // Separate objects, as a render farm job runs them today
+        std::vector<std::unique_ptr<Engine>> engines;
+        for(unsigned i_stream = 0u; i_stream < nStreams; i_stream++)
+        {
+            engines.push_back(std::make_unique<Engine>());
+            engines.back()->init(settings.sampleRate, settings.blockSize, settings.internalRate);
+            setParameters(*engines.back());
+        }
+        const Result separate = run(settings, nStreams, [&engines, &settings](const float* const* input, float* const* output)
+        {
+            for(size_t i_stream = 0u; i_stream < engines.size(); i_stream++)
+                engines[i_stream]->processBlock(input[i_stream], output[i_stream], settings.blockSize);
+        });
+        engines.clear();
+
+        Bank bank;
+        bank.init(nStreams, settings.sampleRate, settings.blockSize, settings.internalRate);
+        setParameters(bank);
+        bank.setWorkerPool(&pool);
+        const Result banked = run(settings, nStreams, [&bank, &settings, nStreams](const float* const* input, float* const* output)
+        {
+            bank.processBlock(input, output, nStreams, settings.blockSize);
+        });
+        bank.setWorkerPool(nullptr);
+
+        const bool identical = separate.hashes == banked.hashes;
+        const double audioSeconds = static_cast<double>(nStreams) * settings.seconds;
+        std::printf("%7u %10.2fx %10.2fx %8.2fx %10s\n", nStreams, audioSeconds / separate.seconds, audioSeconds / banked.seconds,
+                    separate.seconds / banked.seconds, identical ? "yes" : "NO");
+        return identical;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Settings settings;
+    if(!parseArguments(argc, argv, settings))
+    {
+        std::fprintf(stderr, "usage: %s [--streams 1,8,32,64] [--threads n] [--block-size n] [--sample-rate hz] [--seconds s] [--internal-rate hz]\n", argv[0]);
+        return 1;
+    }
+
+    std::printf("%u threads for the bank, block size %d, %.0f Hz, %.1f s per stream, %s kernels\n",
+                settings.threads, settings.blockSize, settings.sampleRate, settings.seconds, getEngineKernels().name);
+    std::printf("stream seconds per second of processing\n");
+    std::printf("%7s %11s %11s %9s %10s\n", "streams", "separate", "bank", "speedup", "identical");
+
+    RealtimeWorkerPool pool;
+    pool.start(settings.threads - 1u);
+    bool identical = true;
+    for(const unsigned nStreams : settings.streamCounts)
+    {
+        if(nStreams > 0u)
+            identical = runStreams(settings, nStreams, pool) && identical;
+    }
+    pool.stop();
+    return identical ? 0 : 1;
+}
@@ -0,0 +1,96 @@
+// Baseline kernels and the load-time selection between the ISA variants
+#include "../include/EngineKernels.h"
+#include "../include/EngineKernelsImpl.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+ #include <intrin.h>
+ #include <immintrin.h>
+#endif
+
+namespace
+{
+    bool cpuSupports(const EngineIsa isa)
+    {
+        if(isa == EngineIsa::Generic)
+            return true;
+       #if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+        if(isa == EngineIsa::Avx2)
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        return __builtin_cpu_supports("avx512f");
+       #elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        int info[4];
+        __cpuid(info, 1);
+        const bool osSavesYmm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+        const bool fma = (info[2] & (1 << 12)) != 0;
+        __cpuidex(info, 7, 0);
+        if(isa == EngineIsa::Avx2)
+            return osSavesYmm && fma && (info[1] & (1 << 5)) != 0;
+        const bool osSavesZmm = osSavesYmm && (_xgetbv(0) & 0xe6) == 0xe6;
+        return osSavesZmm && (info[1] & (1 << 16)) != 0;
+       #else
+        return false;
+       #endif
+    }
+
+    const EngineKernels* getVariant(const EngineIsa isa)
+    {
+        switch(isa)
+        {
+            case EngineIsa::Avx512: return getEngineKernelsAvx512();
+            case EngineIsa::Avx2: return getEngineKernelsAvx2();
+            default: return getEngineKernelsGeneric();
+        }
+    }
+
+    const EngineKernels* selectEngineKernels()
+    {
+        if(const char* forced = std::getenv("HARMONIC_REVERB_ISA"))
+        {
+            const EngineIsa isa = std::strcmp(forced, "avx512") == 0 ? EngineIsa::Avx512
+                                : std::strcmp(forced, "avx2") == 0 ? EngineIsa::Avx2 : EngineIsa::Generic;
+            const EngineKernels* kernels = getVariant(isa);
+            if(kernels != nullptr && cpuSupports(isa))
+                return kernels;
+        }
+        for(const EngineIsa isa : {EngineIsa::Avx512, EngineIsa::Avx2})
+        {
+            const EngineKernels* kernels = getVariant(isa);
+            if(kernels != nullptr && cpuSupports(isa))
+                return kernels;
+        }
+        return getEngineKernelsGeneric();
+    }
+
+    std::atomic<const EngineKernels*> selectedKernels{nullptr};
+}
+
+const EngineKernels* getEngineKernelsGeneric()
+{
+    static constexpr EngineKernels kernels = makeEngineKernels(EngineIsa::Generic, "generic");
+    return &kernels;
+}
+
+const EngineKernels& getEngineKernels()
+{
+    const EngineKernels* kernels = selectedKernels.load(std::memory_order_acquire);
+    if(kernels == nullptr)
+    {
+        // Every thread resolves to the same table, so racing first calls are harmless
+        kernels = selectEngineKernels();
+        selectedKernels.store(kernels, std::memory_order_release);
+    }
+    return *kernels;
+}
+
+bool forceEngineIsa(const EngineIsa isa)
+{
+    const EngineKernels* kernels = getVariant(isa);
+    if(kernels == nullptr || !cpuSupports(isa))
+        return false;
+    selectedKernels.store(kernels, std::memory_order_release);
+    return true;
+}
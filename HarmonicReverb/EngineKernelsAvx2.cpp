@@ -0,0 +1,17 @@
+// Built with AVX2 and FMA enabled, only called if the CPU reports both
+#include "../include/EngineKernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include "../include/EngineKernelsImpl.h"
+
+const EngineKernels* getEngineKernelsAvx2()
+{
+    static constexpr EngineKernels kernels = makeEngineKernels(EngineIsa::Avx2, "avx2");
+    return &kernels;
+}
+#else
+const EngineKernels* getEngineKernelsAvx2()
+{
+    return nullptr;
+}
+#endif
@@ -0,0 +1,17 @@
+// Built with AVX-512F enabled, only called if the CPU reports it
+#include "../include/EngineKernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include "../include/EngineKernelsImpl.h"
+
+const EngineKernels* getEngineKernelsAvx512()
+{
+    static constexpr EngineKernels kernels = makeEngineKernels(EngineIsa::Avx512, "avx512");
+    return &kernels;
+}
+#else
+const EngineKernels* getEngineKernelsAvx512()
+{
+    return nullptr;
+}
+#endif
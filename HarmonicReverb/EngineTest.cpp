@@ -0,0 +1,495 @@
+// Engine tests without a host: each check drives bare CqtReverb engines and compares their output sample for sample.
+//
+//   HarmonicReverbEngineTest
+//
+// Prints one line per check and returns non-zero if any of them failed.
+
+#include "../include/CqtReverb.h"
+#include "../include/EngineKernels.h"
+#include "../include/EnvelopeBank.h"
+#include "../include/EnvelopeRecorder.h"
+#include "../include/RealtimeWorkerPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+constexpr unsigned TestBins{12};
+constexpr unsigned TestOctaves{9};
+
+using Engine = CqtReverb<TestBins, TestOctaves>;
+
+namespace
+{
+    constexpr int TestBlockSize{300}; // not a multiple of the hop
+
+    void generateSignal(std::vector<float>& signal, const double sampleRate, const unsigned seed)
+    {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+        const double twoPi = 6.283185307179586;
+        const double root = 110. * static_cast<double>(1u + seed % 4u);
+        for(size_t i_sample = 0u; i_sample < signal.size(); i_sample++)
+        {
+            const double t = static_cast<double>(i_sample) / sampleRate;
+            signal[i_sample] = static_cast<float>(0.2 * (std::sin(twoPi * root * t) + std::sin(twoPi * root * 1.5 * t))) + 0.05f * uniform(random);
+        }
+    }
+
+    void setParameters(Engine& engine)
+    {
+        engine.setAttack(0.3);
+        engine.setDecay(0.9);
+        engine.setOctaveShift(1.);
+        engine.setOctaveMix(0.3);
+        engine.setColour(0.5);
+        engine.setSparsity(1.);
+        engine.setMaxPartials(40u);
+    }
+
+    void process(Engine& engine, const std::vector<float>& input, std::vector<float>& output, const size_t start, const size_t end)
+    {
+        for(size_t i_sample = start; i_sample + TestBlockSize <= end; i_sample += TestBlockSize)
+            engine.processBlock(input.data() + i_sample, output.data() + i_sample, TestBlockSize);
+    }
+
+    size_t countDifferences(const std::vector<float>& a, const std::vector<float>& b, const size_t start, const size_t end)
+    {
+        size_t nDifferent = 0u;
+        for(size_t i_sample = start; i_sample < end; i_sample++)
+            nDifferent += a[i_sample] != b[i_sample] ? 1u : 0u;
+        return nDifferent;
+    }
+
+    // The sliding CQT keeps its filter states private, so both engines make the same transform calls up to the
+    // checkpoint. The restoring engine is then reset and takes the state of an engine that heard different input,
+    // before it restores the checkpoint, so state the blob misses or restores wrongly shows up as a difference.
+    // The checkpointed engines run on a narrower octave window that opens again after the checkpoint.
+    bool testStateRoundTrip(const double sampleRate, const double internalRate, const bool frozen)
+    {
+        const size_t nSamples = static_cast<size_t>(sampleRate) * 4u;
+        const size_t checkpoint = (nSamples / 2u) / TestBlockSize * TestBlockSize;
+        std::vector<float> input(nSamples), other(nSamples), outputA(nSamples, 0.f), outputB(nSamples, 0.f), outputOther(nSamples, 0.f);
+        generateSignal(input, sampleRate, 1u);
+        generateSignal(other, sampleRate, 2u);
+
+        auto a = std::make_unique<Engine>();
+        auto b = std::make_unique<Engine>();
+        auto c = std::make_unique<Engine>();
+        for(Engine* engine : {a.get(), b.get(), c.get()})
+        {
+            engine->init(sampleRate, TestBlockSize, internalRate);
+            setParameters(*engine);
+            if(engine != c.get())
+                engine->setActiveOctaves(1u, TestOctaves - 2u);
+        }
+
+        const size_t freezeStart = checkpoint - static_cast<size_t>(sampleRate) / 4u / TestBlockSize * TestBlockSize;
+        for(Engine* engine : {a.get(), b.get()})
+        {
+            process(*engine, input, engine == a.get() ? outputA : outputB, 0u, frozen ? freezeStart : checkpoint);
+            engine->setFreeze(frozen);
+            process(*engine, input, engine == a.get() ? outputA : outputB, frozen ? freezeStart : checkpoint, checkpoint);
+        }
+        c->setFreeze(frozen);
+        process(*c, other, outputOther, 0u, checkpoint);
+
+        std::vector<unsigned char> state, otherState;
+        a->saveState(state);
+        c->saveState(otherState);
+        const bool rejectsTruncated = !b->restoreState(state.data(), state.size() - 1u);
+        b->reset();
+        const bool restored = b->restoreState(otherState.data(), otherState.size()) && b->restoreState(state.data(), state.size());
+
+        // after the checkpoint both engines hear new input, frozen ones thaw half way
+        const size_t thaw = checkpoint + (nSamples - checkpoint) / 2u / TestBlockSize * TestBlockSize;
+        for(Engine* engine : {a.get(), b.get()})
+        {
+            std::vector<float>& output = engine == a.get() ? outputA : outputB;
+            process(*engine, other, output, checkpoint, thaw);
+            engine->setFreeze(false);
+            engine->setActiveOctaves(0u, TestOctaves - 1u);
+            process(*engine, other, output, thaw, nSamples);
+        }
+        const size_t end = checkpoint + (nSamples - checkpoint) / TestBlockSize * TestBlockSize;
+        const size_t nDifferent = countDifferences(outputA, outputB, checkpoint, end);
+
+        const bool passed = rejectsTruncated && restored && nDifferent == 0u;
+        std::printf("%s state round trip, %.0f Hz, internal rate %.0f Hz%s: %zu byte blob, %zu of %zu samples differ\n",
+                    passed ? "PASS" : "FAIL", sampleRate, internalRate, frozen ? ", frozen" : "", state.size(), nDifferent, end - checkpoint);
+        return passed;
+    }
+
+    // Wet bus voices read the analysis their main engine published, and a checkpoint can fall between the two: here
+    // the main engine has processed the block and the voice has not. Restored into fresh engines, as after a session
+    // reload, the voice has to render that block from the frames of the restored main engine. Later blocks depend on
+    // the sliding CQT history the blob cannot hold, so only this one is compared.
+    bool testSharedAnalysisRoundTrip()
+    {
+        const double sampleRate = 48000.;
+        const size_t nSamples = static_cast<size_t>(sampleRate) * 2u;
+        const size_t checkpoint = nSamples / TestBlockSize * TestBlockSize - TestBlockSize;
+        std::vector<float> input(nSamples), outputA(nSamples, 0.f), outputB(nSamples, 0.f), scratch(nSamples, 0.f);
+        generateSignal(input, sampleRate, 1u);
+
+        auto mainA = std::make_unique<Engine>();
+        auto voiceA = std::make_unique<Engine>();
+        auto mainB = std::make_unique<Engine>();
+        auto voiceB = std::make_unique<Engine>();
+        for(Engine* engine : {mainA.get(), voiceA.get(), mainB.get(), voiceB.get()})
+        {
+            engine->init(sampleRate, TestBlockSize);
+            setParameters(*engine);
+        }
+        voiceA->setAnalysisSource(mainA.get());
+        voiceB->setAnalysisSource(mainB.get());
+
+        // voices render into the outputs, main engines into scratch
+        auto processPair = [&scratch](Engine& main, Engine& voice, const std::vector<float>& signal, std::vector<float>& output, const size_t start, const size_t end)
+        {
+            for(size_t i_sample = start; i_sample + TestBlockSize <= end; i_sample += TestBlockSize)
+            {
+                main.processBlock(signal.data() + i_sample, scratch.data() + i_sample, TestBlockSize);
+                voice.processBlock(signal.data() + i_sample, output.data() + i_sample, TestBlockSize);
+            }
+        };
+        processPair(*mainA, *voiceA, input, outputA, 0u, checkpoint);
+        mainA->processBlock(input.data() + checkpoint, scratch.data() + checkpoint, TestBlockSize);
+
+        std::vector<unsigned char> mainState, voiceState;
+        mainA->saveState(mainState);
+        voiceA->saveState(voiceState);
+        const bool restored = mainB->restoreState(mainState.data(), mainState.size()) && voiceB->restoreState(voiceState.data(), voiceState.size());
+
+        for(Engine* voice : {voiceA.get(), voiceB.get()})
+            voice->processBlock(input.data() + checkpoint, (voice == voiceA.get() ? outputA : outputB).data() + checkpoint, TestBlockSize);
+
+        const size_t end = checkpoint + TestBlockSize;
+        const size_t nDifferent = countDifferences(outputA, outputB, checkpoint, end);
+        const bool passed = restored && nDifferent == 0u;
+        std::printf("%s state round trip of a shared analysis: %zu byte blob, %zu of %zu samples differ\n",
+                    passed ? "PASS" : "FAIL", mainState.size(), nDifferent, end - checkpoint);
+        return passed;
+    }
+
+    // At an internal rate the output is the engine output delayed by a fixed latency, so host block sizes must not
+    // change a single sample, neither from the first block on nor after a reset. One engine gets full blocks, the other
+    // random sizes up to the full block, and both are reset at the same sample.
+    bool testResampledBlockSizes(const double sampleRate, const double internalRate)
+    {
+        const size_t nSamples = static_cast<size_t>(sampleRate) * 2u;
+        const size_t resetAt = nSamples / 2u;
+        std::vector<float> input(nSamples), outputFull(nSamples, 0.f), outputRandom(nSamples, 0.f);
+        generateSignal(input, sampleRate, 4u);
+
+        auto full = std::make_unique<Engine>();
+        auto random = std::make_unique<Engine>();
+        for(Engine* engine : {full.get(), random.get()})
+        {
+            engine->init(sampleRate, TestBlockSize, internalRate);
+            setParameters(*engine);
+        }
+        std::mt19937 sizes(5u);
+        std::uniform_int_distribution<int> blockSize(1, TestBlockSize);
+        for(Engine* engine : {full.get(), random.get()})
+        {
+            std::vector<float>& output = engine == full.get() ? outputFull : outputRandom;
+            size_t i_sample = 0u;
+            while(i_sample < nSamples)
+            {
+                if(i_sample == resetAt)
+                    engine->reset();
+                const size_t nextStop = i_sample < resetAt ? resetAt : nSamples;
+                const int requested = engine == full.get() ? TestBlockSize : blockSize(sizes);
+                const int nBlock = static_cast<int>(std::min(static_cast<size_t>(requested), nextStop - i_sample));
+                engine->processBlock(input.data() + i_sample, output.data() + i_sample, nBlock);
+                i_sample += static_cast<size_t>(nBlock);
+            }
+        }
+
+        const size_t nDifferent = countDifferences(outputFull, outputRandom, 0u, nSamples);
+        const float peak = std::abs(*std::max_element(outputFull.begin(), outputFull.end(), [](const float a, const float b)
+                                                      { return std::abs(a) < std::abs(b); }));
+        const bool passed = nDifferent == 0u && peak > 0.f;
+        std::printf("%s resampled output independent of block size, %.0f Hz, internal rate %.0f Hz, latency %d: %zu of %zu samples differ\n",
+                    passed ? "PASS" : "FAIL", sampleRate, internalRate, full->getResamplingLatency(), nDifferent, nSamples);
+        return passed;
+    }
+
+    // Octaves share no synthesis state, so spreading them over a pool must not change a single sample
+    bool testOctaveParallel(const unsigned nWorkers)
+    {
+        const double sampleRate = 48000.;
+        const size_t nSamples = static_cast<size_t>(sampleRate) * 4u;
+        std::vector<float> input(nSamples), outputSerial(nSamples, 0.f), outputParallel(nSamples, 0.f);
+        generateSignal(input, sampleRate, 3u);
+
+        RealtimeWorkerPool pool;
+        pool.start(nWorkers);
+        auto serial = std::make_unique<Engine>();
+        auto parallel = std::make_unique<Engine>();
+        for(Engine* engine : {serial.get(), parallel.get()})
+        {
+            engine->init(sampleRate, TestBlockSize);
+            setParameters(*engine);
+        }
+        parallel->setOctavePool(&pool);
+        process(*serial, input, outputSerial, 0u, nSamples);
+        process(*parallel, input, outputParallel, 0u, nSamples);
+        parallel->setOctavePool(nullptr);
+        pool.stop();
+
+        const size_t end = nSamples / TestBlockSize * TestBlockSize;
+        const size_t nDifferent = countDifferences(outputSerial, outputParallel, 0u, end);
+        const bool passed = nDifferent == 0u;
+        std::printf("%s octave-parallel synthesis on %u workers: %zu of %zu samples differ\n", passed ? "PASS" : "FAIL", nWorkers, nDifferent, end);
+        return passed;
+    }
+
+    // The merged-bins tier may only move energy within a group of bins of the lowest octaves: its loudest bin takes
+    // the energy of the group and keeps its pitch, every other octave reads exactly as in the tier below. Attack and
+    // decay are instant, so the displayed envelopes are the targets of the last hop. Sparsity and colour are off, as
+    // their thresholds and weights follow the loudest envelopes, which the merged ones may now be.
+    bool testMergedBins()
+    {
+        const double sampleRate = 48000.;
+        const size_t nSamples = static_cast<size_t>(sampleRate) * 2u;
+        std::vector<float> input(nSamples), output(nSamples, 0.f);
+        generateSignal(input, sampleRate, 4u);
+
+        auto coarse = std::make_unique<Engine>();
+        auto merged = std::make_unique<Engine>();
+        for(Engine* engine : {coarse.get(), merged.get()})
+        {
+            engine->init(sampleRate, TestBlockSize);
+            setParameters(*engine);
+            engine->setAttack(1.);
+            engine->setDecay(1.);
+            engine->setSparsity(0.);
+            engine->setColour(0.);
+            engine->setMaxPartials(0u);
+            process(*engine, input, output, 0u, nSamples);
+        }
+        coarse->setQualityTier(QualityCoarseEnvelopes);
+        merged->setQualityTier(QualityMergedBins);
+        process(*coarse, input, output, 0u, nSamples);
+        process(*merged, input, output, 0u, nSamples);
+
+        size_t nDifferent = 0u;
+        double groupError = 0.;
+        double lowestEnergy = 0.;
+        for(unsigned i_octave = 0u; i_octave < TestOctaves; i_octave++)
+        {
+            const double* valuesCoarse = coarse->getOctaveValues(static_cast<int>(i_octave));
+            const double* valuesMerged = merged->getOctaveValues(static_cast<int>(i_octave));
+            if(i_octave < TestOctaves - MergedOctaveNumber)
+            {
+                for(unsigned i_tone = 0u; i_tone < TestBins; i_tone++)
+                    nDifferent += valuesCoarse[i_tone] != valuesMerged[i_tone] ? 1u : 0u;
+                continue;
+            }
+            for(unsigned i_group = 0u; i_group < TestBins; i_group += MergedBinGroup)
+            {
+                unsigned loudest = i_group;
+                double energy = 0.;
+                for(unsigned i_tone = i_group; i_tone < std::min(i_group + MergedBinGroup, TestBins); i_tone++)
+                {
+                    energy += valuesCoarse[i_tone] * valuesCoarse[i_tone];
+                    loudest = valuesCoarse[i_tone] > valuesCoarse[loudest] ? i_tone : loudest;
+                }
+                for(unsigned i_tone = i_group; i_tone < std::min(i_group + MergedBinGroup, TestBins); i_tone++)
+                {
+                    const double expected = i_tone == loudest ? std::sqrt(energy) : 0.;
+                    groupError = std::max(groupError, std::abs(valuesMerged[i_tone] - expected));
+                }
+                lowestEnergy += energy;
+            }
+        }
+        const bool passed = nDifferent == 0u && groupError < 1e-9 && lowestEnergy > 0.;
+        std::printf("%s merged bins: %zu values differ above the merged octaves, largest group error %g\n", passed ? "PASS" : "FAIL", nDifferent, groupError);
+        return passed;
+    }
+
+    // The bank computes its coefficients in closed form, it has to follow the OnePoleUpDown it replaced at any rate
+    bool testEnvelopeCoefficients()
+    {
+        constexpr size_t nSamples{4000u};
+        double maxDifference = 0.;
+        for(const double rate : {48000., 375.}) // highest and lowest octave rate
+        {
+            for(const double time : {0., 0.01, 0.25, 1.})
+            {
+                EnvelopeBank<1, 1> bank;
+                bank.init(&rate);
+                bank.setSmoothingFactors(time, 0.5 * time);
+                audio_utils::OnePoleUpDown<double> reference;
+                reference.init(rate);
+                reference.setSmoothingFactors(time, 0.5 * time);
+
+                std::vector<double> outputBank(nSamples), outputReference(nSamples);
+                for(const double target : {1., 0.})
+                {
+                    bank.setTargetValue(0u, 0u, target);
+                    reference.setTargetValue(target);
+                    bank.getNextBlock(0u, outputBank.data(), nSamples);
+                    reference.getNextBlock(outputReference.data(), nSamples);
+                    for(size_t i_sample = 0u; i_sample < nSamples; i_sample++)
+                        maxDifference = std::max(maxDifference, std::abs(outputBank[i_sample] - outputReference[i_sample]));
+                }
+            }
+        }
+        const bool passed = maxDifference < 1e-9;
+        std::printf("%s envelope bank against OnePoleUpDown: largest difference %g\n", passed ? "PASS" : "FAIL", maxDifference);
+        return passed;
+    }
+
+    // A recording read back has to hold what was pushed, across several growth chunks of the file
+    bool testEnvelopeRecording()
+    {
+        constexpr unsigned nChannels{2u};
+        constexpr uint64_t nHops{6000u}; // three chunks of frames
+        constexpr unsigned nValues{TestOctaves * TestBins};
+        auto value = [](const unsigned channel, const uint64_t hop, const unsigned i_bin, const bool magnitude)
+        {
+            return static_cast<double>((hop * 7u + i_bin * 3u + channel) % 1000u) * (magnitude ? 1e-3 : 1e-4);
+        };
+
+        const std::string path = (std::filesystem::temp_directory_path() / "HarmonicReverbEngineTest.hrev").string();
+        EnvelopeRecorder<TestBins, TestOctaves> recorder;
+        bool passed = recorder.start(path, 48000., 256u);
+        std::vector<double> envelopes(nValues), magnitudes(nValues);
+        for(uint64_t hop = 0u; passed && hop < nHops; hop++)
+        {
+            for(unsigned channel = 0u; channel < nChannels; channel++)
+            {
+                for(unsigned i_bin = 0u; i_bin < nValues; i_bin++)
+                {
+                    envelopes[i_bin] = value(channel, hop, i_bin, false);
+                    magnitudes[i_bin] = value(channel, hop, i_bin, true);
+                }
+                recorder.push(channel, hop, envelopes.data(), magnitudes.data());
+            }
+            if(hop % 500u == 499u) // lets the writer keep up with the queue
+                std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        }
+        recorder.stop();
+
+        EnvelopeRecordingReader reader;
+        passed = passed && reader.open(path);
+        const uint64_t nFrames = reader.getFrameCount();
+        const EnvelopeRecordingHeader& header = reader.getHeader();
+        passed = passed && header.bins == TestBins && header.octaves == TestOctaves && header.hopSize == 256u && header.engineSampleRate == 48000.
+                 && nFrames + header.droppedFrames == nChannels * nHops;
+        size_t nDifferent = 0u;
+        for(uint64_t frame = 0u; passed && frame < nFrames; frame++)
+        {
+            const EnvelopeFrameHeader& frameHeader = reader.getFrameHeader(frame);
+            const float* frameEnvelopes = reader.getEnvelopes(frame);
+            const float* frameMagnitudes = reader.getMagnitudes(frame);
+            for(unsigned i_bin = 0u; i_bin < nValues; i_bin++)
+            {
+                nDifferent += frameEnvelopes[i_bin] != static_cast<float>(value(frameHeader.channel, frameHeader.hop, i_bin, false)) ? 1u : 0u;
+                nDifferent += frameMagnitudes[i_bin] != static_cast<float>(value(frameHeader.channel, frameHeader.hop, i_bin, true)) ? 1u : 0u;
+            }
+        }
+        const uint64_t nDropped = header.droppedFrames;
+        reader.close();
+        std::filesystem::remove(path);
+
+        passed = passed && nDifferent == 0u && nFrames > nChannels * nHops / 2u;
+        std::printf("%s envelope recording read back: %llu frames, %llu dropped, %zu values differ\n", passed ? "PASS" : "FAIL",
+                    static_cast<unsigned long long>(nFrames), static_cast<unsigned long long>(nDropped), nDifferent);
+        return passed;
+    }
+
+    // Every ISA variant the CPU supports has to match the generic kernels bit for bit
+    bool testKernelVariants(const EngineIsa isa, const char* name)
+    {
+        const EngineIsa selected = getEngineKernels().isa;
+        if(!forceEngineIsa(isa))
+        {
+            std::printf("SKIP %s kernels, not supported here\n", name);
+            return true;
+        }
+        const EngineKernels& variant = getEngineKernels();
+        forceEngineIsa(selected);
+        const EngineKernels& generic = *getEngineKernelsGeneric();
+
+        constexpr unsigned nLanes{TestBins};
+        constexpr size_t nSamples{1001u}; // leaves a remainder for every vector width
+        std::mt19937 random(4u);
+        std::uniform_real_distribution<double> uniform(-1., 1.);
+        std::vector<std::complex<double>> complexInput(nSamples);
+        std::vector<double> input(nSamples), target(nLanes);
+        for(std::complex<double>& value : complexInput)
+            value = {uniform(random), uniform(random)};
+        for(double& value : input)
+            value = uniform(random);
+        for(double& value : target)
+            value = std::abs(uniform(random));
+
+        size_t nDifferent = 0u;
+        auto compare = [&nDifferent](const double* a, const double* b, const size_t n)
+        {
+            for(size_t i = 0u; i < n; i++)
+                nDifferent += a[i] != b[i] ? 1u : 0u;
+        };
+
+        for(const unsigned stride : {1u, EnvelopeStride})
+        {
+            std::vector<double> currentA(nLanes, 0.1), currentB(nLanes, 0.1), outputA(nSamples * nLanes), outputB(nSamples * nLanes);
+            unsigned phaseA = 0u, phaseB = 0u;
+            generic.envelopeBlock(currentA.data(), target.data(), nLanes, 0.3, 0.01, outputA.data(), nSamples, stride, &phaseA);
+            variant.envelopeBlock(currentB.data(), target.data(), nLanes, 0.3, 0.01, outputB.data(), nSamples, stride, &phaseB);
+            compare(outputA.data(), outputB.data(), outputA.size());
+            nDifferent += phaseA != phaseB ? 1u : 0u;
+        }
+        {
+            std::vector<double> outputA(nSamples), outputB(nSamples);
+            generic.magnitudes(complexInput.data(), outputA.data(), nSamples);
+            variant.magnitudes(complexInput.data(), outputB.data(), nSamples);
+            compare(outputA.data(), outputB.data(), nSamples);
+            generic.thresholdGains(input.data(), outputA.data(), nSamples, 0.25);
+            variant.thresholdGains(input.data(), outputB.data(), nSamples, 0.25);
+            compare(outputA.data(), outputB.data(), nSamples);
+        }
+        {
+            std::vector<std::complex<double>> outputA(nSamples), outputB(nSamples);
+            std::vector<double> modulation(nSamples * nLanes);
+            for(double& value : modulation)
+                value = uniform(random);
+            generic.modulate(complexInput.data(), modulation.data(), nLanes, outputA.data(), nSamples);
+            variant.modulate(complexInput.data(), modulation.data(), nLanes, outputB.data(), nSamples);
+            compare(reinterpret_cast<const double*>(outputA.data()), reinterpret_cast<const double*>(outputB.data()), 2u * nSamples);
+        }
+
+        const bool passed = nDifferent == 0u;
+        std::printf("%s %s kernels against generic: %zu values differ\n", passed ? "PASS" : "FAIL", name, nDifferent);
+        return passed;
+    }
+}
+
+int main()
+{
+    bool passed = true;
+    passed = testStateRoundTrip(48000., 0., false) && passed;
+    passed = testStateRoundTrip(44100., 48000., false) && passed;
+    passed = testStateRoundTrip(48000., 0., true) && passed;
+    passed = testSharedAnalysisRoundTrip() && passed;
+    passed = testResampledBlockSizes(44100., 48000.) && passed;
+    passed = testResampledBlockSizes(96000., 48000.) && passed;
+    passed = testOctaveParallel(3u) && passed;
+    passed = testMergedBins() && passed;
+    passed = testEnvelopeCoefficients() && passed;
+    passed = testEnvelopeRecording() && passed;
+    passed = testKernelVariants(EngineIsa::Avx2, "avx2") && passed;
+    passed = testKernelVariants(EngineIsa::Avx512, "avx512") && passed;
+    return passed ? 0 : 1;
+}
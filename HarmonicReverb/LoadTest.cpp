@@ -0,0 +1,306 @@
+// Session-scale load test: runs many stereo engine instances on a fixed number of threads, one simulated audio
+// callback at a time, and reports how the callback time compares to its deadline as the instance count grows.
+//
+//   HarmonicReverbLoadTest [--instances 1,8,16,32,64] [--threads 4] [--block-size 256] [--sample-rate 48000]
+//                          [--seconds 10] [--internal-rate 0] [--octaves 0,8] [--trace file.json]
+//
+// Instances use the bare engine, so the numbers exclude host and plugin wrapper overhead. --octaves sets the active
+// octave window of every engine; octaves outside it skip features and synthesis, the analysis still runs for all. Builds with
+// HARMONIC_REVERB_TRACING write a timeline of all runs to the --trace file, see include/Tracing.h.
+
+#include "../include/CqtReverb.h"
+#include "../include/RealtimeWorkerPool.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+ #include <unistd.h>
+#elif defined(__APPLE__)
+ #include <mach/mach.h>
+#endif
+
+constexpr unsigned LoadTestBins{12};
+constexpr unsigned LoadTestOctaves{9};
+constexpr unsigned ChannelsPerInstance{2u};
+
+using Engine = CqtReverb<LoadTestBins, LoadTestOctaves>;
+
+namespace
+{
+    struct Settings
+    {
+        std::vector<unsigned> instanceCounts{1u, 8u, 16u, 32u, 64u};
+        unsigned threads{std::max(1u, std::thread::hardware_concurrency())};
+        int blockSize{256};
+        double sampleRate{48000.};
+        double seconds{10.};
+        double internalRate{0.};
+        unsigned firstOctave{0u};
+        unsigned lastOctave{LoadTestOctaves - 1u};
+        std::string tracePath;
+    };
+
+    // Typical track content, cycled over the instances
+    enum class Content
+    {
+        Noise,
+        Chord,
+        Drums,
+        Silence,
+        Count
+    };
+
+    const char* contentName(const Content content)
+    {
+        switch(content)
+        {
+            case Content::Noise: return "noise";
+            case Content::Chord: return "chord";
+            case Content::Drums: return "drums";
+            default: return "silence";
+        }
+    }
+
+    void generateContent(const Content content, const double sampleRate, std::vector<float>& signal, const unsigned seed)
+    {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+        const double twoPi = 6.283185307179586;
+        for(size_t i_sample = 0u; i_sample < signal.size(); i_sample++)
+        {
+            const double t = static_cast<double>(i_sample) / sampleRate;
+            switch(content)
+            {
+                case Content::Noise:
+                    signal[i_sample] = 0.25f * uniform(random);
+                    break;
+                case Content::Chord:
+                    signal[i_sample] = static_cast<float>(0.2 * (std::sin(twoPi * 220. * t) + std::sin(twoPi * 277.18 * t) + std::sin(twoPi * 329.63 * t)));
+                    break;
+                case Content::Drums:
+                {
+                    // decaying noise burst every half second
+                    const double sinceHit = std::fmod(t, 0.5);
+                    signal[i_sample] = static_cast<float>(std::exp(-sinceHit * 30.)) * uniform(random);
+                    break;
+                }
+                default:
+                    signal[i_sample] = 0.f;
+                    break;
+            }
+        }
+    }
+
+    size_t residentMemoryBytes()
+    {
+       #if defined(__linux__)
+        long pages = 0;
+        long resident = 0;
+        if(FILE* statm = std::fopen("/proc/self/statm", "r"))
+        {
+            if(std::fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+                resident = 0;
+            std::fclose(statm);
+        }
+        return static_cast<size_t>(resident) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+       #elif defined(__APPLE__)
+        mach_task_basic_info info;
+        mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+        if(task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS)
+            return 0u;
+        return static_cast<size_t>(info.resident_size);
+       #else
+        return 0u;
+       #endif
+    }
+
+    std::vector<unsigned> parseList(const char* text)
+    {
+        std::vector<unsigned> values;
+        std::string item;
+        for(const char* c = text; ; c++)
+        {
+            if(*c == ',' || *c == '\0')
+            {
+                if(!item.empty())
+                    values.push_back(static_cast<unsigned>(std::strtoul(item.c_str(), nullptr, 10)));
+                item.clear();
+                if(*c == '\0')
+                    break;
+            }
+            else
+            {
+                item += *c;
+            }
+        }
+        return values;
+    }
+
+    bool parseArguments(const int argc, char** argv, Settings& settings)
+    {
+        for(int i_arg = 1; i_arg < argc; i_arg++)
+        {
+            const std::string name = argv[i_arg];
+            if(name == "--help" || i_arg + 1 >= argc)
+                return false;
+            const char* value = argv[++i_arg];
+            if(name == "--instances")
+                settings.instanceCounts = parseList(value);
+            else if(name == "--threads")
+                settings.threads = std::max(1u, static_cast<unsigned>(std::strtoul(value, nullptr, 10)));
+            else if(name == "--block-size")
+                settings.blockSize = std::max(1, std::atoi(value));
+            else if(name == "--sample-rate")
+                settings.sampleRate = std::atof(value);
+            else if(name == "--seconds")
+                settings.seconds = std::atof(value);
+            else if(name == "--internal-rate")
+                settings.internalRate = std::atof(value);
+            else if(name == "--octaves")
+            {
+                const std::vector<unsigned> octaves = parseList(value);
+                if(octaves.size() != 2u || octaves[0] > octaves[1] || octaves[1] >= LoadTestOctaves)
+                    return false;
+                settings.firstOctave = octaves[0];
+                settings.lastOctave = octaves[1];
+            }
+            else if(name == "--trace")
+                settings.tracePath = value;
+            else
+                return false;
+        }
+        return !settings.instanceCounts.empty() && settings.sampleRate > 0. && settings.seconds > 0.;
+    }
+
+    double percentile(std::vector<double>& values, const double fraction)
+    {
+        if(values.empty())
+            return 0.;
+        const size_t index = std::min(values.size() - 1u, static_cast<size_t>(fraction * static_cast<double>(values.size())));
+        std::nth_element(values.begin(), values.begin() + static_cast<std::ptrdiff_t>(index), values.end());
+        return values[index];
+    }
+
+    struct Session
+    {
+        std::vector<std::unique_ptr<Engine>> engines;   // ChannelsPerInstance per instance
+        std::vector<std::vector<float>> inputs;         // one loop of content per engine
+        std::vector<std::vector<float>> outputs;
+    };
+
+    void runSession(const Settings& settings, const unsigned nInstances, RealtimeWorkerPool& pool)
+    {
+        const size_t memoryBefore = residentMemoryBytes();
+        const unsigned nEngines = nInstances * ChannelsPerInstance;
+        const size_t loopLength = static_cast<size_t>(settings.sampleRate) * 4u / static_cast<size_t>(settings.blockSize) * static_cast<size_t>(settings.blockSize);
+
+        Session session;
+        for(unsigned i_engine = 0u; i_engine < nEngines; i_engine++)
+        {
+            session.engines.push_back(std::make_unique<Engine>());
+            session.engines.back()->init(settings.sampleRate, settings.blockSize, settings.internalRate);
+            session.engines.back()->setActiveOctaves(settings.firstOctave, settings.lastOctave);
+            const Content content = static_cast<Content>((i_engine / ChannelsPerInstance) % static_cast<unsigned>(Content::Count));
+            session.inputs.emplace_back(loopLength, 0.f);
+            generateContent(content, settings.sampleRate, session.inputs.back(), i_engine);
+            session.outputs.emplace_back(settings.blockSize, 0.f);
+        }
+        const size_t memoryAfter = residentMemoryBytes();
+
+        const double deadline = static_cast<double>(settings.blockSize) / settings.sampleRate;
+        const size_t nCallbacks = static_cast<size_t>(settings.seconds / deadline);
+        std::vector<double> callbackTimes;
+        callbackTimes.reserve(nCallbacks);
+
+        // Every thread takes a contiguous group of engines, like a host spreading tracks over its audio threads
+        const unsigned nTasks = std::min(settings.threads, nEngines);
+        size_t position = 0u;
+        auto groupTask = [&session, &settings, &position, nEngines, nTasks](const unsigned i_task)
+        {
+            const unsigned first = (nEngines * i_task) / nTasks;
+            const unsigned last = (nEngines * (i_task + 1u)) / nTasks;
+            for(unsigned i_engine = first; i_engine < last; i_engine++)
+            {
+                ScopedTrace engineTrace("engine", static_cast<int>(i_engine));
+                session.engines[i_engine]->processBlock(session.inputs[i_engine].data() + position, session.outputs[i_engine].data(), settings.blockSize);
+            }
+        };
+
+        const auto sessionStart = std::chrono::steady_clock::now();
+        for(size_t i_callback = 0u; i_callback < nCallbacks; i_callback++)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            {
+                ScopedTrace callbackTrace("callback", static_cast<int>(nInstances));
+                pool.parallelFor(nTasks, groupTask);
+            }
+            callbackTimes.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            position += static_cast<size_t>(settings.blockSize);
+            if(position + static_cast<size_t>(settings.blockSize) > loopLength)
+                position = 0u;
+        }
+        const double wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - sessionStart).count();
+
+        size_t deadlineMisses = 0u;
+        for(const double time : callbackTimes)
+            deadlineMisses += time > deadline ? 1u : 0u;
+        const double realtimeFactor = static_cast<double>(nCallbacks) * deadline / wallTime;
+        const double p50 = percentile(callbackTimes, 0.5);
+        const double p99 = percentile(callbackTimes, 0.99);
+        const double p999 = percentile(callbackTimes, 0.999);
+        const double maxTime = percentile(callbackTimes, 1.);
+        const double toPercent = 100. / deadline;
+        std::printf("%9u %8.2fx %7.1f%% %7.1f%% %7.1f%% %7.1f%% %8zu %9.1f\n",
+                    nInstances, realtimeFactor, p50 * toPercent, p99 * toPercent, p999 * toPercent, maxTime * toPercent,
+                    deadlineMisses, static_cast<double>(memoryAfter > memoryBefore ? memoryAfter - memoryBefore : 0u) / (1024. * 1024.));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Settings settings;
+    if(!parseArguments(argc, argv, settings))
+    {
+        std::fprintf(stderr, "usage: %s [--instances 1,8,16,32,64] [--threads n] [--block-size n] [--sample-rate hz] [--seconds s] [--internal-rate hz] [--octaves first,last] [--trace file.json]\n", argv[0]);
+        return 1;
+    }
+#if HARMONIC_REVERB_TRACING
+    if(!settings.tracePath.empty() && !Tracer::get().start(settings.tracePath))
+    {
+        std::fprintf(stderr, "cannot write trace to %s\n", settings.tracePath.c_str());
+        return 1;
+    }
+#else
+    if(!settings.tracePath.empty())
+        std::fprintf(stderr, "built without HARMONIC_REVERB_TRACING, no trace is written\n");
+#endif
+
+    std::printf("%u threads, block size %d, %.0f Hz, %.1f s per run, %s kernels, octaves %u to %u, stereo instances cycling",
+                settings.threads, settings.blockSize, settings.sampleRate, settings.seconds, getEngineKernels().name, settings.firstOctave, settings.lastOctave);
+    for(unsigned i_content = 0u; i_content < static_cast<unsigned>(Content::Count); i_content++)
+        std::printf(" %s", contentName(static_cast<Content>(i_content)));
+    std::printf("\ncallback times in percent of the deadline\n");
+    std::printf("%9s %9s %8s %8s %8s %8s %8s %9s\n", "instances", "realtime", "p50", "p99", "p99.9", "max", "misses", "memory MB");
+
+    RealtimeWorkerPool pool;
+    pool.start(settings.threads - 1u);
+    for(const unsigned nInstances : settings.instanceCounts)
+    {
+        if(nInstances > 0u)
+            runSession(settings, nInstances, pool);
+    }
+    pool.stop();
+#if HARMONIC_REVERB_TRACING
+    if(!settings.tracePath.empty())
+        Tracer::get().stop();
+#endif
+    return 0;
+}
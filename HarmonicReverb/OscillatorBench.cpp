@@ -0,0 +1,199 @@
+// Oscillator policy benchmark: cost per generated sample of one bin oscillator and the level of the strongest
+// spurious tone, for each policy in include/OscillatorPolicies.h.
+//
+//   HarmonicReverbOscillatorBench [--blocks 2000] [--sample-rate 48000]
+//
+// Cost is measured on a full bank of 12 x 9 oscillators at the bin frequencies, in time stamp counter cycles on
+// x86 and nanoseconds elsewhere. Spurious tones are measured on carriers centred on FFT bins, so the carrier does
+// not leak and every other bin holds only the oscillator's error. The FFT is much longer than the largest table,
+// so the carriers fall between table entries.
+
+#include "../include/OscillatorPolicies.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+ #if defined(_MSC_VER)
+  #include <intrin.h>
+ #else
+  #include <x86intrin.h>
+ #endif
+ #define OSCILLATOR_BENCH_TSC 1
+#else
+ #define OSCILLATOR_BENCH_TSC 0
+#endif
+
+constexpr unsigned BenchBins{12};
+constexpr unsigned BenchOctaves{9};
+constexpr size_t BenchBlockSize{256u};
+constexpr size_t SpurFftSize{1u << 18u};
+constexpr size_t SpurCarriers[]{37u, 12343u, 101999u}; // FFT bins, primes so table positions do not repeat early
+
+namespace
+{
+    struct Settings
+    {
+        unsigned blocks{2000u};
+        double sampleRate{48000.};
+    };
+
+    struct Result
+    {
+        double costPerSample;
+        double spurLevelDb;
+    };
+
+    inline uint64_t readClock()
+    {
+#if OSCILLATOR_BENCH_TSC
+        return static_cast<uint64_t>(__rdtsc());
+#else
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    template <typename Policy>
+    double measureCost(const Settings& settings)
+    {
+        auto shared = getSharedOscillatorResource<typename Policy::Shared>();
+        std::vector<typename Policy::Oscillator> oscillators(BenchBins * BenchOctaves);
+        for(unsigned i_bin = 0u; i_bin < BenchBins * BenchOctaves; i_bin++)
+        {
+            oscillators[i_bin].init(settings.sampleRate, shared.get());
+            oscillators[i_bin].setFrequency(27.5 * std::pow(2., static_cast<double>(i_bin) / static_cast<double>(BenchBins)));
+        }
+
+        std::vector<std::complex<double>> buffer(BenchBlockSize);
+        double checksum = 0.;
+        uint64_t start = 0u;
+        // the first tenth warms up caches and is not counted
+        const unsigned warmup = settings.blocks / 10u;
+        for(unsigned i_block = 0u; i_block < warmup + settings.blocks; i_block++)
+        {
+            if(i_block == warmup)
+                start = readClock();
+            for(auto& oscillator : oscillators)
+            {
+                oscillator.generateBlock(buffer.data(), BenchBlockSize);
+                checksum += buffer[BenchBlockSize - 1u].real();
+            }
+        }
+        const uint64_t elapsed = readClock() - start;
+        if(checksum == 12345.)
+            std::printf(" ");
+        return static_cast<double>(elapsed) / (static_cast<double>(settings.blocks) * static_cast<double>(oscillators.size()) * static_cast<double>(BenchBlockSize));
+    }
+
+    // In-place radix-2 FFT, twiddles holds exp(-i 2 pi n / size) for n < size / 2
+    void fft(std::vector<std::complex<double>>& data, const std::vector<std::complex<double>>& twiddles)
+    {
+        const size_t size = data.size();
+        for(size_t i = 1u, j = 0u; i < size; i++)
+        {
+            size_t bit = size >> 1u;
+            for(; j & bit; bit >>= 1u)
+                j ^= bit;
+            j ^= bit;
+            if(i < j)
+                std::swap(data[i], data[j]);
+        }
+        for(size_t length = 2u; length <= size; length <<= 1u)
+        {
+            const size_t stride = size / length;
+            for(size_t start = 0u; start < size; start += length)
+            {
+                for(size_t k = 0u; k < length / 2u; k++)
+                {
+                    const std::complex<double> odd = data[start + k + length / 2u] * twiddles[k * stride];
+                    data[start + k + length / 2u] = data[start + k] - odd;
+                    data[start + k] += odd;
+                }
+            }
+        }
+    }
+
+    // Strongest non-carrier FFT bin relative to the carrier, worst over all carriers
+    template <typename Policy>
+    double measureSpurLevel(const std::vector<std::complex<double>>& twiddles)
+    {
+        auto shared = getSharedOscillatorResource<typename Policy::Shared>();
+        std::vector<std::complex<double>> signal(SpurFftSize);
+        double worstDb = -400.;
+        for(const size_t carrier : SpurCarriers)
+        {
+            // frequency relative to a sample rate of one
+            typename Policy::Oscillator oscillator;
+            oscillator.init(1., shared.get());
+            oscillator.setFrequency(static_cast<double>(carrier) / static_cast<double>(SpurFftSize));
+            oscillator.generateBlock(signal.data(), SpurFftSize);
+            fft(signal, twiddles);
+
+            double spurMagnitude = 0.;
+            for(size_t k = 0u; k < SpurFftSize; k++)
+            {
+                if(k != carrier)
+                    spurMagnitude = std::max(spurMagnitude, std::abs(signal[k]));
+            }
+            const double carrierMagnitude = std::abs(signal[carrier]);
+            const double levelDb = 20. * std::log10(std::max(spurMagnitude, 1e-300) / carrierMagnitude);
+            worstDb = std::max(worstDb, levelDb);
+        }
+        return worstDb;
+    }
+
+    template <typename Policy>
+    void runPolicy(const char* name, const Settings& settings, const std::vector<std::complex<double>>& twiddles)
+    {
+        const Result result{measureCost<Policy>(settings), measureSpurLevel<Policy>(twiddles)};
+        std::printf("%-22s %12.2f %14.1f\n", name, result.costPerSample, result.spurLevelDb);
+    }
+
+    bool parseArguments(int argc, char* argv[], Settings& settings)
+    {
+        for(int i_arg = 1; i_arg < argc; i_arg++)
+        {
+            const std::string argument = argv[i_arg];
+            if(i_arg + 1 >= argc)
+                return false;
+            const char* value = argv[++i_arg];
+            if(argument == "--blocks")
+                settings.blocks = static_cast<unsigned>(std::max(1, std::atoi(value)));
+            else if(argument == "--sample-rate")
+                settings.sampleRate = std::atof(value);
+            else
+                return false;
+        }
+        return settings.sampleRate > 0.;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Settings settings;
+    if(!parseArguments(argc, argv, settings))
+    {
+        std::fprintf(stderr, "usage: %s [--blocks 2000] [--sample-rate 48000]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<std::complex<double>> twiddles(SpurFftSize / 2u);
+    for(size_t n = 0u; n < twiddles.size(); n++)
+        twiddles[n] = std::polar(1., -6.283185307179586 * static_cast<double>(n) / static_cast<double>(SpurFftSize));
+
+    std::printf("%-22s %12s %14s\n", "policy", OSCILLATOR_BENCH_TSC ? "cycles/smp" : "ns/smp", "spur dBc");
+    runPolicy<AudioUtilsWavetablePolicy<512u>>("audio-utils 512", settings, twiddles);
+    runPolicy<WavetablePolicy<256u, TableInterpolation::Nearest>>("table 256 nearest", settings, twiddles);
+    runPolicy<WavetablePolicy<4096u, TableInterpolation::Nearest>>("table 4096 nearest", settings, twiddles);
+    runPolicy<WavetablePolicy<512u, TableInterpolation::Linear>>("table 512 linear", settings, twiddles);
+    runPolicy<WavetablePolicy<2048u, TableInterpolation::Linear>>("table 2048 linear", settings, twiddles);
+    runPolicy<PhasorPolicy<64u>>("phasor renorm 64", settings, twiddles);
+    runPolicy<PhasorPolicy<1024u>>("phasor renorm 1024", settings, twiddles);
+    return 0;
+}
@@ -38,17 +38,19 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAud
     mVersionLabel.setJustificationType (juce::Justification::left);
     mWebsiteLabel.setJustificationType (juce::Justification::right);
 
-    // Get parameters saved in processor
-    const float attackParameter = mParameters.getParameterAsValue("attack").getValue();
-    const float decayParameter = mParameters.getParameterAsValue("decay").getValue();
-    const float octaveShiftParameter = mParameters.getParameterAsValue("octaveShift").getValue();
-    const float octaveMixParameter = mParameters.getParameterAsValue("octaveMix").getValue();
+    // Get parameters saved in processor, the per-voice ones are loaded with the voice selection below
     const float tuningParameter = mParameters.getParameterAsValue("tuning").getValue();
-    const float colourParameter = mParameters.getParameterAsValue("colour").getValue();
-    const float sparsityParameter = mParameters.getParameterAsValue("sparsity").getValue();
     const float mixParameter = mParameters.getParameterAsValue("mix").getValue();
     const float gainParameter = mParameters.getParameterAsValue("gain").getValue();
     const float masterParameter = mParameters.getParameterAsValue("master").getValue();
+    const int maxPartialsParameter = mParameters.getParameterAsValue("maxPartials").getValue();
+    const float cpuBudgetParameter = mParameters.getParameterAsValue("cpuBudget").getValue();
+    const int lowOctaveParameter = mParameters.getParameterAsValue("lowOctave").getValue();
+    const int highOctaveParameter = mParameters.getParameterAsValue("highOctave").getValue();
+    const int scaleParameter = mParameters.getParameterAsValue("scale").getValue();
+    const int scaleRootParameter = mParameters.getParameterAsValue("scaleRoot").getValue();
+    const bool freezeParameter = mParameters.getParameterAsValue("freeze").getValue();
+    const bool internalRateParameter = mParameters.getParameterAsValue("internalRate").getValue();
 
     // Controls
     addAndMakeVisible(mAttackLabel);
@@ -61,6 +63,10 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAud
     addAndMakeVisible(mGainLabel);
     addAndMakeVisible(mMixLabel);
     addAndMakeVisible(mMasterLabel);
+    addAndMakeVisible(mMaxPartialsLabel);
+    addAndMakeVisible(mCpuBudgetLabel);
+    addAndMakeVisible(mLowOctaveLabel);
+    addAndMakeVisible(mHighOctaveLabel);
 
     addAndMakeVisible(mAttackSlider);
     addAndMakeVisible(mDecaySlider);
@@ -72,6 +78,10 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAud
     addAndMakeVisible(mGainSlider);
     addAndMakeVisible(mMixSlider);
     addAndMakeVisible(mMasterSlider);
+    addAndMakeVisible(mMaxPartialsSlider);
+    addAndMakeVisible(mCpuBudgetSlider);
+    addAndMakeVisible(mLowOctaveSlider);
+    addAndMakeVisible(mHighOctaveSlider);
 
     mAttackLabel.setText("Attack", juce::dontSendNotification);
     mDecayLabel.setText("Decay", juce::dontSendNotification);
@@ -83,30 +93,26 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAud
     mGainLabel.setText("Gain", juce::dontSendNotification);
     mMixLabel.setText("Mix", juce::dontSendNotification);
     mMasterLabel.setText("Master", juce::dontSendNotification);
+    mMaxPartialsLabel.setText("MaxPartials", juce::dontSendNotification);
+    mCpuBudgetLabel.setText("CpuBudget", juce::dontSendNotification);
+    mLowOctaveLabel.setText("LowOctave", juce::dontSendNotification);
+    mHighOctaveLabel.setText("HighOctave", juce::dontSendNotification);
 
     mAttackSlider.setRange(std::get<0>(AttackRange), std::get<1>(AttackRange), 0.01);
-    mAttackSlider.setValue(attackParameter, juce::dontSendNotification);
     mAttackSlider.setTextValueSuffix ("");
     mAttackSlider.onValueChange = [this]{attackSliderChanged();};
-    attackSliderChanged();
 
     mDecaySlider.setRange(std::get<0>(DecayRange), std::get<1>(DecayRange), 0.01);
-    mDecaySlider.setValue(decayParameter, juce::dontSendNotification);
     mDecaySlider.setTextValueSuffix ("");
     mDecaySlider.onValueChange = [this]{decaySliderChanged();};
-    decaySliderChanged();
 
     mOctaveShiftSlider.setRange(std::get<0>(OctaveShiftRange), std::get<1>(OctaveShiftRange), 0.01);
-    mOctaveShiftSlider.setValue(octaveShiftParameter, juce::dontSendNotification);
     mOctaveShiftSlider.setTextValueSuffix ("");
     mOctaveShiftSlider.onValueChange = [this]{octaveShiftSliderChanged();};
-    octaveShiftSliderChanged();
 
     mOctaveMixSlider.setRange(std::get<0>(OctaveMixRange), std::get<1>(OctaveMixRange), 0.01);
-    mOctaveMixSlider.setValue(octaveMixParameter, juce::dontSendNotification);
     mOctaveMixSlider.setTextValueSuffix ("%");
     mOctaveMixSlider.onValueChange = [this]{octaveMixSliderChanged();};
-    octaveMixSliderChanged();
 
     mTuningSlider.setRange(std::get<0>(TuningRange), std::get<1>(TuningRange), 0.01);
     mTuningSlider.setValue(tuningParameter, juce::dontSendNotification);
@@ -115,16 +121,12 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAud
     tuningSliderChanged();
 
     mColourSlider.setRange(std::get<0>(ColourRange), std::get<1>(ColourRange), 0.01);
-    mColourSlider.setValue(colourParameter, juce::dontSendNotification);
     mColourSlider.setTextValueSuffix ("");
     mColourSlider.onValueChange = [this]{colourSliderChanged();};
-    colourSliderChanged();
 
     mSparsitySlider.setRange(std::get<0>(SparsityRange), std::get<1>(SparsityRange), 0.01);
-    mSparsitySlider.setValue(sparsityParameter, juce::dontSendNotification);
     mSparsitySlider.setTextValueSuffix ("");
     mSparsitySlider.onValueChange = [this]{sparsitySliderChanged();};
-    sparsitySliderChanged();
 
     mGainSlider.setRange(std::get<0>(GainRange), std::get<1>(GainRange), 0.01);
     mGainSlider.setValue(gainParameter, juce::dontSendNotification);
@@ -144,9 +146,102 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAud
     mMasterSlider.onValueChange = [this]{masterSliderChanged();};
     masterSliderChanged();
 
+    mMaxPartialsSlider.setRange(std::get<0>(MaxPartialsRange), std::get<1>(MaxPartialsRange), 1);
+    mMaxPartialsSlider.setValue(maxPartialsParameter, juce::dontSendNotification);
+    mMaxPartialsSlider.textFromValueFunction = [](double value){ return value < 0.5 ? juce::String("Off") : juce::String(juce::roundToInt(value)); };
+    mMaxPartialsSlider.onValueChange = [this]{maxPartialsSliderChanged();};
+    maxPartialsSliderChanged();
+
+    mCpuBudgetSlider.setRange(std::get<0>(CpuBudgetRange), std::get<1>(CpuBudgetRange), 0.01);
+    mCpuBudgetSlider.setValue(cpuBudgetParameter, juce::dontSendNotification);
+    mCpuBudgetSlider.setTextValueSuffix ("");
+    mCpuBudgetSlider.onValueChange = [this]{cpuBudgetSliderChanged();};
+    cpuBudgetSliderChanged();
+
+    mLowOctaveSlider.setRange(std::get<0>(LowOctaveRange), std::get<1>(LowOctaveRange), 1);
+    mLowOctaveSlider.setValue(lowOctaveParameter, juce::dontSendNotification);
+    mLowOctaveSlider.setTextValueSuffix ("");
+    mLowOctaveSlider.onValueChange = [this]{lowOctaveSliderChanged();};
+    lowOctaveSliderChanged();
+
+    mHighOctaveSlider.setRange(std::get<0>(HighOctaveRange), std::get<1>(HighOctaveRange), 1);
+    mHighOctaveSlider.setValue(highOctaveParameter, juce::dontSendNotification);
+    mHighOctaveSlider.setTextValueSuffix ("");
+    mHighOctaveSlider.onValueChange = [this]{highOctaveSliderChanged();};
+    highOctaveSliderChanged();
+
+    // Toggles
+    addAndMakeVisible(mFreezeButton);
+    mFreezeButton.setButtonText("Freeze");
+    mFreezeButton.setClickingTogglesState(true);
+    mFreezeButton.setColour(juce::TextButton::buttonOnColourId, juce::Colour::fromHSV(0.57, 0.98, 0.725, 1.f));
+    mFreezeButton.setToggleState(freezeParameter, juce::dontSendNotification);
+    mFreezeButton.onClick = [this]{freezeButtonChanged();};
+    freezeButtonChanged();
+
+    addAndMakeVisible(mInternalRateButton);
+    mInternalRateButton.setButtonText("48k");
+    mInternalRateButton.setTooltip("Run the engine at a fixed internal rate of 48 kHz");
+    mInternalRateButton.setClickingTogglesState(true);
+    mInternalRateButton.setColour(juce::TextButton::buttonOnColourId, juce::Colour::fromHSV(0.57, 0.98, 0.725, 1.f));
+    mInternalRateButton.setToggleState(internalRateParameter, juce::dontSendNotification);
+    mInternalRateButton.onClick = [this]{internalRateButtonChanged();};
+    internalRateButtonChanged();
+
+    addAndMakeVisible(mRecordButton);
+    mRecordButton.setButtonText("Rec");
+    mRecordButton.setTooltip("Record envelopes and CQT magnitudes to Documents/HarmonicReverb");
+    mRecordButton.setClickingTogglesState(true);
+    mRecordButton.setColour(juce::TextButton::buttonOnColourId, juce::Colour::fromHSV(0.0, 0.98, 0.725, 1.f));
+    mRecordButton.setToggleState(processorRef.isRecording(), juce::dontSendNotification);
+    mRecordButton.onClick = [this]{recordButtonChanged();};
+
+    addAndMakeVisible(mWaterfallButton);
+    mWaterfallButton.setButtonText("Time");
+    mWaterfallButton.setTooltip("Show the envelopes of the last seconds as a scrolling waterfall");
+    mWaterfallButton.setClickingTogglesState(true);
+    mWaterfallButton.setColour(juce::TextButton::buttonOnColourId, juce::Colour::fromHSV(0.57, 0.98, 0.725, 1.f));
+    mWaterfallButton.onClick = [this]{waterfallButtonChanged();};
+
+    // Voice selection, every voice is loaded once so the processor gets all saved values
+    addAndMakeVisible(mVoiceBox);
+    mVoiceBox.addItem("Main", 1);
+    for(unsigned i_voice = 1u; i_voice < VoiceNumber; i_voice++)
+        mVoiceBox.addItem("Wet " + juce::String(i_voice + 1u), static_cast<int>(i_voice) + 1);
+    mVoiceBox.setTooltip("Voice edited by Attack, Decay, OctaveShift, OctaveMix, Colour and Sparsity");
+    mVoiceBox.onChange = [this]{voiceBoxChanged();};
+    for(int i_voice = static_cast<int>(VoiceNumber) - 1; i_voice >= 0; i_voice--)
+        mVoiceBox.setSelectedId(i_voice + 1, juce::sendNotificationSync);
+
+    // Scale, the root has no effect on the chromatic and MIDI scales
+    addAndMakeVisible(mScaleBox);
+    for(unsigned i_scale = 0u; i_scale < ScaleNumber; i_scale++)
+        mScaleBox.addItem(ScaleNames[i_scale], static_cast<int>(i_scale) + 1);
+    mScaleBox.setTooltip("Pitches synthesized by the reverb, MIDI follows the held notes");
+    mScaleBox.setSelectedId(scaleParameter + 1, juce::dontSendNotification);
+    mScaleBox.onChange = [this]{scaleBoxChanged();};
+
+    addAndMakeVisible(mScaleRootBox);
+    const char *rootNames[12]{"C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"};
+    for(int i_root = 0; i_root < 12; i_root++)
+        mScaleRootBox.addItem(rootNames[i_root], i_root + 1);
+    mScaleRootBox.setTooltip("Root of the scale");
+    mScaleRootBox.setSelectedId(scaleRootParameter + 1, juce::dontSendNotification);
+    mScaleRootBox.onChange = [this]{scaleBoxChanged();};
+    scaleBoxChanged();
+
+    // Quality tier, stepped by the processor under CPU pressure
+    addAndMakeVisible(mQualityLabel);
+    mQualityLabel.setColour (juce::Label::textColourId, juce::Colours::white);
+    mQualityLabel.setJustificationType (juce::Justification::centredLeft);
+    timerCallback();
+    startTimerHz(4);
+
     // Spectral display
     addAndMakeVisible(mSpectralComponent);
     mSpectralComponent.setRangeMin(-80.);
+    addChildComponent(mWaterfallComponent);
+    mWaterfallComponent.setRangeMin(-80.);
 
     // Tooltips
     mFrequencyTooltip.setMillisecondsBeforeTipAppears(100);
@@ -157,6 +252,7 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAud
 
 AudioPluginAudioProcessorEditor::~AudioPluginAudioProcessorEditor()
 {
+    stopTimer();
     setLookAndFeel (nullptr);
 }
 
@@ -188,14 +284,45 @@ void AudioPluginAudioProcessorEditor::resized()
     mVersionLabel.setFont (juce::Font (WebsiteSize * labelScaling, juce::Font::bold));
     mWebsiteLabel.setFont (juce::Font (WebsiteSize * labelScaling, juce::Font::bold));
 
+    // Toggles, between version and heading
+    constexpr size_t N_BUTTONS = 2u;
+    juce::TextButton* buttonArray[N_BUTTONS] = {&mFreezeButton, &mInternalRateButton};
+    const float buttonWidthFrac = 0.06f;
+    auto buttonRect = headingRect.reduced(0.f, 0.2f * headingRect.getHeight());
+    buttonRect.setLeft(headingRect.getX() + 0.18f * headingRect.getWidth());
+    buttonRect.setWidth(buttonWidthFrac * headingRect.getWidth());
+    for(size_t i_button = 0u; i_button < N_BUTTONS; i_button++)
+    {
+        buttonArray[i_button]->setBounds(buttonRect.reduced(0.05f * buttonRect.getWidth(), 0.f).toNearestIntEdges());
+        buttonRect.translate(buttonRect.getWidth(), 0.f);
+    }
+    buttonRect.setWidth(0.12f * headingRect.getWidth());
+    mQualityLabel.setBounds(buttonRect.toNearestIntEdges());
+    mQualityLabel.setFont (juce::Font (LabelSize * labelScaling, juce::Font::bold));
+    buttonRect.translate(buttonRect.getWidth(), 0.f);
+    buttonRect.setWidth(0.07f * headingRect.getWidth());
+    mScaleBox.setBounds(buttonRect.reduced(0.02f * buttonRect.getWidth(), 0.f).toNearestIntEdges());
+    buttonRect.translate(buttonRect.getWidth(), 0.f);
+    buttonRect.setWidth(0.045f * headingRect.getWidth());
+    mScaleRootBox.setBounds(buttonRect.reduced(0.02f * buttonRect.getWidth(), 0.f).toNearestIntEdges());
+    buttonRect.setX(headingRect.getX() + 0.54f * headingRect.getWidth());
+    buttonRect.setWidth(buttonWidthFrac * headingRect.getWidth());
+    mWaterfallButton.setBounds(buttonRect.reduced(0.05f * buttonRect.getWidth(), 0.f).toNearestIntEdges());
+    buttonRect.translate(buttonRect.getWidth(), 0.f);
+    mRecordButton.setBounds(buttonRect.reduced(0.05f * buttonRect.getWidth(), 0.f).toNearestIntEdges());
+    buttonRect.translate(buttonRect.getWidth(), 0.f);
+    buttonRect.setWidth(0.1f * headingRect.getWidth());
+    mVoiceBox.setBounds(buttonRect.toNearestIntEdges());
+
     // Spectrum
     auto spectrumRect = b;
     spectrumRect.setTop(b.getHeight() * controlYFrac);
     spectrumRect.setBottom(b.getHeight() - b.getHeight() * headingYFrac);
     mSpectralComponent.setBounds(spectrumRect.toNearestIntEdges());
+    mWaterfallComponent.setBounds(spectrumRect.toNearestIntEdges());
 
     // Controls
-    constexpr size_t N_CONTROLS = 10u;
+    constexpr size_t N_CONTROLS = 14u;
     constexpr size_t N_ROWS = 2u;
     constexpr size_t N_COLUMNS= N_CONTROLS / N_ROWS;
     const float nControls = static_cast<float>(N_CONTROLS);
@@ -203,10 +330,10 @@ void AudioPluginAudioProcessorEditor::resized()
     const float nControlsPerRow = static_cast<float>(N_COLUMNS);
     const float xPerControl = b.getWidth() / nControlsPerRow;
     const float yPerControl = (b.getHeight() * controlYFrac) / nControlRows;
-    juce::Slider* sliderArray[N_CONTROLS] = {&mAttackSlider, &mDecaySlider, &mTuningSlider, &mColourSlider, &mMixSlider,
-                                                &mOctaveShiftSlider, &mOctaveMixSlider, &mSparsitySlider, &mGainSlider, &mMasterSlider};
-    juce::Label* labelArray[N_CONTROLS] = {&mAttackLabel, &mDecayLabel, &mTuningLabel, &mColourLabel, &mMixLabel,
-                                                &mOctaveShiftLabel, &mOctaveMixLabel, &mSparsityLabel, &mGainLabel, &mMasterLabel};
+    juce::Slider* sliderArray[N_CONTROLS] = {&mAttackSlider, &mDecaySlider, &mTuningSlider, &mColourSlider, &mLowOctaveSlider, &mMaxPartialsSlider, &mMixSlider,
+                                                &mOctaveShiftSlider, &mOctaveMixSlider, &mSparsitySlider, &mHighOctaveSlider, &mCpuBudgetSlider, &mGainSlider, &mMasterSlider};
+    juce::Label* labelArray[N_CONTROLS] = {&mAttackLabel, &mDecayLabel, &mTuningLabel, &mColourLabel, &mLowOctaveLabel, &mMaxPartialsLabel, &mMixLabel,
+                                                &mOctaveShiftLabel, &mOctaveMixLabel, &mSparsityLabel, &mHighOctaveLabel, &mCpuBudgetLabel, &mGainLabel, &mMasterLabel};
 
     size_t count = 0u;
     for(size_t row = 0u; row < N_ROWS; row++)
@@ -238,32 +365,32 @@ void AudioPluginAudioProcessorEditor::resized()
 
 void AudioPluginAudioProcessorEditor::attackSliderChanged()
 {
-    processorRef.setAttack(mAttackSlider.getValue());
+    processorRef.setAttack(mAttackSlider.getValue(), mSelectedVoice);
 }
 
 void AudioPluginAudioProcessorEditor::decaySliderChanged()
 {
-    processorRef.setDecay(mDecaySlider.getValue());
+    processorRef.setDecay(mDecaySlider.getValue(), mSelectedVoice);
 }
 
 void AudioPluginAudioProcessorEditor::octaveShiftSliderChanged()
 {
-    processorRef.setOctaveShift(mOctaveShiftSlider.getValue());
+    processorRef.setOctaveShift(mOctaveShiftSlider.getValue(), mSelectedVoice);
 }
 
 void AudioPluginAudioProcessorEditor::octaveMixSliderChanged()
 {
-    processorRef.setOctaveMix(mOctaveMixSlider.getValue());
+    processorRef.setOctaveMix(mOctaveMixSlider.getValue(), mSelectedVoice);
 }
 
 void AudioPluginAudioProcessorEditor::colourSliderChanged()
 {
-    processorRef.setColour(mColourSlider.getValue());
+    processorRef.setColour(mColourSlider.getValue(), mSelectedVoice);
 }
 
 void AudioPluginAudioProcessorEditor::sparsitySliderChanged()
 {
-    processorRef.setSparsity(mSparsitySlider.getValue());
+    processorRef.setSparsity(mSparsitySlider.getValue(), mSelectedVoice);
 }
 
 void AudioPluginAudioProcessorEditor::tuningSliderChanged()
@@ -286,5 +413,99 @@ void AudioPluginAudioProcessorEditor::masterSliderChanged()
     processorRef.setMaster(mMasterSlider.getValue());
 }
 
+void AudioPluginAudioProcessorEditor::maxPartialsSliderChanged()
+{
+    processorRef.setMaxPartials(juce::roundToInt(mMaxPartialsSlider.getValue()));
+}
+
+void AudioPluginAudioProcessorEditor::cpuBudgetSliderChanged()
+{
+    processorRef.setCpuBudget(mCpuBudgetSlider.getValue());
+}
+
+void AudioPluginAudioProcessorEditor::lowOctaveSliderChanged()
+{
+    processorRef.setLowOctave(juce::roundToInt(mLowOctaveSlider.getValue()));
+}
 
+void AudioPluginAudioProcessorEditor::highOctaveSliderChanged()
+{
+    processorRef.setHighOctave(juce::roundToInt(mHighOctaveSlider.getValue()));
+}
+
+void AudioPluginAudioProcessorEditor::freezeButtonChanged()
+{
+    processorRef.setFreeze(mFreezeButton.getToggleState());
+}
+
+void AudioPluginAudioProcessorEditor::internalRateButtonChanged()
+{
+    processorRef.setInternalRate(mInternalRateButton.getToggleState());
+}
 
+void AudioPluginAudioProcessorEditor::recordButtonChanged()
+{
+    if(!mRecordButton.getToggleState())
+    {
+        processorRef.stopRecording();
+        return;
+    }
+    const auto directory = juce::File::getSpecialLocation(juce::File::userDocumentsDirectory).getChildFile("HarmonicReverb");
+    const auto file = directory.getNonexistentChildFile("Envelopes", ".hrev");
+    if(processorRef.startRecording(file))
+        mRecordButton.setTooltip("Recording to " + file.getFullPathName());
+    else
+        mRecordButton.setToggleState(false, juce::dontSendNotification);
+}
+
+// Only one of the displays is visible, the hidden one does not draw
+void AudioPluginAudioProcessorEditor::waterfallButtonChanged()
+{
+    const bool waterfall = mWaterfallButton.getToggleState();
+    mWaterfallComponent.setVisible(waterfall);
+    mSpectralComponent.setVisible(!waterfall);
+}
+
+void AudioPluginAudioProcessorEditor::scaleBoxChanged()
+{
+    processorRef.setScale(juce::jmax(0, mScaleBox.getSelectedId() - 1));
+    processorRef.setScaleRoot(juce::jmax(0, mScaleRootBox.getSelectedId() - 1));
+}
+
+void AudioPluginAudioProcessorEditor::voiceBoxChanged()
+{
+    mSelectedVoice = static_cast<unsigned>(juce::jlimit(1, static_cast<int>(VoiceNumber), mVoiceBox.getSelectedId()) - 1);
+    const juce::String suffix = mSelectedVoice == 0u ? juce::String() : juce::String(mSelectedVoice + 1u);
+
+    const float attackParameter = mParameters.getParameterAsValue("attack" + suffix).getValue();
+    const float decayParameter = mParameters.getParameterAsValue("decay" + suffix).getValue();
+    const float octaveShiftParameter = mParameters.getParameterAsValue("octaveShift" + suffix).getValue();
+    const float octaveMixParameter = mParameters.getParameterAsValue("octaveMix" + suffix).getValue();
+    const float colourParameter = mParameters.getParameterAsValue("colour" + suffix).getValue();
+    const float sparsityParameter = mParameters.getParameterAsValue("sparsity" + suffix).getValue();
+
+    mAttackSlider.setValue(attackParameter, juce::dontSendNotification);
+    mDecaySlider.setValue(decayParameter, juce::dontSendNotification);
+    mOctaveShiftSlider.setValue(octaveShiftParameter, juce::dontSendNotification);
+    mOctaveMixSlider.setValue(octaveMixParameter, juce::dontSendNotification);
+    mColourSlider.setValue(colourParameter, juce::dontSendNotification);
+    mSparsitySlider.setValue(sparsityParameter, juce::dontSendNotification);
+
+    attackSliderChanged();
+    decaySliderChanged();
+    octaveShiftSliderChanged();
+    octaveMixSliderChanged();
+    colourSliderChanged();
+    sparsitySliderChanged();
+}
+
+void AudioPluginAudioProcessorEditor::timerCallback()
+{
+    const unsigned qualityTier = processorRef.getQualityTier();
+    if(qualityTier == mDisplayedQualityTier)
+        return;
+    const char* tierNames[QualityTierNumber] = {"Full", "Reduced", "Coarse", "Merged"};
+    mQualityLabel.setText(juce::String("Quality: ") + tierNames[qualityTier], juce::dontSendNotification);
+    mQualityLabel.setTooltip(qualityTier == QualityFull ? "Full quality" : "Quality reduced to stay within the CPU budget");
+    mDisplayedQualityTier = qualityTier;
+}
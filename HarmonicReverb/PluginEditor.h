@@ -4,9 +4,10 @@
 
 #include "../include/gui/OtherLookAndFeel.h"
 #include "../include/gui/SpectralComponent.h"
+#include "../include/gui/WaterfallComponent.h"
 
 //==============================================================================
-class AudioPluginAudioProcessorEditor  : public juce::AudioProcessorEditor
+class AudioPluginAudioProcessorEditor  : public juce::AudioProcessorEditor, private juce::Timer
 {
 public:
     explicit AudioPluginAudioProcessorEditor (AudioPluginAudioProcessor&, juce::AudioProcessorValueTreeState&);
@@ -35,6 +36,10 @@ private:
     juce::Label mGainLabel;
     juce::Label mMixLabel;
     juce::Label mMasterLabel;
+    juce::Label mMaxPartialsLabel;
+    juce::Label mCpuBudgetLabel;
+    juce::Label mLowOctaveLabel;
+    juce::Label mHighOctaveLabel;
 
     juce::Slider mAttackSlider;
     juce::Slider mDecaySlider;
@@ -46,12 +51,32 @@ private:
     juce::Slider mGainSlider;
     juce::Slider mMixSlider;
     juce::Slider mMasterSlider;
+    juce::Slider mMaxPartialsSlider;
+    juce::Slider mCpuBudgetSlider;
+    juce::Slider mLowOctaveSlider;
+    juce::Slider mHighOctaveSlider;
+
+    juce::TextButton mFreezeButton;
+    juce::TextButton mInternalRateButton;
+    juce::TextButton mRecordButton;
+    juce::TextButton mWaterfallButton;
+
+    juce::Label mQualityLabel;
+
+    // Voice edited by the per-voice sliders, 0 is the main output
+    juce::ComboBox mVoiceBox;
+    // Pitch-class mask
+    juce::ComboBox mScaleBox;
+    juce::ComboBox mScaleRootBox;
+    unsigned mSelectedVoice{0u};
+    unsigned mDisplayedQualityTier{QualityTierNumber};
 
     OtherLookAndFeel mOtherLookAndFeel;
 
     juce::TooltipWindow mFrequencyTooltip;
 
     SpectralComponent<BinsPerOctave, OctaveNumber> mSpectralComponent{ processorRef };
+    WaterfallComponent<BinsPerOctave, OctaveNumber> mWaterfallComponent{ processorRef.mSpectralHistory };
 
     void attackSliderChanged();
     void decaySliderChanged();
@@ -63,6 +88,17 @@ private:
     void gainSliderChanged();
     void mixSliderChanged();
     void masterSliderChanged();
+    void maxPartialsSliderChanged();
+    void cpuBudgetSliderChanged();
+    void lowOctaveSliderChanged();
+    void highOctaveSliderChanged();
+    void freezeButtonChanged();
+    void internalRateButtonChanged();
+    void voiceBoxChanged();
+    void scaleBoxChanged();
+    void recordButtonChanged();
+    void waterfallButtonChanged();
+    void timerCallback() override;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioPluginAudioProcessorEditor)
 };
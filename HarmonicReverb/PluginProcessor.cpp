@@ -1,6 +1,51 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 
+namespace
+{
+    // The governor's tier shown to the host as a meter: read-only, written from the message thread only
+    class QualityTierParameter : public juce::AudioParameterInt
+    {
+    public:
+        QualityTierParameter()
+            : juce::AudioParameterInt ("qualityTier", "QualityTier", 0, static_cast<int>(QualityTierNumber) - 1, 0)
+        {
+        }
+
+        bool isAutomatable() const override { return false; }
+        Category getCategory() const override { return otherMeter; }
+    };
+}
+
+#if JUCE_VERSION >= 0x70006
+namespace
+{
+    // The shared pool serves every instance, so its workers join one workgroup for the process, the latest reported
+    struct WorkerWorkgroup
+    {
+        std::mutex mutex;
+        juce::AudioWorkgroup workgroup;
+    };
+
+    WorkerWorkgroup& getWorkerWorkgroup()
+    {
+        static WorkerWorkgroup workerWorkgroup;
+        return workerWorkgroup;
+    }
+
+    // Runs on each pool worker, a worker leaves its workgroup when it rejoins or exits
+    void joinWorkerWorkgroup(void*)
+    {
+        thread_local juce::WorkgroupToken token;
+        auto& workerWorkgroup = getWorkerWorkgroup();
+        std::lock_guard<std::mutex> lock(workerWorkgroup.mutex);
+        token.reset();
+        if(workerWorkgroup.workgroup)
+            workerWorkgroup.workgroup.join(token);
+    }
+}
+#endif
+
 //==============================================================================
 AudioPluginAudioProcessor::AudioPluginAudioProcessor()
      : AudioProcessor (BusesProperties()
@@ -9,6 +54,8 @@ AudioPluginAudioProcessor::AudioPluginAudioProcessor()
                        .withInput  ("Input",  juce::AudioChannelSet::stereo(), true)
                       #endif
                        .withOutput ("Output", juce::AudioChannelSet::stereo(), true)
+                       .withOutput ("Wet 2",  juce::AudioChannelSet::stereo(), false)
+                       .withOutput ("Wet 3",  juce::AudioChannelSet::stereo(), false)
                      #endif
                        ),
         mParameters (*this, nullptr, juce::Identifier ("HarmonicReverb"), 
@@ -23,18 +70,57 @@ AudioPluginAudioProcessor::AudioPluginAudioProcessor()
             std::make_unique<juce::AudioParameterFloat> ("master", "Master", std::get<0>(MasterRange), std::get<1>(MasterRange), std::get<2>(MasterRange)),
             std::make_unique<juce::AudioParameterFloat> ("colour", "Colour", std::get<0>(ColourRange), std::get<1>(ColourRange), std::get<2>(ColourRange)),
             std::make_unique<juce::AudioParameterFloat> ("sparsity", "Sparsity", std::get<0>(SparsityRange), std::get<1>(SparsityRange), std::get<2>(SparsityRange)),
+            std::make_unique<juce::AudioParameterBool> ("freeze", "Freeze", false),
+            std::make_unique<juce::AudioParameterBool> ("internalRate", "InternalRate", false),
+            std::make_unique<juce::AudioParameterFloat> ("cpuBudget", "CpuBudget", std::get<0>(CpuBudgetRange), std::get<1>(CpuBudgetRange), std::get<2>(CpuBudgetRange)),
+            std::make_unique<QualityTierParameter> (),
+            std::make_unique<juce::AudioParameterInt> ("maxPartials", "MaxPartials", std::get<0>(MaxPartialsRange), std::get<1>(MaxPartialsRange), std::get<2>(MaxPartialsRange)),
+            std::make_unique<juce::AudioParameterInt> ("lowOctave", "LowOctave", std::get<0>(LowOctaveRange), std::get<1>(LowOctaveRange), std::get<2>(LowOctaveRange)),
+            std::make_unique<juce::AudioParameterInt> ("highOctave", "HighOctave", std::get<0>(HighOctaveRange), std::get<1>(HighOctaveRange), std::get<2>(HighOctaveRange)),
+            std::make_unique<juce::AudioParameterInt> ("scale", "Scale", std::get<0>(ScaleRange), std::get<1>(ScaleRange), std::get<2>(ScaleRange)),
+            std::make_unique<juce::AudioParameterInt> ("scaleRoot", "ScaleRoot", std::get<0>(ScaleRootRange), std::get<1>(ScaleRootRange), std::get<2>(ScaleRootRange)),
+            // Wet bus voices
+            std::make_unique<juce::AudioParameterFloat> ("attack2", "Attack2", std::get<0>(AttackRange), std::get<1>(AttackRange), std::get<2>(AttackRange)),
+            std::make_unique<juce::AudioParameterFloat> ("decay2", "Decay2", std::get<0>(DecayRange), std::get<1>(DecayRange), std::get<2>(DecayRange)),
+            std::make_unique<juce::AudioParameterFloat> ("octaveShift2", "OctaveShift2", std::get<0>(OctaveShiftRange), std::get<1>(OctaveShiftRange), std::get<2>(OctaveShiftRange)),
+            std::make_unique<juce::AudioParameterFloat> ("octaveMix2", "OctaveMix2", std::get<0>(OctaveMixRange), std::get<1>(OctaveMixRange), std::get<2>(OctaveMixRange)),
+            std::make_unique<juce::AudioParameterFloat> ("colour2", "Colour2", std::get<0>(ColourRange), std::get<1>(ColourRange), std::get<2>(ColourRange)),
+            std::make_unique<juce::AudioParameterFloat> ("sparsity2", "Sparsity2", std::get<0>(SparsityRange), std::get<1>(SparsityRange), std::get<2>(SparsityRange)),
+            std::make_unique<juce::AudioParameterFloat> ("busLevel2", "BusLevel2", std::get<0>(BusLevelRange), std::get<1>(BusLevelRange), std::get<2>(BusLevelRange)),
+            std::make_unique<juce::AudioParameterFloat> ("attack3", "Attack3", std::get<0>(AttackRange), std::get<1>(AttackRange), std::get<2>(AttackRange)),
+            std::make_unique<juce::AudioParameterFloat> ("decay3", "Decay3", std::get<0>(DecayRange), std::get<1>(DecayRange), std::get<2>(DecayRange)),
+            std::make_unique<juce::AudioParameterFloat> ("octaveShift3", "OctaveShift3", std::get<0>(OctaveShiftRange), std::get<1>(OctaveShiftRange), std::get<2>(OctaveShiftRange)),
+            std::make_unique<juce::AudioParameterFloat> ("octaveMix3", "OctaveMix3", std::get<0>(OctaveMixRange), std::get<1>(OctaveMixRange), std::get<2>(OctaveMixRange)),
+            std::make_unique<juce::AudioParameterFloat> ("colour3", "Colour3", std::get<0>(ColourRange), std::get<1>(ColourRange), std::get<2>(ColourRange)),
+            std::make_unique<juce::AudioParameterFloat> ("sparsity3", "Sparsity3", std::get<0>(SparsityRange), std::get<1>(SparsityRange), std::get<2>(SparsityRange)),
+            std::make_unique<juce::AudioParameterFloat> ("busLevel3", "BusLevel3", std::get<0>(BusLevelRange), std::get<1>(BusLevelRange), std::get<2>(BusLevelRange)),
         })
 {
-    mAttackParameter = dynamic_cast<juce::AudioParameterFloat*>(mParameters.getParameter("attack"));
-    mDecayParameter = dynamic_cast<juce::AudioParameterFloat*>(mParameters.getParameter("decay"));
-    mOctaveShiftParameter = dynamic_cast<juce::AudioParameterFloat*>(mParameters.getParameter("octaveShift"));
-    mOctaveMixParameter = dynamic_cast<juce::AudioParameterFloat*>(mParameters.getParameter("octaveMix"));
+    for(unsigned i_voice = 0u; i_voice < VoiceNumber; i_voice++)
+    {
+        const juce::String suffix = i_voice == 0u ? juce::String() : juce::String(i_voice + 1u);
+        mAttackParameter[i_voice] = dynamic_cast<juce::AudioParameterFloat*>(mParameters.getParameter("attack" + suffix));
+        mDecayParameter[i_voice] = dynamic_cast<juce::AudioParameterFloat*>(mParameters.getParameter("decay" + suffix));
+        mOctaveShiftParameter[i_voice] = dynamic_cast<juce::AudioParameterFloat*>(mParameters.getParameter("octaveShift" + suffix));
+        mOctaveMixParameter[i_voice] = dynamic_cast<juce::AudioParameterFloat*>(mParameters.getParameter("octaveMix" + suffix));
+        mColourParameter[i_voice] = dynamic_cast<juce::AudioParameterFloat*>(mParameters.getParameter("colour" + suffix));
+        mSparsityParameter[i_voice] = dynamic_cast<juce::AudioParameterFloat*>(mParameters.getParameter("sparsity" + suffix));
+        if(i_voice > 0u)
+            mBusLevelParameter[i_voice] = dynamic_cast<juce::AudioParameterFloat*>(mParameters.getParameter("busLevel" + suffix));
+    }
     mTuningParameter = dynamic_cast<juce::AudioParameterFloat*>(mParameters.getParameter("tuning"));
-    mColourParameter = dynamic_cast<juce::AudioParameterFloat*>(mParameters.getParameter("colour"));
-    mSparsityParameter = dynamic_cast<juce::AudioParameterFloat*>(mParameters.getParameter("sparsity"));
     mGainParameter = dynamic_cast<juce::AudioParameterFloat*>(mParameters.getParameter("gain"));
     mMixParameter = dynamic_cast<juce::AudioParameterFloat*>(mParameters.getParameter("mix"));
     mMasterParameter = dynamic_cast<juce::AudioParameterFloat*>(mParameters.getParameter("master"));
+    mFreezeParameter = dynamic_cast<juce::AudioParameterBool*>(mParameters.getParameter("freeze"));
+    mInternalRateParameter = dynamic_cast<juce::AudioParameterBool*>(mParameters.getParameter("internalRate"));
+    mCpuBudgetParameter = dynamic_cast<juce::AudioParameterFloat*>(mParameters.getParameter("cpuBudget"));
+    mQualityTierParameter = dynamic_cast<juce::AudioParameterInt*>(mParameters.getParameter("qualityTier"));
+    mMaxPartialsParameter = dynamic_cast<juce::AudioParameterInt*>(mParameters.getParameter("maxPartials"));
+    mLowOctaveParameter = dynamic_cast<juce::AudioParameterInt*>(mParameters.getParameter("lowOctave"));
+    mHighOctaveParameter = dynamic_cast<juce::AudioParameterInt*>(mParameters.getParameter("highOctave"));
+    mScaleParameter = dynamic_cast<juce::AudioParameterInt*>(mParameters.getParameter("scale"));
+    mScaleRootParameter = dynamic_cast<juce::AudioParameterInt*>(mParameters.getParameter("scaleRoot"));
 
     for(unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
     {
@@ -44,11 +130,29 @@ AudioPluginAudioProcessor::AudioPluginAudioProcessor()
             mKernelFreqs[i_octave][i_tone] = 0.; 
         }
     }
-    
+
+    for(unsigned i_voice = 1u; i_voice < VoiceNumber; i_voice++)
+    {
+        for(unsigned i_channel = 0u; i_channel < MaxChannelNumber; i_channel++)
+        {
+            mCqtReverb[i_voice][i_channel].setAnalysisSource(&mCqtReverb[0][i_channel]);
+            mCqtReverb[i_voice][i_channel].setDisplayEnabled(false);
+        }
+    }
+    for(unsigned i_channel = 0u; i_channel < MaxChannelNumber; i_channel++)
+    {
+        mCqtReverb[0][i_channel].setRecorder(&mRecorder, i_channel);
+    }
+    mCqtReverb[0][0].setSpectralHistory(&mSpectralHistory);
+
+    startTimerHz(10);
 }
 
 AudioPluginAudioProcessor::~AudioPluginAudioProcessor()
 {
+    stopTimer();
+    mRecorder.stop();
+    stopTracing();
 }
 
 //==============================================================================
@@ -126,11 +230,44 @@ void AudioPluginAudioProcessor::prepareToPlay (double sampleRate, int samplesPer
 {
     // mutex
 
-    for(int c = 0; c < 2; c++)
+    // Hosts call this repeatedly while loading a session, engines are only rebuilt if their configuration changed.
+    // Otherwise they are silenced, so no tail of the previous playback carries into the next one.
+    // Main engines only take the main bus, the wet bus channels belong to the voices.
+    const unsigned channelNumber = static_cast<unsigned>(juce::jlimit(1, static_cast<int>(MaxChannelNumber), getMainBusNumOutputChannels()));
+    const double internalRate = mInternalRateParameter->get() ? InternalSampleRate : 0.;
+    bool enginesValid = sampleRate == mSampleRate && samplesPerBlock == mSamplesPerBlock
+                     && channelNumber <= mChannelNumber && internalRate == mEngineInternalRate;
+    for(unsigned i_voice = 1u; i_voice < VoiceNumber; i_voice++)
+    {
+        const auto* bus = getBus(false, static_cast<int>(i_voice));
+        const bool voiceEnabled = bus != nullptr && bus->isEnabled();
+        enginesValid = enginesValid && voiceEnabled == mVoiceEnabled[i_voice];
+        mVoiceEnabled[i_voice] = voiceEnabled;
+    }
+    mSampleRate = sampleRate;
+    mSamplesPerBlock = samplesPerBlock;
+    mChannelNumber = channelNumber;
+    if(!enginesValid)
+        initEngines();
+    else
+        resetEngines();
+    mGainBuffer.resize(samplesPerBlock, 0.);
+    mWetBuffer.resize(samplesPerBlock, 0.);
+    mDryBuffer.resize(samplesPerBlock, 0.);
+    for(unsigned i_voice = 1u; i_voice < VoiceNumber; i_voice++)
+        mBusLevelBuffer[i_voice].resize(samplesPerBlock, 0.);
+
+    // One pool for all instances, sized to the machine, so large sessions do not oversubscribe the cores.
+    // Offline, octaves are spread over the pool instead of channels.
+    if(mWorkerPool == nullptr)
     {
-        mCqtReverb[c].init(sampleRate, samplesPerBlock);
-        mCqtSampleBuffer[c].resize(samplesPerBlock, 0.);
+        mWorkerPool = getSharedWorkerPool();
+       #if JUCE_VERSION >= 0x70006
+        mWorkerPool->setThreadInit(joinWorkerWorkgroup, nullptr);
+       #endif
     }
+    setOfflineMode(isNonRealtime());
+
     mGain.init(sampleRate);
     mMaster.init(sampleRate);
     mWet.init(sampleRate);
@@ -140,10 +277,69 @@ void AudioPluginAudioProcessor::prepareToPlay (double sampleRate, int samplesPer
     mMaster.setSmoothingTime(20.);
     mWet.setSmoothingTime(20.);
     mDry.setSmoothingTime(20.);
+    for(unsigned i_voice = 1u; i_voice < VoiceNumber; i_voice++)
+    {
+        mBusLevel[i_voice].init(sampleRate);
+        mBusLevel[i_voice].setSmoothingTime(20.);
+    }
+
+    mGovernor.init(sampleRate);
+    mGovernor.setBudget(mCpuBudgetParameter->get());
+
+    mBypassFadeLength = juce::jmax(1, juce::roundToInt(sampleRate * BypassFadeTime));
+    mBypassFadeInput.setSize(juce::jmax(1, getTotalNumInputChannels()), mBypassFadeLength);
+
+    updateKernelFreqs();
+    startTracing();
+}
+
+void AudioPluginAudioProcessor::initEngines()
+{
+    const double internalRate = mInternalRateParameter->get() ? InternalSampleRate : 0.;
+    // A voice and its analysis source have to start together to stay hop aligned
+    for(unsigned i_voice = 0u; i_voice < VoiceNumber; i_voice++)
+    {
+        if(!mVoiceEnabled[i_voice])
+            continue;
+        for(unsigned c = 0u; c < mChannelNumber; c++)
+        {
+            mCqtReverb[i_voice][c].init(mSampleRate, mSamplesPerBlock, internalRate);
+        }
+    }
+    mEngineInternalRate = internalRate;
+}
+
+void AudioPluginAudioProcessor::resetEngines()
+{
+    for(unsigned i_voice = 0u; i_voice < VoiceNumber; i_voice++)
+    {
+        if(!mVoiceEnabled[i_voice])
+            continue;
+        for(unsigned c = 0u; c < mChannelNumber; c++)
+        {
+            mCqtReverb[i_voice][c].reset();
+        }
+    }
+}
+
+void AudioPluginAudioProcessor::setOfflineMode(const bool offline)
+{
+    // Channel parallelism already fills the pool if there are enough channels
+    mOffline = offline;
+    mOctaveParallel = offline && mWorkerPool != nullptr && mChannelNumber <= mWorkerPool->getNumWorkers();
+    for(unsigned i_channel = 0u; i_channel < MaxChannelNumber; i_channel++)
+    {
+        mCqtReverb[0][i_channel].setDisplayEnabled(!offline);
+        for(unsigned i_voice = 0u; i_voice < VoiceNumber; i_voice++)
+            mCqtReverb[i_voice][i_channel].setOctavePool(mOctaveParallel ? mWorkerPool.get() : nullptr);
+    }
+}
 
+void AudioPluginAudioProcessor::updateKernelFreqs()
+{
     for(unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
     {
-        auto octaveBinFreqs = mCqtReverb[0].getOctaveBinFreqs(i_octave);
+        auto octaveBinFreqs = mCqtReverb[0][0].getOctaveBinFreqs(i_octave);
         for(unsigned i_tone = 0u; i_tone < BinsPerOctave; i_tone++)
         {
             mKernelFreqs[i_octave][i_tone] = octaveBinFreqs[i_tone]; 
@@ -156,7 +352,29 @@ void AudioPluginAudioProcessor::releaseResources()
 {
     // When playback stops, you can use this as an opportunity to free up any
     // spare memory, etc.
+    // Engines must not keep the shared pool once it is given back
+    for(unsigned i_channel = 0u; i_channel < MaxChannelNumber; i_channel++)
+    {
+        for(unsigned i_voice = 0u; i_voice < VoiceNumber; i_voice++)
+            mCqtReverb[i_voice][i_channel].setOctavePool(nullptr);
+    }
+    mOctaveParallel = false;
+    mWorkerPool.reset();
+    stopTracing();
+}
+
+#if JUCE_VERSION >= 0x70006
+void AudioPluginAudioProcessor::audioWorkgroupContextChanged (const juce::AudioWorkgroup& workgroup)
+{
+    {
+        auto& workerWorkgroup = getWorkerWorkgroup();
+        std::lock_guard<std::mutex> lock(workerWorkgroup.mutex);
+        workerWorkgroup.workgroup = workgroup;
+    }
+    if(mWorkerPool != nullptr)
+        mWorkerPool->setThreadInit(joinWorkerWorkgroup, nullptr);
 }
+#endif
 
 bool AudioPluginAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) const
 {
@@ -164,14 +382,25 @@ bool AudioPluginAudioProcessor::isBusesLayoutSupported (const BusesLayout& layou
     juce::ignoreUnused (layouts);
     return true;
   #else
-    // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
-    // Some plugin hosts, such as certain GarageBand versions, will only
-    // load plugins that support stereo bus layouts.
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+    // Any layout up to 7.1.4 or ambisonics up to third order, every channel gets its own engine.
+    const auto& outputSet = layouts.getMainOutputChannelSet();
+    if (outputSet.isDisabled())
         return false;
 
+    const int ambisonicOrder = outputSet.getAmbisonicOrder();
+    if (ambisonicOrder > MaxAmbisonicOrder)
+        return false;
+    if (ambisonicOrder < 0 && outputSet.size() > static_cast<int>(MaxDiscreteChannelNumber))
+        return false;
+
+    // Wet buses follow the main layout, channel by channel
+    for (int i_bus = 1; i_bus < layouts.outputBuses.size(); i_bus++)
+    {
+        const auto& wetSet = layouts.outputBuses.getReference(i_bus);
+        if (!wetSet.isDisabled() && wetSet != outputSet)
+            return false;
+    }
+
     // This checks if the input layout matches the output layout
    #if ! JucePlugin_IsSynth
     if (layouts.getMainOutputChannelSet() != layouts.getMainInputChannelSet())
@@ -185,49 +414,194 @@ bool AudioPluginAudioProcessor::isBusesLayoutSupported (const BusesLayout& layou
 void AudioPluginAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
                                               juce::MidiBuffer& midiMessages)
 {
-    juce::ignoreUnused (midiMessages);
-
     juce::ScopedNoDenormals noDenormals;
+    ScopedRealtimeCheck realtimeCheck;
+    ScopedTrace blockTrace("processBlock");
+    const auto blockStart = mGovernor.beginBlock();
+    handleMidi(midiMessages);
+
+    // Engines restart from silence after a bypass, their output fades in from the input
+    const bool resuming = mBypassed;
+    if(resuming)
+    {
+        storeBypassFadeInput(buffer);
+        resetEngines();
+        mBypassed = false;
+    }
+
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
 
     for (auto i_channel = totalNumInputChannels; i_channel < totalNumOutputChannels; ++i_channel)
         buffer.clear (i_channel, 0, buffer.getNumSamples());
 
-    auto* channelDataL = buffer.getWritePointer (0);
-    auto* channelDataR = buffer.getWritePointer (1); 
-    for(int i_sample = 0; i_sample < buffer.getNumSamples(); i_sample++)
+    // Hosts may switch without a new prepareToPlay
+    if(isNonRealtime() != mOffline)
+        setOfflineMode(isNonRealtime());
+
+    const int nSamples = buffer.getNumSamples();
+    const unsigned nChannels = juce::jmin(mChannelNumber, static_cast<unsigned>(buffer.getNumChannels()));
+    for(unsigned i_channel = 0u; i_channel < nChannels; i_channel++)
     {
-        const double gain = mGain.getNextValue();
-        mCqtSampleBuffer[0][i_sample] = static_cast<double>(channelDataL[i_sample]) * gain;
-        mCqtSampleBuffer[1][i_sample] = static_cast<double>(channelDataR[i_sample]) * gain;
+        mChannelData[0][i_channel] = buffer.getWritePointer (static_cast<int>(i_channel));
+    }
+    for(unsigned i_voice = 1u; i_voice < VoiceNumber; i_voice++)
+    {
+        const int busIndex = static_cast<int>(i_voice);
+        const bool voiceActive = mVoiceEnabled[i_voice] && busIndex < getBusCount(false);
+        const int firstChannel = voiceActive ? getChannelIndexInProcessBlockBuffer(false, busIndex, 0) : 0;
+        const int nBusChannels = voiceActive ? getChannelCountOfBus(false, busIndex) : 0;
+        for(unsigned i_channel = 0u; i_channel < nChannels; i_channel++)
+        {
+            const bool hasChannel = static_cast<int>(i_channel) < nBusChannels && firstChannel + static_cast<int>(i_channel) < buffer.getNumChannels();
+            mChannelData[i_voice][i_channel] = hasChannel ? buffer.getWritePointer (firstChannel + static_cast<int>(i_channel)) : nullptr;
+        }
     }
 
-    for(unsigned i_channel = 0u; i_channel < ChannelNumber; i_channel++)
+    // Quality tier chosen from the previous callbacks' cost, offline renders have no deadline and keep full quality
+    mGovernor.setBudget(mCpuBudgetParameter->get());
+    const unsigned qualityTier = mOffline ? static_cast<unsigned>(QualityFull) : mGovernor.getTier();
+    // Scale and root are read every block, so automation and restored state reach the engines as well as the editor.
+    // The MIDI scale follows the held notes, nothing played yet leaves all pitches open.
+    const unsigned scale = static_cast<unsigned>(juce::jlimit(0, static_cast<int>(ScaleNumber) - 1, mScaleParameter->get()));
+    const unsigned scaleRoot = static_cast<unsigned>(juce::jlimit(0, 11, mScaleRootParameter->get()));
+    const uint32_t scalePitchClasses = ((ScalePitchClasses[scale] << scaleRoot) | (ScalePitchClasses[scale] >> (12u - scaleRoot))) & AllPitchClasses;
+    const uint32_t pitchClassMask = scale != MidiScale ? scalePitchClasses : mMidiPitchClasses != 0u ? mMidiPitchClasses : AllPitchClasses;
+    for(unsigned i_channel = 0u; i_channel < nChannels; i_channel++)
     {
-        mCqtReverb[i_channel].processBlock(mCqtSampleBuffer[i_channel].data(), buffer.getNumSamples());
+        for(unsigned i_voice = 0u; i_voice < VoiceNumber; i_voice++)
+        {
+            mCqtReverb[i_voice][i_channel].setQualityTier(qualityTier);
+            mCqtReverb[i_voice][i_channel].setPitchClassMask(pitchClassMask);
+        }
     }
-    for(int i_sample = 0; i_sample < buffer.getNumSamples(); i_sample++)
+
+    // Wet bus levels are not set from the editor, hosts automate them directly
+    for(unsigned i_voice = 1u; i_voice < VoiceNumber; i_voice++)
+        mBusLevel[i_voice].setTargetValue(std::pow(10., static_cast<double>(mBusLevelParameter[i_voice]->get()) / 20.));
+
+    // Ramps are sized for samplesPerBlock, larger host blocks are split
+    const int maxChunk = juce::jmax(1, static_cast<int>(mGainBuffer.size()));
+    for(int offset = 0; offset < nSamples; offset += maxChunk)
     {
-        const double wet = mWet.getNextValue();
-        const double dry = mDry.getNextValue();
-        const double master = mMaster.getNextValue();
-        const double outSampleL = (wet * mCqtSampleBuffer[0][i_sample] + dry * static_cast<double>(channelDataL[i_sample])) * master;
-        const double outSampleR = (wet * mCqtSampleBuffer[1][i_sample] + dry * static_cast<double>(channelDataR[i_sample])) * master;
-        channelDataL[i_sample] = static_cast<float>(outSampleL);
-        channelDataR[i_sample] = static_cast<float>(outSampleR);
+        const int nChunk = juce::jmin(maxChunk, nSamples - offset);
+        for(int i_sample = 0; i_sample < nChunk; i_sample++)
+        {
+            const double master = mMaster.getNextValue();
+            mGainBuffer[i_sample] = mGain.getNextValue();
+            mWetBuffer[i_sample] = mWet.getNextValue() * master;
+            mDryBuffer[i_sample] = mDry.getNextValue() * master;
+        }
+        for(unsigned i_voice = 1u; i_voice < VoiceNumber; i_voice++)
+        {
+            for(int i_sample = 0; i_sample < nChunk; i_sample++)
+                mBusLevelBuffer[i_voice][i_sample] = mBusLevel[i_voice].getNextValue();
+        }
+
+        if(mOctaveParallel || mWorkerPool == nullptr)
+        {
+            // the pool is busy with the octaves of each channel
+            for(unsigned i_channel = 0u; i_channel < nChannels; i_channel++)
+                processChannel(i_channel, offset, nChunk);
+        }
+        else
+        {
+            auto channelTask = [this, offset, nChunk](const unsigned i_channel) { processChannel(i_channel, offset, nChunk); };
+            mWorkerPool->parallelFor(nChannels, channelTask);
+        }
     }
+    if(resuming)
+        fadeBypass(buffer, false);
+
+    if(mOffline)
+        return;
 
     // Spectral display
     unsigned i_channel = 0u;
     for(unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
     {
-        auto octaveValues = mCqtReverb[i_channel].getOctaveValues(i_octave);
+        auto octaveValues = mCqtReverb[0][i_channel].getOctaveValues(i_octave);
         for(unsigned i_tone = 0u; i_tone < BinsPerOctave; i_tone++)
         {
             mCqtDataStorage[i_octave][i_tone] = octaveValues[i_tone];
         }
     }
+
+    mGovernor.endBlock(blockStart, nSamples);
+}
+
+void AudioPluginAudioProcessor::processBlockBypassed (juce::AudioBuffer<float>& buffer,
+                                                      juce::MidiBuffer& midiMessages)
+{
+    const auto totalNumInputChannels = getTotalNumInputChannels();
+    if(!mBypassed)
+    {
+        // Only the start of the first bypassed block is processed, fading to the input. The engines sleep after it.
+        const int nFade = juce::jmin(buffer.getNumSamples(), mBypassFadeLength);
+        storeBypassFadeInput(buffer);
+        juce::AudioBuffer<float> fadeBlock(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), nFade);
+        processBlock(fadeBlock, midiMessages);
+        fadeBypass(fadeBlock, true);
+        for (auto i_channel = totalNumInputChannels; i_channel < buffer.getNumChannels(); ++i_channel)
+            buffer.clear (i_channel, nFade, buffer.getNumSamples() - nFade);
+        mBypassed = true;
+        return;
+    }
+
+    // The MIDI scale keeps following the held notes
+    handleMidi(midiMessages);
+    for (auto i_channel = totalNumInputChannels; i_channel < buffer.getNumChannels(); ++i_channel)
+        buffer.clear (i_channel, 0, buffer.getNumSamples());
+}
+
+void AudioPluginAudioProcessor::storeBypassFadeInput (const juce::AudioBuffer<float>& buffer)
+{
+    const int nChannels = juce::jmin(getTotalNumInputChannels(), buffer.getNumChannels(), mBypassFadeInput.getNumChannels());
+    const int nSamples = juce::jmin(buffer.getNumSamples(), mBypassFadeLength);
+    for(int i_channel = 0; i_channel < nChannels; i_channel++)
+        mBypassFadeInput.copyFrom(i_channel, 0, buffer, i_channel, 0, nSamples);
+}
+
+// Linear fade over the start of buffer between the processed output and the stored input, towards the input when
+// entering bypass. Channels without input, i.e. the wet buses, fade to or from silence.
+void AudioPluginAudioProcessor::fadeBypass (juce::AudioBuffer<float>& buffer, const bool toBypass)
+{
+    const int nInputChannels = juce::jmin(getTotalNumInputChannels(), mBypassFadeInput.getNumChannels());
+    const int nFade = juce::jmin(buffer.getNumSamples(), mBypassFadeLength);
+    const float oneDivFade = 1.f / static_cast<float>(nFade);
+    for(int i_channel = 0; i_channel < buffer.getNumChannels(); i_channel++)
+    {
+        float* data = buffer.getWritePointer(i_channel);
+        const float* input = i_channel < nInputChannels ? mBypassFadeInput.getReadPointer(i_channel) : nullptr;
+        for(int i_sample = 0; i_sample < nFade; i_sample++)
+        {
+            const float ramp = static_cast<float>(i_sample + 1) * oneDivFade;
+            const float processedWeight = toBypass ? 1.f - ramp : ramp;
+            const float dry = input != nullptr ? input[i_sample] : 0.f;
+            data[i_sample] = processedWeight * data[i_sample] + (1.f - processedWeight) * dry;
+        }
+    }
+}
+
+void AudioPluginAudioProcessor::processChannel (const unsigned channel, const int offset, const int nSamples)
+{
+    // Runs on pool workers too, which are checked like the audio thread
+    ScopedRealtimeCheck realtimeCheck;
+    ScopedTrace channelTrace("channel", static_cast<int>(channel));
+
+    // The engine reads the host buffer and writes the mixed signal back in place
+    float* channelData = mChannelData[0][channel] + offset;
+    mCqtReverb[0][channel].processBlock(channelData, channelData, nSamples, mGainBuffer.data(), mWetBuffer.data(), mDryBuffer.data());
+
+    // Wet buses reuse the analysis just made, their own bus buffer only paces the hops and takes the reverb at the
+    // bus level. They call the inverse transform every hop without feeding its input, see CqtReverb::setAnalysisSource.
+    for(unsigned i_voice = 1u; i_voice < VoiceNumber; i_voice++)
+    {
+        if(mChannelData[i_voice][channel] == nullptr)
+            continue;
+        float* voiceData = mChannelData[i_voice][channel] + offset;
+        mCqtReverb[i_voice][channel].processBlock(voiceData, voiceData, nSamples, nullptr, mBusLevelBuffer[i_voice].data());
+    }
 }
 
 // void AudioPluginAudioProcessor::processBlock (juce::AudioBuffer<double>& buffer,
@@ -281,69 +655,215 @@ juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
 }
 
 //==============================================================================
-void AudioPluginAudioProcessor::setAttack(const double attack)
+void AudioPluginAudioProcessor::setAttack(const double attack, const unsigned voice)
 {
-    *mAttackParameter = attack;
+    *mAttackParameter[voice] = attack;
     const double attackMapped = std::tanh(5. * attack);
-    for(unsigned i_channel = 0u; i_channel < ChannelNumber; i_channel++)
+    for(unsigned i_channel = 0u; i_channel < MaxChannelNumber; i_channel++)
     {
-        mCqtReverb[i_channel].setAttack(attackMapped);
+        mCqtReverb[voice][i_channel].setAttack(attackMapped);
     }
 }
 
-void AudioPluginAudioProcessor::setDecay(const double decay)
+void AudioPluginAudioProcessor::setDecay(const double decay, const unsigned voice)
 {
-    *mDecayParameter = decay;
+    *mDecayParameter[voice] = decay;
     const double decayMapped = std::tanh(5. * decay);
-    for(unsigned i_channel = 0u; i_channel < ChannelNumber; i_channel++)
+    for(unsigned i_channel = 0u; i_channel < MaxChannelNumber; i_channel++)
     {
-        mCqtReverb[i_channel].setDecay(decayMapped);
+        mCqtReverb[voice][i_channel].setDecay(decayMapped);
     }
 }
 
-void AudioPluginAudioProcessor::setOctaveShift(const double octaveShift)
+void AudioPluginAudioProcessor::setOctaveShift(const double octaveShift, const unsigned voice)
 {
-    *mOctaveShiftParameter = octaveShift;
-    for(unsigned i_channel = 0u; i_channel < ChannelNumber; i_channel++)
+    *mOctaveShiftParameter[voice] = octaveShift;
+    for(unsigned i_channel = 0u; i_channel < MaxChannelNumber; i_channel++)
     {
-        mCqtReverb[i_channel].setOctaveShift(octaveShift);
+        mCqtReverb[voice][i_channel].setOctaveShift(octaveShift);
     }
 }
 
-void AudioPluginAudioProcessor::setOctaveMix(const double octaveMix)
+void AudioPluginAudioProcessor::setOctaveMix(const double octaveMix, const unsigned voice)
 {
-    *mOctaveMixParameter = octaveMix;
-    for(unsigned i_channel = 0u; i_channel < ChannelNumber; i_channel++)
+    *mOctaveMixParameter[voice] = octaveMix;
+    for(unsigned i_channel = 0u; i_channel < MaxChannelNumber; i_channel++)
     {
-        mCqtReverb[i_channel].setOctaveMix(octaveMix);
+        mCqtReverb[voice][i_channel].setOctaveMix(octaveMix);
     }
 }
 
-void AudioPluginAudioProcessor::setSparsity(const double sparsity)
+void AudioPluginAudioProcessor::setSparsity(const double sparsity, const unsigned voice)
 {
-    *mSparsityParameter = sparsity;
-    for(unsigned i_channel = 0u; i_channel < ChannelNumber; i_channel++)
+    *mSparsityParameter[voice] = sparsity;
+    for(unsigned i_channel = 0u; i_channel < MaxChannelNumber; i_channel++)
     {
-        mCqtReverb[i_channel].setSparsity(sparsity);
+        mCqtReverb[voice][i_channel].setSparsity(sparsity);
     }
 }
 
+// Voices share the analysis bins, so tuning and the settings below apply to all of them
 void AudioPluginAudioProcessor::setTuning(const double tuning)
 {
     *mTuningParameter = tuning;
-    for(unsigned i_channel = 0u; i_channel < ChannelNumber; i_channel++)
+    for(unsigned i_channel = 0u; i_channel < MaxChannelNumber; i_channel++)
     {
-        mCqtReverb[i_channel].setTuning(tuning);
+        for(unsigned i_voice = 0u; i_voice < VoiceNumber; i_voice++)
+            mCqtReverb[i_voice][i_channel].setTuning(tuning);
     }
-    for(unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+    updateKernelFreqs();
+}
+
+void AudioPluginAudioProcessor::setFreeze(const bool freeze)
+{
+    *mFreezeParameter = freeze;
+    for(unsigned i_channel = 0u; i_channel < MaxChannelNumber; i_channel++)
     {
-        auto octaveBinFreqs = mCqtReverb[0].getOctaveBinFreqs(i_octave);
-        for(unsigned i_tone = 0u; i_tone < BinsPerOctave; i_tone++)
-        {
-            mKernelFreqs[i_octave][i_tone] = octaveBinFreqs[i_tone]; 
-        }
+        for(unsigned i_voice = 0u; i_voice < VoiceNumber; i_voice++)
+            mCqtReverb[i_voice][i_channel].setFreeze(freeze);
     }
-    mNewKernelFreqs = true;
+}
+
+void AudioPluginAudioProcessor::setInternalRate(const bool internalRate)
+{
+    const bool changed = mInternalRateParameter->get() != internalRate;
+    *mInternalRateParameter = internalRate;
+    if(!changed || mSampleRate <= 0.)
+        return;
+
+    // Engines have to be rebuilt at the new rate, keep the callback out meanwhile
+    suspendProcessing(true);
+    initEngines();
+    suspendProcessing(false);
+    updateKernelFreqs();
+}
+
+void AudioPluginAudioProcessor::setCpuBudget(const double budget)
+{
+    // Picked up by the governor at the next callback
+    *mCpuBudgetParameter = budget;
+}
+
+void AudioPluginAudioProcessor::setMaxPartials(const int maxPartials)
+{
+    *mMaxPartialsParameter = maxPartials;
+    for(unsigned i_channel = 0u; i_channel < MaxChannelNumber; i_channel++)
+    {
+        for(unsigned i_voice = 0u; i_voice < VoiceNumber; i_voice++)
+            mCqtReverb[i_voice][i_channel].setMaxPartials(static_cast<unsigned>(juce::jmax(0, maxPartials)));
+    }
+}
+
+void AudioPluginAudioProcessor::setLowOctave(const int lowOctave)
+{
+    *mLowOctaveParameter = lowOctave;
+    updateActiveOctaves();
+}
+
+void AudioPluginAudioProcessor::setHighOctave(const int highOctave)
+{
+    *mHighOctaveParameter = highOctave;
+    updateActiveOctaves();
+}
+
+void AudioPluginAudioProcessor::setScale(const int scale)
+{
+    *mScaleParameter = scale;
+}
+
+void AudioPluginAudioProcessor::setScaleRoot(const int scaleRoot)
+{
+    *mScaleRootParameter = scaleRoot;
+}
+
+// Notes are tracked in every mode, so switching to the MIDI scale picks up what is already held
+void AudioPluginAudioProcessor::handleMidi(const juce::MidiBuffer& midiMessages)
+{
+    bool notesChanged = false;
+    for(const auto metadata : midiMessages)
+    {
+        const auto message = metadata.getMessage();
+        if(message.isNoteOn())
+            mHeldNotes[message.getNoteNumber()] = true;
+        else if(message.isNoteOff())
+            mHeldNotes[message.getNoteNumber()] = false;
+        else if(message.isAllNotesOff() || message.isAllSoundOff())
+            std::fill(std::begin(mHeldNotes), std::end(mHeldNotes), false);
+        else
+            continue;
+        notesChanged = true;
+    }
+    if(!notesChanged)
+        return;
+
+    uint32_t held = 0u;
+    for(int i_note = 0; i_note < 128; i_note++)
+    {
+        if(mHeldNotes[i_note])
+            held |= 1u << (i_note % 12);
+    }
+    if(held != 0u)
+        mMidiPitchClasses = held;
+}
+
+void AudioPluginAudioProcessor::updateActiveOctaves()
+{
+    // Parameters count from the lowest octave, the engine from the highest
+    const int lowOctave = juce::jmin(mLowOctaveParameter->get(), mHighOctaveParameter->get());
+    const int highOctave = juce::jmax(mLowOctaveParameter->get(), mHighOctaveParameter->get());
+    const unsigned firstOctave = OctaveNumber - 1u - static_cast<unsigned>(highOctave);
+    const unsigned lastOctave = OctaveNumber - 1u - static_cast<unsigned>(lowOctave);
+    for(unsigned i_channel = 0u; i_channel < MaxChannelNumber; i_channel++)
+    {
+        for(unsigned i_voice = 0u; i_voice < VoiceNumber; i_voice++)
+            mCqtReverb[i_voice][i_channel].setActiveOctaves(firstOctave, lastOctave);
+    }
+}
+
+bool AudioPluginAudioProcessor::startRecording(const juce::File &file)
+{
+    if(mSampleRate <= 0. || !file.getParentDirectory().createDirectory())
+        return false;
+    return mRecorder.start(file.getFullPathName().toStdString(), mCqtReverb[0][0].getEngineSampleRate(), static_cast<unsigned>(BlockSize));
+}
+
+void AudioPluginAudioProcessor::stopRecording()
+{
+    mRecorder.stop();
+}
+
+void AudioPluginAudioProcessor::startTracing()
+{
+#if HARMONIC_REVERB_TRACING
+    // Instances share the process-wide trace, the first one names the file
+    const juce::String request = juce::SystemStats::getEnvironmentVariable("HARMONIC_REVERB_TRACE", {});
+    if(mTracing || request.isEmpty() || request == "0")
+        return;
+    juce::File file = juce::File::getCurrentWorkingDirectory().getChildFile(request);
+    if(request == "1")
+    {
+        const auto directory = juce::File::getSpecialLocation(juce::File::userDocumentsDirectory).getChildFile("HarmonicReverb");
+        if(!directory.createDirectory())
+            return;
+        file = directory.getNonexistentChildFile("Trace", ".json");
+    }
+    mTracing = Tracer::get().start(file.getFullPathName().toStdString());
+#endif
+}
+
+void AudioPluginAudioProcessor::stopTracing()
+{
+    if(mTracing)
+        Tracer::get().stop();
+    mTracing = false;
+}
+
+void AudioPluginAudioProcessor::timerCallback()
+{
+    // Parameter changes notify the host, so they are kept off the audio thread
+    const int qualityTier = static_cast<int>(mGovernor.getTier());
+    if(mQualityTierParameter->get() != qualityTier)
+        *mQualityTierParameter = qualityTier;
 }
 
 void AudioPluginAudioProcessor::setGain(const double gain)
@@ -367,9 +887,13 @@ void AudioPluginAudioProcessor::setMaster(const double master)
     mMaster.setTargetValue(masterLin);
 }
 
-void AudioPluginAudioProcessor::setColour(const double colour)
+void AudioPluginAudioProcessor::setColour(const double colour, const unsigned voice)
 {
-   *mColourParameter = colour; 
+    *mColourParameter[voice] = colour;
+    for(unsigned i_channel = 0u; i_channel < MaxChannelNumber; i_channel++)
+    {
+        mCqtReverb[voice][i_channel].setColour(colour);
+    }
 }
 
 //==============================================================================
@@ -2,11 +2,18 @@
 
 #include <juce_audio_processors/juce_audio_processors.h>
 #include "../include/CqtReverb.h"
+#include "../include/RealtimeWorkerPool.h"
+#include "../include/RealtimeSafety.h"
 #include "../submodules/rt-cqt/submodules/audio-utils/include/SmoothedFloat.h"
 
 constexpr unsigned BinsPerOctave{12};
 constexpr unsigned OctaveNumber{9};
-constexpr unsigned ChannelNumber{2};
+constexpr unsigned MaxDiscreteChannelNumber{12}; // 7.1.4
+constexpr int MaxAmbisonicOrder{3};
+constexpr double InternalSampleRate{48000.}; // Engine rate in fixed rate mode
+constexpr unsigned MaxChannelNumber{(MaxAmbisonicOrder + 1) * (MaxAmbisonicOrder + 1)};
+constexpr unsigned VoiceNumber{3u}; // main output plus wet-only output buses sharing its analysis
+constexpr double BypassFadeTime{0.01}; // seconds, into and out of host bypass
 
 // min, max, default
 constexpr std::tuple<float, float, float> AttackRange{0.f, 1.f, 0.25f};
@@ -19,12 +26,25 @@ constexpr std::tuple<float, float, float> TuningRange{415.305f, 466.164f, 440.f}
 constexpr std::tuple<float, float, float> GainRange{-20.f, 20.f, 0.f};
 constexpr std::tuple<float, float, float> MixRange{0.f, 1.f, 0.3f};
 constexpr std::tuple<float, float, float> MasterRange{-20.f, 20.f, 0.f};
+constexpr std::tuple<float, float, float> CpuBudgetRange{0.1f, 1.f, 0.7f}; // fraction of the callback deadline
+constexpr std::tuple<int, int, int> MaxPartialsRange{0, static_cast<int>(OctaveNumber * BinsPerOctave), 0}; // 0 is unlimited
+constexpr std::tuple<int, int, int> LowOctaveRange{0, static_cast<int>(OctaveNumber) - 1, 0}; // counted from the lowest octave
+constexpr std::tuple<int, int, int> HighOctaveRange{0, static_cast<int>(OctaveNumber) - 1, static_cast<int>(OctaveNumber) - 1};
+constexpr std::tuple<float, float, float> BusLevelRange{-60.f, 12.f, 0.f}; // dB, wet bus outputs
+
+// Scales for the pitch-class mask, bit 0 is the root. The last one follows the held MIDI notes instead.
+constexpr unsigned ScaleNumber{7u};
+constexpr unsigned MidiScale{ScaleNumber - 1u};
+constexpr const char *ScaleNames[ScaleNumber]{"Chromatic", "Major", "Minor", "Pentatonic", "Minor Pent.", "Whole Tone", "MIDI"};
+constexpr uint32_t ScalePitchClasses[ScaleNumber]{0xfffu, 0xab5u, 0x5adu, 0x295u, 0x4a9u, 0x555u, 0xfffu};
+constexpr std::tuple<int, int, int> ScaleRange{0, static_cast<int>(ScaleNumber) - 1, 0};
+constexpr std::tuple<int, int, int> ScaleRootRange{0, 11, 0}; // pitch class, 0 is C
 
 // TODO:
 //  - Smoothed parameters
 
 //==============================================================================
-class AudioPluginAudioProcessor : public juce::AudioProcessor
+class AudioPluginAudioProcessor : public juce::AudioProcessor, private juce::Timer
 {
 public:
     //==============================================================================
@@ -34,10 +54,15 @@ public:
     //==============================================================================
     void prepareToPlay(double sampleRate, int samplesPerBlock) override;
     void releaseResources() override;
+   #if JUCE_VERSION >= 0x70006
+    // Workers of the shared pool join the host's audio workgroup, where the platform has one
+    void audioWorkgroupContextChanged(const juce::AudioWorkgroup &workgroup) override;
+   #endif
 
     bool isBusesLayoutSupported(const BusesLayout &layouts) const override;
 
     void processBlock(juce::AudioBuffer<float> &, juce::MidiBuffer &) override;
+    void processBlockBypassed(juce::AudioBuffer<float> &, juce::MidiBuffer &) override;
     // void processBlock (juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
     using AudioProcessor::processBlock;
 
@@ -69,39 +94,122 @@ public:
     double mCqtDataStorage[OctaveNumber][BinsPerOctave]; // For spectral display
     double mKernelFreqs[OctaveNumber][BinsPerOctave];    // For spectral display
     bool mNewKernelFreqs{false};                         // For spectral display
+    SpectralHistory<BinsPerOctave, OctaveNumber> mSpectralHistory; // For waterfall display, fed by the first channel
 
-    void setAttack(const double attack);
-    void setDecay(const double decay);
-    void setOctaveShift(const double octaveShift);
-    void setOctaveMix(const double octaveMix);
+    // Voice 0 is the main output, the others feed the wet buses
+    void setAttack(const double attack, const unsigned voice = 0u);
+    void setDecay(const double decay, const unsigned voice = 0u);
+    void setOctaveShift(const double octaveShift, const unsigned voice = 0u);
+    void setOctaveMix(const double octaveMix, const unsigned voice = 0u);
     void setGain(const double gain);
     void setMix(const double mix);
     void setMaster(const double master);
-    void setColour(const double colour);
-    void setSparsity(const double sparsity);
+    void setColour(const double colour, const unsigned voice = 0u);
+    void setSparsity(const double sparsity, const unsigned voice = 0u);
     void setTuning(const double tuning);
+    void setFreeze(const bool freeze);
+    void setInternalRate(const bool internalRate);
+    void setCpuBudget(const double budget);
+    void setMaxPartials(const int maxPartials);
+    void setLowOctave(const int lowOctave);
+    void setHighOctave(const int highOctave);
+    void setScale(const int scale);
+    void setScaleRoot(const int scaleRoot);
+    unsigned getQualityTier() const { return mGovernor.getTier(); };
+
+    // Streams the main voice's per-hop envelopes and magnitudes of all channels to file, see include/EnvelopeRecording.h
+    bool startRecording(const juce::File &file);
+    void stopRecording();
+    bool isRecording() const { return mRecorder.isRecording(); };
+    double getCpuLoad() const { return mGovernor.getLoad(); };
 
 private:
     //==============================================================================
-    std::vector<double> mCqtSampleBuffer[2];
-    CqtReverb<BinsPerOctave, OctaveNumber> mCqtReverb[2];
+    // Wet bus voices read the analysis of the main voice of their channel and only run synthesis and the inverse
+    CqtReverb<BinsPerOctave, OctaveNumber> mCqtReverb[VoiceNumber][MaxChannelNumber];
+    unsigned mChannelNumber{2u};
+    bool mVoiceEnabled[VoiceNumber]{true};
+
+    // Channels are processed in parallel, one engine lane per channel. The pool is shared by all instances of the
+    // process and held from prepareToPlay to releaseResources.
+    std::shared_ptr<RealtimeWorkerPool> mWorkerPool;
+    float *mChannelData[VoiceNumber][MaxChannelNumber];
+
+    // Per-sample smoothed values, shared by all channels
+    std::vector<double> mGainBuffer;
+    std::vector<double> mWetBuffer;
+    std::vector<double> mDryBuffer;
+    std::vector<double> mBusLevelBuffer[VoiceNumber]; // wet buses only
+
+    void processChannel(const unsigned channel, const int offset, const int nSamples);
+
+    // Host bypass: engines are not called while bypassed and the input passes unchanged, as the dry path has no
+    // latency. The first bypassed block still runs and fades to the input, the first active one resets the engines,
+    // so nothing from before the bypass replays, and fades back in from the input.
+    bool mBypassed{false};
+    int mBypassFadeLength{1};
+    juce::AudioBuffer<float> mBypassFadeInput;
+    void storeBypassFadeInput(const juce::AudioBuffer<float> &buffer);
+    void fadeBypass(juce::AudioBuffer<float> &buffer, const bool toBypass);
+
+    // Offline bounces: channels run one after another with their octaves spread over the pool, no display updates
+    bool mOffline{false};
+    bool mOctaveParallel{false};
+    void setOfflineMode(const bool offline);
+
+    double mSampleRate{0.};
+    int mSamplesPerBlock{0};
+    double mEngineInternalRate{-1.}; // internal rate the engines were last built with, -1 before the first init
+    void initEngines();
+    void resetEngines(); // prepared engines only, without reallocating
+    void updateKernelFreqs();
+    void updateActiveOctaves();
+
+    // MIDI scale, audio thread only: pitch classes of the held notes, the last chord stays after all notes are released
+    bool mHeldNotes[128]{};
+    uint32_t mMidiPitchClasses{0u};
+    void handleMidi(const juce::MidiBuffer &midiMessages);
+
+    EnvelopeRecorder<BinsPerOctave, OctaveNumber> mRecorder;
+
+    // Builds with HARMONIC_REVERB_TRACING trace from prepareToPlay to releaseResources if the HARMONIC_REVERB_TRACE
+    // environment variable is set, to that file or with 1 to Documents/HarmonicReverb, see include/Tracing.h
+    bool mTracing{false};
+    void startTracing();
+    void stopTracing();
+
+    // Steps the engines' quality down under CPU pressure. The tier is a measurement: the editor reads it through
+    // getQualityTier, hosts see it as a read-only meter parameter the timer keeps up to date.
+    QualityGovernor mGovernor;
+    void timerCallback() override;
 
     juce::AudioProcessorValueTreeState mParameters;
-    juce::AudioParameterFloat *mAttackParameter{nullptr};
-    juce::AudioParameterFloat *mDecayParameter{nullptr};
-    juce::AudioParameterFloat *mOctaveShiftParameter{nullptr};
-    juce::AudioParameterFloat *mOctaveMixParameter{nullptr};
+    juce::AudioParameterFloat *mAttackParameter[VoiceNumber]{};
+    juce::AudioParameterFloat *mDecayParameter[VoiceNumber]{};
+    juce::AudioParameterFloat *mOctaveShiftParameter[VoiceNumber]{};
+    juce::AudioParameterFloat *mOctaveMixParameter[VoiceNumber]{};
     juce::AudioParameterFloat *mGainParameter{nullptr};
     juce::AudioParameterFloat *mMixParameter{nullptr};
     juce::AudioParameterFloat *mMasterParameter{nullptr};
-    juce::AudioParameterFloat *mColourParameter{nullptr};
-    juce::AudioParameterFloat *mSparsityParameter{nullptr};
+    juce::AudioParameterFloat *mColourParameter[VoiceNumber]{};
+    juce::AudioParameterFloat *mSparsityParameter[VoiceNumber]{};
     juce::AudioParameterFloat *mTuningParameter{nullptr};
+    juce::AudioParameterBool *mFreezeParameter{nullptr};
+    juce::AudioParameterBool *mInternalRateParameter{nullptr};
+    juce::AudioParameterFloat *mCpuBudgetParameter{nullptr};
+    juce::AudioParameterInt *mQualityTierParameter{nullptr}; // meter, never read back
+    juce::AudioParameterInt *mMaxPartialsParameter{nullptr};
+    juce::AudioParameterInt *mLowOctaveParameter{nullptr};
+    juce::AudioParameterInt *mHighOctaveParameter{nullptr};
+    juce::AudioParameterInt *mScaleParameter{nullptr};     // read every block
+    juce::AudioParameterInt *mScaleRootParameter{nullptr}; // read every block
+    juce::AudioParameterFloat *mBusLevelParameter[VoiceNumber]{}; // wet buses only, read every block
 
     audio_utils::SmoothedFloat<double> mGain;
     audio_utils::SmoothedFloat<double> mMaster;
     audio_utils::SmoothedFloat<double> mWet;
     audio_utils::SmoothedFloat<double> mDry;
+    audio_utils::SmoothedFloat<double> mBusLevel[VoiceNumber];
 
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AudioPluginAudioProcessor)
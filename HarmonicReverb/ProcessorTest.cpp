@@ -0,0 +1,190 @@
+// Processor tests: drive AudioPluginAudioProcessor like a host, with its bus layouts, and check the buses separately.
+//
+//   HarmonicReverbProcessorTest
+//
+// Prints one line per check and returns non-zero if any of them failed.
+
+#include "PluginProcessor.h"
+
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <memory>
+
+namespace
+{
+    constexpr double TestSampleRate{48000.};
+    constexpr int TestBlockSize{512};
+    constexpr int TestSeconds{3};
+    constexpr int MainChannels{2};
+    constexpr int SettleSamples{static_cast<int>(TestSampleRate) / 2}; // parameter smoothing, compared after it
+
+    // Stereo in and out, the wet buses stereo as well or disabled
+    AudioPluginAudioProcessor::BusesLayout makeLayout(const bool wetBuses)
+    {
+        AudioPluginAudioProcessor::BusesLayout layout;
+        layout.inputBuses.add(juce::AudioChannelSet::stereo());
+        layout.outputBuses.add(juce::AudioChannelSet::stereo());
+        for(unsigned i_voice = 1u; i_voice < VoiceNumber; i_voice++)
+            layout.outputBuses.add(wetBuses ? juce::AudioChannelSet::stereo() : juce::AudioChannelSet::disabled());
+        return layout;
+    }
+
+    // Renders TestSeconds of two tones through a processor with the given layout. The mix is fully wet and all
+    // voices have the same settings, so every wet bus has to carry the main output at its bus level of 0 dB.
+    // Offline, so the quality tier stays full and renders repeat exactly. configure runs once the processor is prepared.
+    bool render(const bool wetBuses, juce::AudioBuffer<float>& output,
+                const std::function<void(AudioPluginAudioProcessor&)>& configure = nullptr)
+    {
+        AudioPluginAudioProcessor processor;
+        if(!processor.setBusesLayout(makeLayout(wetBuses)))
+            return false;
+        processor.setNonRealtime(true);
+        processor.setRateAndBufferSizeDetails(TestSampleRate, TestBlockSize);
+        processor.prepareToPlay(TestSampleRate, TestBlockSize);
+        processor.setGain(0.);
+        processor.setMaster(0.);
+        processor.setMix(1.);
+        for(unsigned i_voice = 0u; i_voice < VoiceNumber; i_voice++)
+        {
+            processor.setAttack(std::get<2>(AttackRange), i_voice);
+            processor.setDecay(std::get<2>(DecayRange), i_voice);
+            processor.setOctaveShift(std::get<2>(OctaveShiftRange), i_voice);
+            processor.setOctaveMix(std::get<2>(OctaveMixRange), i_voice);
+            processor.setColour(std::get<2>(ColourRange), i_voice);
+            processor.setSparsity(std::get<2>(SparsityRange), i_voice);
+        }
+        if(configure)
+            configure(processor);
+
+        const int nChannels = juce::jmax(processor.getTotalNumInputChannels(), processor.getTotalNumOutputChannels());
+        const int nSamples = TestSeconds * static_cast<int>(TestSampleRate);
+        output.setSize(nChannels, nSamples);
+        juce::AudioBuffer<float> buffer(nChannels, TestBlockSize);
+        juce::MidiBuffer midi;
+        const double twoPi = 6.283185307179586;
+        for(int position = 0; position + TestBlockSize <= nSamples; position += TestBlockSize)
+        {
+            buffer.clear();
+            for(int i_channel = 0; i_channel < MainChannels; i_channel++)
+            {
+                float* data = buffer.getWritePointer(i_channel);
+                for(int i_sample = 0; i_sample < TestBlockSize; i_sample++)
+                {
+                    const double t = static_cast<double>(position + i_sample) / TestSampleRate;
+                    data[i_sample] = static_cast<float>(0.2 * (std::sin(twoPi * 220. * t) + std::sin(twoPi * (330. + 110. * i_channel) * t)));
+                }
+            }
+            // Hosts hand over the wet bus channels with whatever they held before
+            for(int i_channel = MainChannels; i_channel < nChannels; i_channel++)
+                juce::FloatVectorOperations::fill(buffer.getWritePointer(i_channel), 0.5f, TestBlockSize);
+            processor.processBlock(buffer, midi);
+            for(int i_channel = 0; i_channel < nChannels; i_channel++)
+                output.copyFrom(i_channel, position, buffer, i_channel, 0, TestBlockSize);
+        }
+        processor.releaseResources();
+        return true;
+    }
+
+    float maxDifference(const juce::AudioBuffer<float>& a, const int channelA, const juce::AudioBuffer<float>& b, const int channelB, const int start)
+    {
+        float difference = 0.f;
+        const float* dataA = a.getReadPointer(channelA);
+        const float* dataB = b.getReadPointer(channelB);
+        for(int i_sample = start; i_sample < a.getNumSamples(); i_sample++)
+            difference = juce::jmax(difference, std::abs(dataA[i_sample] - dataB[i_sample]));
+        return difference;
+    }
+
+    // The main engines are sized from the main bus only. Were the wet bus channels counted as well, main engines would
+    // run over them, in place, at the same time as the voices write them.
+    bool testMainBus(const juce::AudioBuffer<float>& withWet, const juce::AudioBuffer<float>& withoutWet)
+    {
+        float difference = 0.f;
+        for(int i_channel = 0; i_channel < MainChannels; i_channel++)
+            difference = juce::jmax(difference, maxDifference(withWet, i_channel, withoutWet, i_channel, 0));
+        const bool passed = difference == 0.f && withoutWet.getMagnitude(0, withoutWet.getNumSamples()) > 0.f;
+        std::printf("%s main bus unchanged by the wet buses: max difference %g\n", passed ? "PASS" : "FAIL", static_cast<double>(difference));
+        return passed;
+    }
+
+    // Each wet bus channel carries the voice of its own channel at 0 dB, which has the settings of the main voice
+    bool testWetBuses(const juce::AudioBuffer<float>& withWet)
+    {
+        bool passed = withWet.getNumChannels() == MainChannels * static_cast<int>(VoiceNumber);
+        const float peak = withWet.getMagnitude(0, SettleSamples, withWet.getNumSamples() - SettleSamples);
+        const float tolerance = 1e-3f * peak;
+        for(int i_bus = 1; passed && i_bus < static_cast<int>(VoiceNumber); i_bus++)
+        {
+            float difference = 0.f;
+            float busPeak = 0.f;
+            for(int i_channel = 0; i_channel < MainChannels; i_channel++)
+            {
+                const int busChannel = i_bus * MainChannels + i_channel;
+                difference = juce::jmax(difference, maxDifference(withWet, busChannel, withWet, i_channel, SettleSamples));
+                busPeak = juce::jmax(busPeak, withWet.getMagnitude(busChannel, SettleSamples, withWet.getNumSamples() - SettleSamples));
+            }
+            passed = busPeak > 0.f && difference <= tolerance;
+            std::printf("%s wet bus %d against the main output: peak %g, max difference %g\n", passed ? "PASS" : "FAIL", i_bus + 1,
+                        static_cast<double>(busPeak), static_cast<double>(difference));
+        }
+        return passed;
+    }
+
+    // As a host automates it or a state restore sets it, without the editor's setters
+    void setParameterFromHost(AudioPluginAudioProcessor& processor, const juce::String& id, const float value)
+    {
+        for(juce::AudioProcessorParameter* parameter : processor.getParameters())
+        {
+            auto* ranged = dynamic_cast<juce::RangedAudioParameter*>(parameter);
+            if(ranged != nullptr && ranged->getParameterID() == id)
+                ranged->setValueNotifyingHost(ranged->convertTo0to1(value));
+        }
+    }
+
+    // The scale mask is read from the parameters in every block, so a host setting scale and root has to sound
+    // exactly like the editor setting them, and different from all pitches open
+    bool testScaleFromHost(const juce::AudioBuffer<float>& allPitches)
+    {
+        constexpr int TestScale{3};
+        constexpr int TestScaleRoot{2};
+        juce::AudioBuffer<float> fromEditor, fromHost;
+        bool passed = render(false, fromEditor, [](AudioPluginAudioProcessor& processor)
+                             {
+                                 processor.setScale(TestScale);
+                                 processor.setScaleRoot(TestScaleRoot);
+                             });
+        passed = render(false, fromHost, [](AudioPluginAudioProcessor& processor)
+                        {
+                            setParameterFromHost(processor, "scale", static_cast<float>(TestScale));
+                            setParameterFromHost(processor, "scaleRoot", static_cast<float>(TestScaleRoot));
+                        }) && passed;
+        float difference = 0.f, scaleEffect = 0.f;
+        for(int i_channel = 0; passed && i_channel < MainChannels; i_channel++)
+        {
+            difference = juce::jmax(difference, maxDifference(fromHost, i_channel, fromEditor, i_channel, 0));
+            scaleEffect = juce::jmax(scaleEffect, maxDifference(fromEditor, i_channel, allPitches, i_channel, 0));
+        }
+        passed = passed && difference == 0.f && scaleEffect > 0.f;
+        std::printf("%s scale set by the host: max difference to the editor %g, to all pitches %g\n", passed ? "PASS" : "FAIL",
+                    static_cast<double>(difference), static_cast<double>(scaleEffect));
+        return passed;
+    }
+}
+
+int main()
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::AudioBuffer<float> withWet, withoutWet;
+    if(!render(true, withWet) || !render(false, withoutWet))
+    {
+        std::printf("FAIL bus layouts not supported\n");
+        return 1;
+    }
+    bool passed = true;
+    passed = testMainBus(withWet, withoutWet) && passed;
+    passed = testWetBuses(withWet) && passed;
+    passed = testScaleFromHost(withoutWet) && passed;
+    return passed ? 0 : 1;
+}
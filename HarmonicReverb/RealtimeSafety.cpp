@@ -0,0 +1,164 @@
+#include "../include/RealtimeSafety.h"
+
+#if HARMONIC_REVERB_REALTIME_CHECKS
+
+#include <juce_core/juce_core.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#if JUCE_LINUX || JUCE_MAC
+ #include <dlfcn.h>
+ #include <pthread.h>
+#endif
+
+constexpr unsigned long MaxReportedViolations{32ul}; // later violations are only counted
+
+namespace
+{
+    thread_local int realtimeDepth{0};
+    thread_local bool reporting{false};
+    std::atomic<unsigned long> violationCount{0ul};
+
+    // The report itself allocates and locks, so the check is off on this thread while reporting
+    void reportViolation(const char* what)
+    {
+        if(realtimeDepth == 0 || reporting)
+            return;
+        reporting = true;
+        const unsigned long count = violationCount.fetch_add(1ul) + 1ul;
+        if(count <= MaxReportedViolations)
+        {
+            std::fprintf(stderr, "[realtime check] %s on the audio thread (violation %lu)\n%s\n",
+                         what, count, juce::SystemStats::getStackBacktrace().toRawUTF8());
+            if(count == MaxReportedViolations)
+                std::fprintf(stderr, "[realtime check] further violations are counted but not reported\n");
+        }
+        reporting = false;
+    }
+
+    void* allocate(const std::size_t size)
+    {
+        reportViolation("allocation");
+        if(void* memory = std::malloc(size == 0 ? 1 : size))
+            return memory;
+        throw std::bad_alloc();
+    }
+
+    void* allocateAligned(const std::size_t size, const std::align_val_t alignment)
+    {
+        reportViolation("allocation");
+        const std::size_t alignmentSize = static_cast<std::size_t>(alignment);
+        const std::size_t roundedSize = ((size == 0 ? 1 : size) + alignmentSize - 1) / alignmentSize * alignmentSize;
+       #if JUCE_WINDOWS
+        if(void* memory = _aligned_malloc(roundedSize, alignmentSize))
+       #else
+        if(void* memory = std::aligned_alloc(alignmentSize, roundedSize))
+       #endif
+            return memory;
+        throw std::bad_alloc();
+    }
+
+    void deallocate(void* memory)
+    {
+        if(memory == nullptr)
+            return;
+        reportViolation("deallocation");
+        std::free(memory);
+    }
+
+    void deallocateAligned(void* memory)
+    {
+        if(memory == nullptr)
+            return;
+        reportViolation("deallocation");
+       #if JUCE_WINDOWS
+        _aligned_free(memory);
+       #else
+        std::free(memory);
+       #endif
+    }
+}
+
+void ScopedRealtimeCheck::enter()
+{
+    realtimeDepth++;
+}
+
+void ScopedRealtimeCheck::leave()
+{
+    realtimeDepth--;
+}
+
+unsigned long ScopedRealtimeCheck::getViolationCount()
+{
+    return violationCount.load();
+}
+
+//==============================================================================
+// Allocator, replaced for everything linked into the plugin
+void* operator new (std::size_t size) { return allocate(size); }
+void* operator new[] (std::size_t size) { return allocate(size); }
+void* operator new (std::size_t size, const std::nothrow_t&) noexcept { try { return allocate(size); } catch(...) { return nullptr; } }
+void* operator new[] (std::size_t size, const std::nothrow_t&) noexcept { try { return allocate(size); } catch(...) { return nullptr; } }
+void* operator new (std::size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+void* operator new[] (std::size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+
+void operator delete (void* memory) noexcept { deallocate(memory); }
+void operator delete[] (void* memory) noexcept { deallocate(memory); }
+void operator delete (void* memory, std::size_t) noexcept { deallocate(memory); }
+void operator delete[] (void* memory, std::size_t) noexcept { deallocate(memory); }
+void operator delete (void* memory, std::align_val_t) noexcept { deallocateAligned(memory); }
+void operator delete[] (void* memory, std::align_val_t) noexcept { deallocateAligned(memory); }
+void operator delete (void* memory, std::size_t, std::align_val_t) noexcept { deallocateAligned(memory); }
+void operator delete[] (void* memory, std::size_t, std::align_val_t) noexcept { deallocateAligned(memory); }
+
+//==============================================================================
+// Blocking primitives, std::mutex and std::condition_variable end up here on POSIX.
+// try_lock is not reported, it never blocks.
+#if JUCE_LINUX || JUCE_MAC
+namespace
+{
+    // No function-local statics here, their initialisation guard may itself lock a mutex
+    template <typename Function>
+    Function nextFunction(std::atomic<Function>& cache, const char* name)
+    {
+        Function function = cache.load(std::memory_order_relaxed);
+        if(function == nullptr)
+        {
+            function = reinterpret_cast<Function>(dlsym(RTLD_NEXT, name));
+            cache.store(function, std::memory_order_relaxed);
+        }
+        return function;
+    }
+
+    std::atomic<int (*)(pthread_mutex_t*)> nextMutexLock{nullptr};
+    std::atomic<int (*)(pthread_cond_t*, pthread_mutex_t*)> nextCondWait{nullptr};
+    std::atomic<int (*)(pthread_cond_t*, pthread_mutex_t*, const struct timespec*)> nextCondTimedWait{nullptr};
+}
+
+extern "C"
+{
+    int pthread_mutex_lock (pthread_mutex_t* mutex)
+    {
+        reportViolation("mutex lock");
+        return nextFunction(nextMutexLock, "pthread_mutex_lock")(mutex);
+    }
+
+    int pthread_cond_wait (pthread_cond_t* condition, pthread_mutex_t* mutex)
+    {
+        reportViolation("condition wait");
+        return nextFunction(nextCondWait, "pthread_cond_wait")(condition, mutex);
+    }
+
+    int pthread_cond_timedwait (pthread_cond_t* condition, pthread_mutex_t* mutex, const struct timespec* time)
+    {
+        reportViolation("condition wait");
+        return nextFunction(nextCondTimedWait, "pthread_cond_timedwait")(condition, mutex, time);
+    }
+}
+#endif
+
+#endif
@@ -0,0 +1,407 @@
+// Realtime stress test, every audio thread call inside a ScopedRealtimeCheck. Fails if any of them allocated or locked.
+//  - Bare engines with random block sizes, parameter sweeps, tuning changes and state restores.
+//  - AudioPluginAudioProcessor as a host runs it: an audio thread calls processBlock or processBlockBypassed with
+//    random block sizes and MIDI notes, while the message thread changes parameters through the setters and as host
+//    automation, saves and restores the state, switches bus layouts (wet buses included), sample rates, offline mode
+//    and bypass, and starts and stops recordings. That covers the pool dispatch, handleMidi, the bypass fades, the
+//    governor, the recorder and the wet bus routing, as pool workers are checked inside processChannel too.
+//
+//   HarmonicReverbStressTest [--seconds 20] [--seed 1]
+//
+// Built with HARMONIC_REVERB_REALTIME_CHECKS, see include/RealtimeSafety.h. Violations are reported with a stack
+// trace as they happen; the test returns non-zero if there were any.
+
+#include "../include/CqtReverb.h"
+#include "../include/RealtimeSafety.h"
+#include "../include/RealtimeWorkerPool.h"
+#include "PluginProcessor.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+constexpr unsigned StressTestBins{12};
+constexpr unsigned StressTestOctaves{9};
+
+using Engine = CqtReverb<StressTestBins, StressTestOctaves>;
+
+namespace
+{
+    constexpr int MaxBlockSize{1024};
+    constexpr unsigned ChannelNumber{2u};
+    constexpr unsigned ParameterPeriod{8u}; // callbacks between parameter changes, on average
+    constexpr int MaxProcessorChannels{32}; // main and two wet buses of the largest layout below fit
+    constexpr int MidiCapacity{4096};       // bytes, so adding the notes of a block never allocates
+    constexpr int MaxControlInterval{4};    // ms of message loop between two changes of the processor
+
+    struct Settings
+    {
+        double seconds{20.};
+        unsigned seed{1u};
+    };
+
+    // Host-like configurations: plain, resampled to an internal rate, and offline with octaves on a pool
+    struct Configuration
+    {
+        const char* name;
+        double sampleRate;
+        double internalRate;
+        bool octavePool;
+    };
+
+    bool parseArguments(const int argc, char** argv, Settings& settings)
+    {
+        for(int i_arg = 1; i_arg < argc; i_arg++)
+        {
+            const std::string name = argv[i_arg];
+            if(name == "--help" || i_arg + 1 >= argc)
+                return false;
+            const char* value = argv[++i_arg];
+            if(name == "--seconds")
+                settings.seconds = std::atof(value);
+            else if(name == "--seed")
+                settings.seed = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+            else
+                return false;
+        }
+        return settings.seconds > 0.;
+    }
+
+    // Every setter the plugin calls while processing, with random values in the ranges of its parameters
+    void changeParameters(Engine& engine, std::mt19937& random)
+    {
+        std::uniform_real_distribution<double> unit(0., 1.);
+        std::uniform_int_distribution<unsigned> octave(0u, StressTestOctaves - 1u);
+        switch(random() % 12u)
+        {
+            case 0u: engine.setAttack(unit(random)); break;
+            case 1u: engine.setDecay(unit(random)); break;
+            case 2u: engine.setOctaveShift(6. * unit(random) - 3.); break;
+            case 3u: engine.setOctaveMix(unit(random)); break;
+            case 4u: engine.setColour(2. * unit(random) - 1.); break;
+            case 5u: engine.setSparsity(10. * unit(random)); break;
+            case 6u: engine.setTuning(415.305 + (466.164 - 415.305) * unit(random)); break;
+            case 7u: engine.setMaxPartials(random() % 3u == 0u ? 0u : random() % (StressTestOctaves * StressTestBins)); break;
+            case 8u:
+            {
+                const unsigned first = octave(random);
+                engine.setActiveOctaves(first, first + octave(random) % (StressTestOctaves - first));
+                break;
+            }
+            case 9u: engine.setPitchClassMask(random() % 4u == 0u ? AllPitchClasses : static_cast<uint32_t>(random())); break;
+            case 10u: engine.setQualityTier(random() % QualityTierNumber); break;
+            default: engine.setFreeze(random() % 4u == 0u); break;
+        }
+    }
+
+    // Host layouts: the main bus with none, one or both wet buses, which have to follow the main layout
+    struct Layout
+    {
+        const char* name;
+        juce::AudioChannelSet channels;
+        unsigned wetBuses;
+    };
+
+    const Layout& randomLayout(std::mt19937& random)
+    {
+        static const Layout layouts[] = {
+            {"mono", juce::AudioChannelSet::mono(), 0u},
+            {"stereo", juce::AudioChannelSet::stereo(), 0u},
+            {"stereo, one wet bus", juce::AudioChannelSet::stereo(), 1u},
+            {"stereo, two wet buses", juce::AudioChannelSet::stereo(), 2u},
+            {"5.1, two wet buses", juce::AudioChannelSet::create5point1(), 2u},
+            {"first order ambisonics, one wet bus", juce::AudioChannelSet::ambisonic(1), 1u},
+        };
+        return layouts[random() % (sizeof(layouts) / sizeof(layouts[0]))];
+    }
+
+    // Message thread, with the callback lock held like a host that reconfigures a running plugin
+    bool applyLayout(AudioPluginAudioProcessor& processor, const Layout& layout, const double sampleRate)
+    {
+        AudioPluginAudioProcessor::BusesLayout buses;
+        buses.inputBuses.add(layout.channels);
+        buses.outputBuses.add(layout.channels);
+        for(unsigned i_voice = 1u; i_voice < VoiceNumber; i_voice++)
+            buses.outputBuses.add(i_voice <= layout.wetBuses ? layout.channels : juce::AudioChannelSet::disabled());
+
+        const juce::ScopedLock lock(processor.getCallbackLock());
+        processor.releaseResources();
+        if(!processor.setBusesLayout(buses))
+        {
+            std::fprintf(stderr, "layout %s not supported\n", layout.name);
+            return false;
+        }
+        processor.setRateAndBufferSizeDetails(sampleRate, MaxBlockSize);
+        processor.prepareToPlay(sampleRate, MaxBlockSize);
+        return true;
+    }
+
+    // Host audio thread: buffers and MIDI storage are allocated up front, the callback lock is taken outside the check
+    void runAudioThread(AudioPluginAudioProcessor& processor, const std::atomic<bool>& running, const std::atomic<bool>& bypassed,
+                        std::atomic<size_t>& nCallbacks, const unsigned seed)
+    {
+        std::mt19937 random(seed);
+        std::uniform_int_distribution<int> blockSize(1, MaxBlockSize);
+        std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+        std::vector<float> storage(static_cast<size_t>(MaxProcessorChannels * MaxBlockSize), 0.f);
+        float* channels[MaxProcessorChannels];
+        for(int i_channel = 0; i_channel < MaxProcessorChannels; i_channel++)
+            channels[i_channel] = storage.data() + i_channel * MaxBlockSize;
+        juce::MidiBuffer midi;
+        midi.ensureSize(MidiCapacity);
+
+        const double twoPi = 6.283185307179586;
+        size_t position = 0u;
+        while(running.load())
+        {
+            const int nBlock = blockSize(random);
+            midi.clear();
+            if(random() % 16u == 0u)
+            {
+                const int note = 36 + static_cast<int>(random() % 48u);
+                midi.addEvent(random() % 2u == 0u ? juce::MidiMessage::noteOn(1, note, 0.8f) : juce::MidiMessage::noteOff(1, note), static_cast<int>(random() % static_cast<unsigned>(nBlock)));
+            }
+            {
+                const juce::ScopedLock lock(processor.getCallbackLock());
+                if(!processor.isSuspended())
+                {
+                    const int nInputs = processor.getTotalNumInputChannels();
+                    const int nChannels = juce::jmin(MaxProcessorChannels, juce::jmax(nInputs, processor.getTotalNumOutputChannels()));
+                    for(int i_channel = 0; i_channel < nChannels; i_channel++)
+                    {
+                        for(int i_sample = 0; i_sample < nBlock; i_sample++)
+                        {
+                            const double t = static_cast<double>(position + static_cast<size_t>(i_sample)) / processor.getSampleRate();
+                            // output-only channels hold whatever the host left in them
+                            channels[i_channel][i_sample] = i_channel < nInputs ? static_cast<float>(0.2 * std::sin(twoPi * 220. * t)) + 0.05f * uniform(random) : 0.5f;
+                        }
+                    }
+                    juce::AudioBuffer<float> buffer(channels, nChannels, nBlock);
+                    ScopedRealtimeCheck realtimeCheck;
+                    if(bypassed.load())
+                        processor.processBlockBypassed(buffer, midi);
+                    else
+                        processor.processBlock(buffer, midi);
+                }
+            }
+            nCallbacks.fetch_add(1u);
+            position += static_cast<size_t>(nBlock);
+            std::this_thread::yield();
+        }
+    }
+
+    // Setters the editor calls, with random values in the ranges of their parameters
+    void callSetter(AudioPluginAudioProcessor& processor, std::mt19937& random)
+    {
+        std::uniform_real_distribution<double> unit(0., 1.);
+        const unsigned voice = random() % VoiceNumber;
+        switch(random() % 17u)
+        {
+            case 0u: processor.setAttack(unit(random), voice); break;
+            case 1u: processor.setDecay(unit(random), voice); break;
+            case 2u: processor.setOctaveShift(6. * unit(random) - 3., voice); break;
+            case 3u: processor.setOctaveMix(unit(random), voice); break;
+            case 4u: processor.setColour(2. * unit(random) - 1., voice); break;
+            case 5u: processor.setSparsity(10. * unit(random), voice); break;
+            case 6u: processor.setTuning(415.305 + (466.164 - 415.305) * unit(random)); break;
+            case 7u: processor.setFreeze(random() % 4u == 0u); break;
+            case 8u: processor.setGain(40. * unit(random) - 20.); break;
+            case 9u: processor.setMix(unit(random)); break;
+            case 10u: processor.setMaster(40. * unit(random) - 20.); break;
+            case 11u: processor.setCpuBudget(0.1 + 0.9 * unit(random)); break;
+            case 12u: processor.setMaxPartials(random() % 3u == 0u ? 0 : static_cast<int>(random() % (OctaveNumber * BinsPerOctave))); break;
+            case 13u: processor.setLowOctave(static_cast<int>(random() % OctaveNumber)); break;
+            case 14u: processor.setHighOctave(static_cast<int>(random() % OctaveNumber)); break;
+            case 15u: processor.setScale(static_cast<int>(random() % ScaleNumber)); break;
+            default: processor.setScaleRoot(static_cast<int>(random() % 12u)); break;
+        }
+    }
+
+    unsigned long runProcessor(const Settings& settings)
+    {
+        const unsigned long violationsBefore = ScopedRealtimeCheck::getViolationCount();
+        std::mt19937 random(settings.seed);
+        std::uniform_real_distribution<float> unit(0.f, 1.f);
+        const double sampleRates[] = {44100., 48000., 96000.};
+
+        AudioPluginAudioProcessor processor;
+        if(!applyLayout(processor, randomLayout(random), 48000.))
+            return 1ul;
+        std::atomic<bool> running{true};
+        std::atomic<bool> bypassed{false};
+        std::atomic<size_t> nCallbacks{0u};
+        std::thread audioThread([&processor, &running, &bypassed, &nCallbacks, &settings]
+                                { runAudioThread(processor, running, bypassed, nCallbacks, settings.seed + 1u); });
+
+        juce::MemoryBlock state;
+        processor.getStateInformation(state);
+        const juce::File recording = juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("HarmonicReverbStressTest.hrev");
+        size_t nChanges = 0u;
+        bool layoutsSupported = true;
+        const auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(settings.seconds);
+        while(std::chrono::steady_clock::now() < end && layoutsSupported)
+        {
+            // timers run here as well, e.g. the one publishing the quality tier
+            juce::MessageManager::getInstance()->runDispatchLoopUntil(1 + static_cast<int>(random() % static_cast<unsigned>(MaxControlInterval)));
+            const unsigned change = random() % 64u;
+            if(change < 32u)
+            {
+                callSetter(processor, random);
+            }
+            else if(change < 48u)
+            {
+                // host automation, of the parameters hosts may write
+                auto& parameters = processor.getParameters();
+                auto* parameter = parameters[static_cast<int>(random() % static_cast<unsigned>(parameters.size()))];
+                if(parameter->isAutomatable())
+                    parameter->setValueNotifyingHost(unit(random));
+            }
+            else if(change < 52u)
+            {
+                processor.getStateInformation(state);
+            }
+            else if(change < 56u)
+            {
+                processor.setStateInformation(state.getData(), static_cast<int>(state.getSize()));
+            }
+            else if(change < 58u)
+            {
+                layoutsSupported = applyLayout(processor, randomLayout(random), sampleRates[random() % 3u]);
+            }
+            else if(change < 59u)
+            {
+                processor.setNonRealtime(!processor.isNonRealtime());
+            }
+            else if(change < 60u)
+            {
+                processor.setInternalRate(random() % 2u == 0u);
+            }
+            else if(change < 62u)
+            {
+                if(processor.isRecording())
+                    processor.stopRecording();
+                else
+                    processor.startRecording(recording);
+            }
+            else
+            {
+                bypassed.store(!bypassed.load());
+            }
+            nChanges++;
+        }
+        running.store(false);
+        audioThread.join();
+        processor.stopRecording();
+        processor.releaseResources();
+        recording.deleteFile();
+
+        const unsigned long nViolations = ScopedRealtimeCheck::getViolationCount() - violationsBefore;
+        const bool passed = nViolations == 0ul && layoutsSupported;
+        std::printf("%s processor under host changes: %zu callbacks, %zu changes, %lu violations\n", passed ? "PASS" : "FAIL",
+                    nCallbacks.load(), nChanges, nViolations);
+        return passed ? 0ul : juce::jmax(1ul, nViolations);
+    }
+
+    unsigned long runConfiguration(const Configuration& configuration, const Settings& settings)
+    {
+        const unsigned long violationsBefore = ScopedRealtimeCheck::getViolationCount();
+        std::mt19937 random(settings.seed);
+        std::uniform_int_distribution<int> blockSize(1, MaxBlockSize);
+        std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+
+        RealtimeWorkerPool pool;
+        if(configuration.octavePool)
+            pool.start(2u);
+        std::unique_ptr<Engine> engines[ChannelNumber];
+        for(std::unique_ptr<Engine>& engine : engines)
+        {
+            engine = std::make_unique<Engine>();
+            engine->init(configuration.sampleRate, MaxBlockSize, configuration.internalRate);
+            if(configuration.octavePool)
+                engine->setOctavePool(&pool);
+        }
+        std::vector<float> buffer(MaxBlockSize, 0.f);
+        std::vector<double> gain(MaxBlockSize, 1.), wet(MaxBlockSize, 0.5), dry(MaxBlockSize, 0.5);
+        std::vector<unsigned char> state;
+
+        const double twoPi = 6.283185307179586;
+        const size_t nSamples = static_cast<size_t>(settings.seconds * configuration.sampleRate);
+        size_t nCallbacks = 0u;
+        for(size_t position = 0u; position < nSamples; nCallbacks++)
+        {
+            const int nBlock = blockSize(random);
+            for(int i_sample = 0; i_sample < nBlock; i_sample++)
+            {
+                const double t = static_cast<double>(position + static_cast<size_t>(i_sample)) / configuration.sampleRate;
+                buffer[i_sample] = static_cast<float>(0.2 * std::sin(twoPi * 220. * t)) + 0.05f * uniform(random);
+            }
+
+            // checkpoints are written on the message thread and restored on the audio thread
+            const bool restoring = !state.empty() && random() % 64u == 0u;
+            if(random() % 64u == 0u)
+                engines[0]->saveState(state);
+
+            {
+                ScopedRealtimeCheck realtimeCheck;
+                for(std::unique_ptr<Engine>& engine : engines)
+                {
+                    if(random() % ParameterPeriod == 0u)
+                        changeParameters(*engine, random);
+                    if(restoring)
+                        engine->restoreState(state.data(), state.size());
+                    if(random() % 2u == 0u)
+                        engine->processBlock(buffer.data(), buffer.data(), nBlock, gain.data(), wet.data(), dry.data());
+                    else
+                        engine->processBlock(buffer.data(), buffer.data(), nBlock);
+                    if(random() % 256u == 0u)
+                        engine->reset();
+                }
+            }
+            position += static_cast<size_t>(nBlock);
+        }
+        if(configuration.octavePool)
+        {
+            for(std::unique_ptr<Engine>& engine : engines)
+                engine->setOctavePool(nullptr);
+            pool.stop();
+        }
+
+        const unsigned long nViolations = ScopedRealtimeCheck::getViolationCount() - violationsBefore;
+        std::printf("%s %s: %zu callbacks, %lu violations\n", nViolations == 0ul ? "PASS" : "FAIL", configuration.name, nCallbacks, nViolations);
+        return nViolations;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Settings settings;
+    if(!parseArguments(argc, argv, settings))
+    {
+        std::fprintf(stderr, "usage: %s [--seconds s] [--seed n]\n", argv[0]);
+        return 1;
+    }
+#if !HARMONIC_REVERB_REALTIME_CHECKS
+    std::fprintf(stderr, "built without HARMONIC_REVERB_REALTIME_CHECKS, nothing is checked\n");
+    return 1;
+#endif
+
+    const Configuration configurations[] = {
+        {"48000 Hz", 48000., 0., false},
+        {"44100 Hz at an internal rate of 48000 Hz", 44100., 48000., false},
+        {"48000 Hz, octaves on a pool", 48000., 0., true},
+    };
+    unsigned long nViolations = 0ul;
+    for(const Configuration& configuration : configurations)
+        nViolations += runConfiguration(configuration, settings);
+
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    nViolations += runProcessor(settings);
+    return nViolations == 0ul ? 0 : 1;
+}
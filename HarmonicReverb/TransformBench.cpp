@@ -0,0 +1,301 @@
+// Transform benchmark: per-hop cost of the engine's sliding CQT, and per-hop cost and accuracy of the pffft
+// precisions built into the plugin, for an FFT-based CQT with one forward and one inverse transform per octave.
+//
+//   HarmonicReverbTransformBench [--hops 2000] [--fft-size 1024] [--precision both] [--sample-rate 48000]
+//
+// --precision picks the pffft paths at runtime (float, double or both), the HARMONIC_REVERB_PFFFT build option
+// decides which of them exist. Accuracy is the error of the forward transform of white noise against a long
+// double DFT, and of a forward and inverse round trip, both in dB relative to the signal.
+
+#include "../include/CqtReverb.h"
+
+#if HARMONIC_REVERB_PFFFT_FLOAT
+ #include "../submodules/rt-cqt/submodules/pffft/pffft.h"
+#endif
+#if HARMONIC_REVERB_PFFFT_DOUBLE
+ #include "../submodules/rt-cqt/submodules/pffft/pffft_double.h"
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+constexpr unsigned BenchBins{12};
+constexpr unsigned BenchOctaves{9};
+
+namespace
+{
+    struct Settings
+    {
+        unsigned hops{2000u};
+        int fftSize{1024};
+        bool runFloat{true};
+        bool runDouble{true};
+        double sampleRate{48000.};
+    };
+
+    struct Result
+    {
+        double microsecondsPerHop;
+        double errorDb;
+        double roundTripDb;
+    };
+
+    double elapsedMicroseconds(const std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    double toDb(const double errorEnergy, const double signalEnergy)
+    {
+        return 10. * std::log10(std::max(errorEnergy, 1e-300) / signalEnergy);
+    }
+
+    std::vector<double> makeNoise(const int size)
+    {
+        std::mt19937 generator(1234u);
+        std::uniform_real_distribution<double> distribution(-1., 1.);
+        std::vector<double> noise(static_cast<size_t>(size));
+        for(auto& sample : noise)
+            sample = distribution(generator);
+        return noise;
+    }
+
+    // Reference spectrum in pffft's ordered real layout: DC, Nyquist, then re/im of bins 1 to size/2 - 1
+    std::vector<long double> referenceSpectrum(const std::vector<double>& input)
+    {
+        const size_t size = input.size();
+        std::vector<long double> cosines(size), sines(size);
+        for(size_t n = 0u; n < size; n++)
+        {
+            const long double phase = -6.283185307179586476925L * static_cast<long double>(n) / static_cast<long double>(size);
+            cosines[n] = std::cos(phase);
+            sines[n] = std::sin(phase);
+        }
+        std::vector<long double> spectrum(size);
+        for(size_t k = 0u; k <= size / 2u; k++)
+        {
+            long double re = 0.L, im = 0.L;
+            for(size_t n = 0u; n < size; n++)
+            {
+                const size_t index = (k * n) % size;
+                re += static_cast<long double>(input[n]) * cosines[index];
+                im += static_cast<long double>(input[n]) * sines[index];
+            }
+            if(k == 0u)
+                spectrum[0] = re;
+            else if(k == size / 2u)
+                spectrum[1] = re;
+            else
+            {
+                spectrum[2u * k] = re;
+                spectrum[2u * k + 1u] = im;
+            }
+        }
+        return spectrum;
+    }
+
+    template <typename T>
+    void measureAccuracy(const std::vector<double>& noise, const std::vector<long double>& reference, const std::vector<T>& spectrum,
+                         const std::vector<T>& roundTrip, Result& result)
+    {
+        double signalEnergy = 0., errorEnergy = 0.;
+        for(size_t i = 0u; i < reference.size(); i++)
+        {
+            signalEnergy += static_cast<double>(reference[i] * reference[i]);
+            const double error = static_cast<double>(static_cast<long double>(spectrum[i]) - reference[i]);
+            errorEnergy += error * error;
+        }
+        result.errorDb = toDb(errorEnergy, signalEnergy);
+
+        // pffft does not scale, the round trip comes back size times larger
+        const double scale = 1. / static_cast<double>(noise.size());
+        signalEnergy = 0.;
+        errorEnergy = 0.;
+        for(size_t i = 0u; i < noise.size(); i++)
+        {
+            signalEnergy += noise[i] * noise[i];
+            const double error = static_cast<double>(roundTrip[i]) * scale - noise[i];
+            errorEnergy += error * error;
+        }
+        result.roundTripDb = toDb(errorEnergy, signalEnergy);
+    }
+
+    // The transform the engine runs, analysis and inverse of one hop
+    Result measureSlidingCqt(const Settings& settings)
+    {
+        auto cqt = std::make_unique<Cqt::SlidingCqt<BenchBins, BenchOctaves, false>>();
+        cqt->init(settings.sampleRate, BlockSize);
+        const std::vector<double> noise = makeNoise(BlockSize);
+        std::vector<double> input(noise);
+        double checksum = 0.;
+        const unsigned warmup = settings.hops / 10u;
+        auto start = std::chrono::steady_clock::now();
+        for(unsigned i_hop = 0u; i_hop < warmup + settings.hops; i_hop++)
+        {
+            if(i_hop == warmup)
+                start = std::chrono::steady_clock::now();
+            cqt->inputBlock(input.data(), BlockSize);
+            checksum += cqt->outputBlock(BlockSize)[0];
+            input = noise;
+        }
+        const double elapsed = elapsedMicroseconds(start);
+        if(checksum == 12345.)
+            std::printf(" ");
+        return {elapsed / static_cast<double>(settings.hops), std::nan(""), std::nan("")};
+    }
+
+#if HARMONIC_REVERB_PFFFT_FLOAT
+    Result measurePffftFloat(const Settings& settings, const std::vector<double>& noise, const std::vector<long double>& reference)
+    {
+        const size_t size = static_cast<size_t>(settings.fftSize);
+        PFFFT_Setup* setup = pffft_new_setup(settings.fftSize, PFFFT_REAL);
+        float* input = static_cast<float*>(pffft_aligned_malloc(size * sizeof(float)));
+        float* output = static_cast<float*>(pffft_aligned_malloc(size * sizeof(float)));
+        float* work = static_cast<float*>(pffft_aligned_malloc(size * sizeof(float)));
+        for(size_t i = 0u; i < size; i++)
+            input[i] = static_cast<float>(noise[i]);
+
+        // unordered, as a convolution in the frequency domain would use it
+        const unsigned warmup = settings.hops / 10u;
+        auto start = std::chrono::steady_clock::now();
+        for(unsigned i_hop = 0u; i_hop < warmup + settings.hops; i_hop++)
+        {
+            if(i_hop == warmup)
+                start = std::chrono::steady_clock::now();
+            for(unsigned i_octave = 0u; i_octave < BenchOctaves; i_octave++)
+            {
+                pffft_transform(setup, input, output, work, PFFFT_FORWARD);
+                pffft_transform(setup, output, output, work, PFFFT_BACKWARD);
+            }
+        }
+        Result result{elapsedMicroseconds(start) / static_cast<double>(settings.hops), 0., 0.};
+
+        std::vector<float> spectrum(size), roundTrip(size);
+        pffft_transform_ordered(setup, input, output, work, PFFFT_FORWARD);
+        std::copy(output, output + size, spectrum.begin());
+        pffft_transform_ordered(setup, output, output, work, PFFFT_BACKWARD);
+        std::copy(output, output + size, roundTrip.begin());
+        measureAccuracy(noise, reference, spectrum, roundTrip, result);
+
+        pffft_aligned_free(work);
+        pffft_aligned_free(output);
+        pffft_aligned_free(input);
+        pffft_destroy_setup(setup);
+        return result;
+    }
+#endif
+
+#if HARMONIC_REVERB_PFFFT_DOUBLE
+    Result measurePffftDouble(const Settings& settings, const std::vector<double>& noise, const std::vector<long double>& reference)
+    {
+        const size_t size = static_cast<size_t>(settings.fftSize);
+        PFFFTD_Setup* setup = pffftd_new_setup(settings.fftSize, PFFFT_REAL);
+        double* input = static_cast<double*>(pffftd_aligned_malloc(size * sizeof(double)));
+        double* output = static_cast<double*>(pffftd_aligned_malloc(size * sizeof(double)));
+        double* work = static_cast<double*>(pffftd_aligned_malloc(size * sizeof(double)));
+        std::copy(noise.begin(), noise.end(), input);
+
+        const unsigned warmup = settings.hops / 10u;
+        auto start = std::chrono::steady_clock::now();
+        for(unsigned i_hop = 0u; i_hop < warmup + settings.hops; i_hop++)
+        {
+            if(i_hop == warmup)
+                start = std::chrono::steady_clock::now();
+            for(unsigned i_octave = 0u; i_octave < BenchOctaves; i_octave++)
+            {
+                pffftd_transform(setup, input, output, work, PFFFT_FORWARD);
+                pffftd_transform(setup, output, output, work, PFFFT_BACKWARD);
+            }
+        }
+        Result result{elapsedMicroseconds(start) / static_cast<double>(settings.hops), 0., 0.};
+
+        std::vector<double> spectrum(size), roundTrip(size);
+        pffftd_transform_ordered(setup, input, output, work, PFFFT_FORWARD);
+        std::copy(output, output + size, spectrum.begin());
+        pffftd_transform_ordered(setup, output, output, work, PFFFT_BACKWARD);
+        std::copy(output, output + size, roundTrip.begin());
+        measureAccuracy(noise, reference, spectrum, roundTrip, result);
+
+        pffftd_aligned_free(work);
+        pffftd_aligned_free(output);
+        pffftd_aligned_free(input);
+        pffftd_destroy_setup(setup);
+        return result;
+    }
+#endif
+
+    void printResult(const char* name, const Result& result, const double hopMicroseconds)
+    {
+        std::printf("%-22s %10.2f %9.2f%%", name, result.microsecondsPerHop, 100. * result.microsecondsPerHop / hopMicroseconds);
+        if(std::isnan(result.errorDb))
+            std::printf(" %10s %12s\n", "-", "-");
+        else
+            std::printf(" %10.1f %12.1f\n", result.errorDb, result.roundTripDb);
+    }
+
+    bool parseArguments(int argc, char* argv[], Settings& settings)
+    {
+        for(int i_arg = 1; i_arg < argc; i_arg++)
+        {
+            const std::string argument = argv[i_arg];
+            if(i_arg + 1 >= argc)
+                return false;
+            const std::string value = argv[++i_arg];
+            if(argument == "--hops")
+                settings.hops = static_cast<unsigned>(std::max(1, std::atoi(value.c_str())));
+            else if(argument == "--fft-size")
+                settings.fftSize = std::atoi(value.c_str());
+            else if(argument == "--sample-rate")
+                settings.sampleRate = std::atof(value.c_str());
+            else if(argument == "--precision" && (value == "float" || value == "double" || value == "both"))
+            {
+                settings.runFloat = value != "double";
+                settings.runDouble = value != "float";
+            }
+            else
+                return false;
+        }
+        // pffft takes multiples of 32 for real transforms, powers of two are kept for the reference
+        return settings.sampleRate > 0. && settings.fftSize >= 32 && (settings.fftSize & (settings.fftSize - 1)) == 0;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Settings settings;
+    if(!parseArguments(argc, argv, settings))
+    {
+        std::fprintf(stderr, "usage: %s [--hops 2000] [--fft-size 1024] [--precision float|double|both] [--sample-rate 48000]\n", argv[0]);
+        return 1;
+    }
+
+    const double hopMicroseconds = 1e6 * static_cast<double>(BlockSize) / settings.sampleRate;
+    std::printf("hop %d samples at %.0f Hz (%.0f us), %u octaves, fft size %d\n", BlockSize, settings.sampleRate, hopMicroseconds,
+                BenchOctaves, settings.fftSize);
+    std::printf("%-22s %10s %10s %10s %12s\n", "transform", "us/hop", "of hop", "error dB", "round trip dB");
+    printResult("sliding cqt (engine)", measureSlidingCqt(settings), hopMicroseconds);
+
+    const std::vector<double> noise = makeNoise(settings.fftSize);
+    const std::vector<long double> reference = referenceSpectrum(noise);
+#if HARMONIC_REVERB_PFFFT_FLOAT
+    if(settings.runFloat)
+        printResult("pffft float", measurePffftFloat(settings, noise, reference), hopMicroseconds);
+#else
+    if(settings.runFloat)
+        std::printf("%-22s not built, see HARMONIC_REVERB_PFFFT\n", "pffft float");
+#endif
+#if HARMONIC_REVERB_PFFFT_DOUBLE
+    if(settings.runDouble)
+        printResult("pffft double", measurePffftDouble(settings, noise, reference), hopMicroseconds);
+#else
+    if(settings.runDouble)
+        std::printf("%-22s not built, see HARMONIC_REVERB_PFFFT\n", "pffft double");
+#endif
+    return 0;
+}
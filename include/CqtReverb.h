@@ -1,28 +1,79 @@
 #pragma once
 
+#include <algorithm>
+#include <limits>
+#include <memory>
+
 #include "../submodules/rt-cqt/include/SlidingCqt.h"
 #include "../submodules/rt-cqt/submodules/audio-utils/include/SmoothedFloat.h"
-#include "../submodules/rt-cqt/submodules/audio-utils/include/CplxWavetableOscillator.h"
+#include "EngineKernels.h"
+#include "EnvelopeBank.h"
+#include "EnvelopeRecorder.h"
+#include "OscillatorPolicies.h"
+#include "PolyphaseResampler.h"
+#include "QualityGovernor.h"
+#include "RealtimeWorkerPool.h"
+#include "SpectralHistory.h"
+#include "StateBlob.h"
+#include "Tracing.h"
 
 using namespace std::complex_literals;
 constexpr int BlockSize{256};
 constexpr size_t WavetableSize{512u};
 
+// Oscillator of the bins, see include/OscillatorPolicies.h. The table oscillator's phase is checkpointed with the
+// engine state, the audio-utils one of the same size is not accessible.
+using DefaultOscillatorPolicy = WavetablePolicy<WavetableSize, TableInterpolation::Linear>;
+
 // Parameters later
 constexpr double MaxToneThresholdFactor{0.05}; // sparsity
 constexpr double GlobalMaxThresholdFactor{0.05};
 constexpr double OctaveMeanThresholdFactor{.75}; // sparsity
 
-template <unsigned B, unsigned OctaveNumber>
+// Quality tiers
+constexpr double PartialFloorFactor{0.01}; // partials below -40 dB of the loudest one are not synthesized
+constexpr unsigned EnvelopeStride{4u};
+constexpr unsigned MergedOctaveNumber{2u}; // lowest octaves, whose bins are merged
+constexpr unsigned MergedBinGroup{3u};     // adjacent bins merged into the loudest of them
+
+// Max partials
+constexpr double PartialHysteresis{1.25}; // selected bins keep their place unless a new one is this much louder
+
+// Pitch-class mask, bit 0 is C
+constexpr uint32_t AllPitchClasses{0xfffu};
+
+// Control decimation: a bin's magnitude cannot change much faster than its bandwidth, so the features of an octave
+// are refreshed ControlOversampling times per period of its narrowest bin, every power of two hops. At 48 kHz with a
+// 27.5 Hz lowest bin the upper six of nine octaves update every hop and the lowest every eighth.
+constexpr double ControlOversampling{8.};
+constexpr unsigned MaxControlInterval{32u};
+
+// The colour EQ is centred on the loudest octave, followed with this time constant
+constexpr double BaseOctaveSmoothingTime{1.}; // seconds
+
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy = DefaultOscillatorPolicy>
 class CqtReverb
 {
 public:
     CqtReverb() = default;
     ~CqtReverb() = default;
 
-    void init(const double samplerate, const int blockSize);
+    // internalRate > 0 runs the engine at that fixed rate, resampling from and back to samplerate
+    void init(const double samplerate, const int blockSize, const double internalRate = 0.);
+    double getEngineSampleRate() const { return mEngineSampleRate; };
+    // Host samples the internal rate FIFO adds to the hop latency, fixed for a given init, 0 at the host rate
+    int getResamplingLatency() const { return mResampling ? mOutputLatency : 0; };
+    // Silences the engine without reallocating, e.g. after it was not called for a while. Envelopes, features and
+    // pending output start from zero. The sliding CQT still holds the input from before, so each octave reads as
+    // silent until its analysis window has passed.
+    void reset();
 
-    void processBlock(double *const data, const int nSamples);
+    // output = wet * reverb + dry * input, with the optional per-sample gain applied to the engine input.
+    // Without a dry ramp the output is wet * reverb, without either the reverb only. Input and output may alias.
+    template <typename SampleType>
+    void processBlock(const SampleType *const input, SampleType *const output, const int nSamples,
+                      const double *const gain = nullptr, const double *const wet = nullptr, const double *const dry = nullptr);
+    void processBlock(double *const data, const int nSamples) { processBlock(data, data, nSamples); };
 
     const double *getOctaveValues(const int octave) { return mGainsIllustration[octave]; };
     inline double *getOctaveBinFreqs(const int octave) { return mCqt.getOctaveBinFreqs(octave); };
@@ -34,38 +85,137 @@ public:
     void setOctaveMix(const double octaveMix);
     void setColour(const double colour);
     void setSparsity(const double sparsity);
+    void setFreeze(const bool freeze);
+    void setQualityTier(const unsigned tier);
+    unsigned getQualityTier() const { return mQualityTier; };
+    // Synthesizes at most maxPartials bins per hop, 0 disables the limit
+    void setMaxPartials(const unsigned maxPartials);
+    // Octaves outside [firstOctave, lastOctave] (0 is the highest) are skipped by feature extraction and synthesis
+    // and contribute silence to the output. Takes effect at the next hop.
+    void setActiveOctaves(const unsigned firstOctave, const unsigned lastOctave);
+    // Only bins nearest to a pitch class in mask are synthesized. Masked bins fade out with the decay and are then
+    // skipped like silent ones, so a sparse scale also saves their oscillators. Takes effect at the next hop.
+    void setPitchClassMask(const uint32_t mask) { mPitchClassMask = mask & AllPitchClasses; };
+
+    // Checkpoint of the processing state for offline renders. restoreState does not call init or allocate, the engine
+    // has to be initialised with the same rates and block size as the one that wrote the blob; returns false otherwise.
+    // Parameters are not included, they are restored through the setters.
+    void saveState(std::vector<unsigned char> &state);
+    bool restoreState(const unsigned char *const data, const size_t size);
+
+    // Offline rendering: octaves of a hop are synthesized in parallel on the given pool (nullptr runs them inline),
+    // and the display values can be skipped. Output is identical either way, as octaves share no synthesis state,
+    // see HarmonicReverb/EngineTest.cpp. Every hop dispatches a job, which relies on the pool claiming tasks with
+    // their job generation so no late worker can take a task of the next hop.
+    void setOctavePool(RealtimeWorkerPool *const pool) { mOctavePool = pool; };
+    void setDisplayEnabled(const bool displayEnabled) { mDisplayEnabled = displayEnabled; };
+
+    // Shared analysis: this engine skips the sliding CQT analysis and reads the bin magnitudes of source instead,
+    // only feature extraction, synthesis and the inverse run here. The input then only paces the hops.
+    // Both engines have to be initialised together with the same rates and block size, and source has to process
+    // each block right before this one. Hops the source did not analyse (e.g. while frozen) read as silence.
+    // The own sliding CQT then runs outputBlock every hop without ever seeing inputBlock. That relies on outputBlock
+    // reading only the octave buffers synthesis pushes to and the inverse's own state, nothing inputBlock sets.
+    // rt-cqt does not promise this, so it has to be checked again whenever the submodule is updated.
+    void setAnalysisSource(const CqtReverb *const source) { mAnalysisSource = source; };
+
+    // Envelopes of every hop for the waterfall display, skipped while the display is disabled
+    void setSpectralHistory(SpectralHistory<B, OctaveNumber> *const history) { mSpectralHistory = history; };
+
+    // Analysed hops are passed to the recorder while it is recording, tagged with channel
+    void setRecorder(EnvelopeRecorder<B, OctaveNumber> *const recorder, const unsigned channel)
+    {
+        mRecorder = recorder;
+        mRecorderChannel = channel;
+    };
 
 private:
     static constexpr double mOneDivB{1. / static_cast<double>(B)};
+    static constexpr uint32_t StateMagic{0x4b435248u}; // "HRCK"
+    static constexpr uint32_t StateVersion{7u};
+
+    // Features of one hop, kept for the engines sharing this analysis
+    struct AnalysisFrame
+    {
+        uint64_t hop;
+        double values[OctaveNumber][B];
+        size_t samplesToProcess[OctaveNumber];
+    };
+
+    void writeStateHeader(StateWriter &writer, const uint64_t outputCount, const uint64_t frameCount) const;
+    void writeStateBody(StateWriter &writer, const uint64_t outputCount, const uint64_t frameCount);
+    uint64_t countAnalysisFrames() const;
+
+    void processHop();
+    void processFrozenHop();
+    void analyseHop();
+    void readSharedAnalysis();
+    void selectPartials();
+    void applyOctaveWindow();
+    void applyPitchClassMask();
+    void updateControlSchedule();
+    void synthesizeOctave(const unsigned octave);
+    void prefillOutput();
+
+    template <typename SampleType>
+    void processBlockNative(const SampleType *const input, SampleType *const output, const int nSamples, const double *const gain, const double *const wet, const double *const dry);
+    template <typename SampleType>
+    void processBlockResampled(const SampleType *const input, SampleType *const output, const int nSamples, const double *const gain, const double *const wet, const double *const dry);
+    template <typename SampleType>
+    static void gatherInput(const SampleType *const input, double *const hopInput, const int nSamples, const double *const gain);
+    template <typename SampleType>
+    static void mixOutput(const SampleType *const input, SampleType *const output, const double *const engineOutput, const int nSamples, const double *const wet, const double *const dry);
 
     // Processing classes and buffers
     Cqt::SlidingCqt<B, OctaveNumber, false> mCqt;
+    const EngineKernels *mKernels{nullptr};
 
-    audio_utils::CircularBuffer<double> mInputBuffer;
-    audio_utils::CircularBuffer<double> mOutputBuffer;
+    // Hop-aligned I/O, latency is one hop
     std::vector<double> mInputData;
+    std::vector<double> mSilentHop;
+    const double *mHopOutput{nullptr};
+    std::vector<double> mRestoredHop; // hop output of a restored checkpoint
+    int mHopPosition{0};
+    int mMaxBlockSize{0};
+
+    // Internal rate mode
+    audio_utils::CircularBuffer<double> mOutputBuffer;
     std::vector<double> mOutputData;
-    size_t mInputDataCounter;
     size_t mOutputDataCounter;
+    size_t mOutputCapacity{0u};
+    int mOutputLatency{0}; // zeros the FIFO starts with, see prefillOutput
+
+    bool mResampling{false};
+    double mHostSampleRate{48000.};
+    double mEngineSampleRate{48000.};
+    PolyphaseResampler mDownsampler;
+    PolyphaseResampler mUpsampler;
+    std::vector<double> mResampleBuffer;
+    std::vector<double> mUpsampleBuffer;
 
-    // SmoothedFloatUpDown<double, SmoothingTypes::Linear> mSmoothedFloats[OctaveNumber][B];
-    audio_utils::OnePoleUpDown<double> mSmoothedFloats[OctaveNumber][B];
+    // One envelope follower per bin, coefficients per octave
+    EnvelopeBank<B, OctaveNumber> mEnvelopes;
 
+    std::complex<double> mCqtFrame[OctaveNumber][B];
     double mCqtValues[OctaveNumber][B];
-    std::vector<double> mModulationData[OctaveNumber][B];
+    std::vector<double> mModulationData[OctaveNumber]; // [sample][tone]
     std::vector<double> mPhaseData[OctaveNumber][B];
 
-    audio_utils::StaticCplxWavetable<WavetableSize> mStaticWavetable;
-    audio_utils::CplxWavetableOscillator<WavetableSize> mOscillators[OctaveNumber][B];
+    std::shared_ptr<typename OscillatorPolicy::Shared> mOscillatorResource;
+    typename OscillatorPolicy::Oscillator mOscillators[OctaveNumber][B];
     std::vector<std::complex<double>> mOscillatorBuffer[OctaveNumber][B];
     std::vector<std::complex<double>> mSynthBuffer[OctaveNumber][B];
+    bool mSynthSilent[OctaveNumber][B]; // synth buffer is all zeros and can be pushed as is
 
     double mGainSum[OctaveNumber][B];
     double mGainSumShifted[OctaveNumber][B];
     double mGainSumMixed[OctaveNumber][B];
     double mGainsIllustration[OctaveNumber][B];
 
-    audio_utils::SmoothedFloat<double> mBaseOctaveTracker;
+    // One-pole follower of the loudest octave, advanced once per hop
+    double mBaseOctave{0.};
+    double mBaseOctaveTarget{0.};
+    double mBaseOctaveCoefficient{0.};
 
     // Thresholding
     double mOctaveMean[OctaveNumber];
@@ -81,6 +231,59 @@ private:
     double mOctaveMix{0.3};
     double mColour{1.};
     double mSparsity{1.};
+    bool mFreeze{false};
+
+    // Quality reduction under CPU pressure
+    unsigned mQualityTier{QualityFull};
+    double mPartialFloor{0.};
+
+    // Shared analysis, a ring of the last hops as one host block can complete several
+    std::vector<AnalysisFrame> mAnalysisFrames;
+    const CqtReverb *mAnalysisSource{nullptr};
+    uint64_t mHopCount{0u};
+    size_t mSamplesToProcess[OctaveNumber];
+
+    SpectralHistory<B, OctaveNumber> *mSpectralHistory{nullptr};
+    EnvelopeRecorder<B, OctaveNumber> *mRecorder{nullptr};
+    unsigned mRecorderChannel{0u};
+
+    // Offline rendering
+    RealtimeWorkerPool *mOctavePool{nullptr};
+    bool mDisplayEnabled{true};
+
+    // Active octave window, requested by the setter and applied at the start of a hop. Octaves that left it are
+    // still synthesized for one hop while they ramp out.
+    unsigned mFirstOctave{0u};
+    unsigned mLastOctave{OctaveNumber - 1u};
+    unsigned mRequestedFirstOctave{0u};
+    unsigned mRequestedLastOctave{OctaveNumber - 1u};
+    bool mOctaveFading[OctaveNumber]{};
+
+    // Pitch-class mask, bins are mapped again when the mask or the tuning changes
+    uint32_t mPitchClassMask{AllPitchClasses};
+    uint32_t mAppliedPitchClassMask{AllPitchClasses};
+    double mMaskTuning{0.};
+    bool mBinMasked[OctaveNumber][B]{};
+
+    // Control decimation, features and gains of octaves that are not due are held
+    unsigned mControlInterval[OctaveNumber];
+    bool mControlDue[OctaveNumber];
+
+    // After reset, octaves read as silent until hop mSettleUntil, one analysis window of their narrowest bin
+    unsigned mSettleHops[OctaveNumber]{};
+    uint64_t mSettleUntil[OctaveNumber]{};
+
+    // Max partials: strongest bins of the current hop. Bins entering or leaving the selection ramp over one hop,
+    // from the selection gain they were synthesized with in the previous one.
+    unsigned mMaxPartials{0u};
+    bool mPartialActive[OctaveNumber][B];
+    double mPartialGain[OctaveNumber][B];
+    double mPartialScores[OctaveNumber * B];
+    unsigned mPartialOrder[OctaveNumber * B];
+
+    // Freeze: envelopes held at the moment freeze got engaged
+    bool mFrozen{false};
+    double mFrozenGains[OctaveNumber][B];
 
     // Octave shift
     int mLowerOctaveShift{0};
@@ -89,317 +292,859 @@ private:
     double mHigherShiftFrac{0.};
 };
 
-template <unsigned B, unsigned OctaveNumber>
-inline void CqtReverb<B, OctaveNumber>::init(const double samplerate, const int nSamples)
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::init(const double samplerate, const int nSamples, const double internalRate)
 {
-    mCqt.init(samplerate, BlockSize);
+    // resampling, falls back to the host rate for ratios the resampler does not support
+    mResampling = internalRate > 0. && std::abs(internalRate - samplerate) > 0.5;
+    mResampling = mResampling && mDownsampler.init(samplerate, internalRate) && mUpsampler.init(internalRate, samplerate);
+    mHostSampleRate = samplerate;
+    mEngineSampleRate = mResampling ? internalRate : samplerate;
+    mMaxBlockSize = std::max(nSamples, 1);
+    const int nSamplesEngine = mResampling ? mDownsampler.getMaxOutputSamples(mMaxBlockSize) : 0;
+    const int nSamplesHopOut = mResampling ? mUpsampler.getMaxOutputSamples(BlockSize) : 0;
+    mResampleBuffer.resize(nSamplesEngine, 0.);
+    mUpsampleBuffer.resize(nSamplesHopOut, 0.);
+
+    if (mOscillatorResource == nullptr)
+        mOscillatorResource = getSharedOscillatorResource<typename OscillatorPolicy::Shared>();
+    mKernels = &getEngineKernels();
+
+    mCqt.init(mEngineSampleRate, BlockSize);
+    mCqt.setConcertPitch(mTuning);
 
     // buffers
-    mInputBuffer.changeSize(nSamples + BlockSize);
-    mOutputBuffer.changeSize(nSamples + BlockSize);
     mInputData.resize(BlockSize, 0.);
-    mOutputData.resize(nSamples, 0.);
-    mInputDataCounter = 0u;
-    mOutputDataCounter = 0u;
+    mSilentHop.assign(BlockSize, 0.);
+    mRestoredHop.resize(BlockSize, 0.);
+    mHopOutput = mSilentHop.data();
+    mHopPosition = 0;
+    mHopCount = 0u;
+    const int nHopSamplesMax = mResampling ? nSamplesEngine : mMaxBlockSize;
+    mAnalysisFrames.assign(static_cast<size_t>(nHopSamplesMax / BlockSize + 2), AnalysisFrame{});
+    for (AnalysisFrame &frame : mAnalysisFrames)
+        frame.hop = std::numeric_limits<uint64_t>::max(); // nothing published yet
+    std::fill(&mPartialActive[0][0], &mPartialActive[0][0] + OctaveNumber * B, true);
+    std::fill(&mPartialGain[0][0], &mPartialGain[0][0] + OctaveNumber * B, 1.);
+    std::fill(&mGainsIllustration[0][0], &mGainsIllustration[0][0] + OctaveNumber * B, 0.);
+    std::fill(&mCqtValues[0][0], &mCqtValues[0][0] + OctaveNumber * B, 0.);
+    std::fill(&mGainSum[0][0], &mGainSum[0][0] + OctaveNumber * B, 0.);
+    std::fill(&mGainSumMixed[0][0], &mGainSumMixed[0][0] + OctaveNumber * B, 0.);
+    // Output FIFO at the host rate. Before a chunk it can still hold the latency, one chunk and one hop of output,
+    // and the chunk itself completes up to nSamplesEngine / BlockSize + 1 hops. Block sizes that are not a multiple
+    // of the hop need the extra hop, a FIFO of one chunk and one hop overflows with them.
+    mOutputLatency = mResampling ? nSamplesHopOut + 1 : 0;
+    mOutputCapacity = mResampling ? static_cast<size_t>(mOutputLatency + mMaxBlockSize + (nSamplesEngine / BlockSize + 2) * nSamplesHopOut) : 0u;
+    mOutputData.resize(mResampling ? mMaxBlockSize : 0, 0.);
+    if (mResampling)
+    {
+        mOutputBuffer.changeSize(mOutputCapacity);
+        prefillOutput();
+    }
+    else
+    {
+        mOutputDataCounter = 0u;
+    }
 
     // smoothed values
+    double octaveRates[OctaveNumber];
+    for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+    {
+        octaveRates[i_octave] = mCqt.getOctaveSampleRate(i_octave);
+    }
+    mEnvelopes.init(octaveRates);
+    mEnvelopes.setSmoothingFactors(mAttack, mDecay);
+
     for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
     {
-        const double octaveRate = mCqt.getOctaveSampleRate(i_octave);
+        const double octaveRate = octaveRates[i_octave];
         const int octaveSize = mCqt.getOctaveBlockSize(i_octave);
         const double *const binFreqs = mCqt.getOctaveBinFreqs(i_octave);
+        mModulationData[i_octave].resize(octaveSize * B, 0.);
         for (unsigned i_tone = 0u; i_tone < B; i_tone++)
         {
-            mSmoothedFloats[i_octave][i_tone].init(octaveRate);
-            mSmoothedFloats[i_octave][i_tone].setSmoothingFactors(mAttack, mDecay);
-
-            mOscillators[i_octave][i_tone].init(octaveRate, &mStaticWavetable);
+            mOscillators[i_octave][i_tone].init(octaveRate, mOscillatorResource.get());
             mOscillators[i_octave][i_tone].setFrequency(binFreqs[i_tone]);
             mOscillatorBuffer[i_octave][i_tone].resize(octaveSize, {0., 0.});
             mSynthBuffer[i_octave][i_tone].resize(octaveSize, {0., 0.});
-
-            mModulationData[i_octave][i_tone].resize(octaveSize, 0.);
+            mSynthSilent[i_octave][i_tone] = false;
         }
     }
-    const double blockRate = static_cast<double>(BlockSize) / samplerate;
-    mBaseOctaveTracker.init(blockRate);
-    mBaseOctaveTracker.setSmoothingTime(1000.);
+    mMaskTuning = 0.; // bin frequencies may have moved with the rate
+
+    const double hopDuration = static_cast<double>(BlockSize) / mEngineSampleRate;
+    for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+    {
+        const double *const binFreqs = mCqt.getOctaveBinFreqs(i_octave);
+        const double bandwidth = *std::min_element(binFreqs, binFreqs + B) * (std::pow(2., mOneDivB) - 1.);
+        const double hopsPerUpdate = 1. / (ControlOversampling * bandwidth * hopDuration);
+        mControlInterval[i_octave] = 1u;
+        while (mControlInterval[i_octave] < MaxControlInterval && 2. * mControlInterval[i_octave] <= hopsPerUpdate)
+            mControlInterval[i_octave] *= 2u;
+        mSettleHops[i_octave] = static_cast<unsigned>(std::ceil(ControlOversampling * hopsPerUpdate));
+        mSettleUntil[i_octave] = 0u;
+    }
+    mBaseOctaveCoefficient = 1. - std::exp(-hopDuration / BaseOctaveSmoothingTime);
 }
 
-template <unsigned B, unsigned OctaveNumber>
-inline void CqtReverb<B, OctaveNumber>::processBlock(double *const data, const int nSamples)
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::reset()
 {
-    mInputBuffer.pushBlock(data, nSamples);
-    mInputDataCounter += nSamples;
-    while (mInputDataCounter >= BlockSize)
+    mEnvelopes.reset();
+    std::fill(&mCqtValues[0][0], &mCqtValues[0][0] + OctaveNumber * B, 0.);
+    std::fill(&mGainSum[0][0], &mGainSum[0][0] + OctaveNumber * B, 0.);
+    std::fill(&mGainSumMixed[0][0], &mGainSumMixed[0][0] + OctaveNumber * B, 0.);
+    std::fill(&mGainsIllustration[0][0], &mGainsIllustration[0][0] + OctaveNumber * B, 0.);
+    std::fill(mInputData.begin(), mInputData.end(), 0.);
+    mHopOutput = mSilentHop.data();
+    mHopPosition = 0;
+    mFrozen = false;
+    if (mResampling)
+    {
+        mDownsampler.reset();
+        mUpsampler.reset();
+        prefillOutput();
+    }
+    for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
     {
-        mInputBuffer.pullDelayBlock(mInputData.data(), mInputDataCounter - 1, BlockSize);
-        mInputDataCounter -= BlockSize;
-        mCqt.inputBlock(mInputData.data(), BlockSize);
+        mSettleUntil[i_octave] = mHopCount + mSettleHops[i_octave];
+    }
+}
 
-        for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+template <typename SampleType>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::processBlock(const SampleType *const input, SampleType *const output, const int nSamples, const double *const gain, const double *const wet, const double *const dry)
+{
+    if (mResampling)
+        processBlockResampled(input, output, nSamples, gain, wet, dry);
+    else
+        processBlockNative(input, output, nSamples, gain, wet, dry);
+
+    // Spectral display
+    if (!mDisplayEnabled)
+        return;
+    for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+    {
+        for (unsigned i_tone = 0u; i_tone < B; i_tone++)
         {
-            CircularBuffer<std::complex<double>> *octaveCqtBuffer = mCqt.getOctaveCqtBuffer(i_octave);
+            mGainsIllustration[i_octave][i_tone] = mEnvelopes.getCurrentValue(i_octave, i_tone);
+        }
+    }
+}
 
-            // acquire cqt values for feature calculations
-            for (unsigned i_tone = 0u; i_tone < B; i_tone++)
-            {
-                mCqtValues[i_octave][i_tone] = std::abs(octaveCqtBuffer[i_tone].pullDelaySample(0));
-            }
+// The hop block is filled straight from the host buffer while the previous hop's output is read in place
+// from the inverse transform, so the only copy is the conversion into the engine's input block.
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+template <typename SampleType>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::processBlockNative(const SampleType *const input, SampleType *const output, const int nSamples, const double *const gain, const double *const wet, const double *const dry)
+{
+    int i_sample = 0;
+    while (i_sample < nSamples)
+    {
+        const int nSegment = std::min(nSamples - i_sample, BlockSize - mHopPosition);
+        gatherInput(input + i_sample, mInputData.data() + mHopPosition, nSegment, gain == nullptr ? nullptr : gain + i_sample);
+        mixOutput(input + i_sample, output + i_sample, mHopOutput + mHopPosition, nSegment,
+                  wet == nullptr ? nullptr : wet + i_sample, dry == nullptr ? nullptr : dry + i_sample);
+        mHopPosition += nSegment;
+        i_sample += nSegment;
+        if (mHopPosition == BlockSize)
+        {
+            processHop();
+            mHopPosition = 0;
         }
-        for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+    }
+}
+
+// The FIFO starts with the output of up to a whole hop missing: samples of a partial hop sit in the engine until it
+// completes, and both resamplers round their output counts. Starting it with one resampled hop and one sample of
+// zeros covers that for any host block size, so the output is the resampled engine output delayed by
+// mOutputLatency, in every block from the first one on. Without it a host block could find the FIFO short and get
+// silence, which depends on the block size and repeats after every reset.
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::prefillOutput()
+{
+    for (int i_sample = 0; i_sample < mOutputLatency; i_sample += BlockSize)
+        mOutputBuffer.pushBlock(mSilentHop.data(), std::min(BlockSize, mOutputLatency - i_sample));
+    mOutputDataCounter = static_cast<size_t>(mOutputLatency);
+}
+
+// Hops do not line up with host blocks after resampling, so output goes through a FIFO at the host rate
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+template <typename SampleType>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::processBlockResampled(const SampleType *const input, SampleType *const output, const int nSamples, const double *const gain, const double *const wet, const double *const dry)
+{
+    for (int i_chunk = 0; i_chunk < nSamples; i_chunk += mMaxBlockSize)
+    {
+        const int nChunk = std::min(mMaxBlockSize, nSamples - i_chunk);
+        gatherInput(input + i_chunk, mOutputData.data(), nChunk, gain == nullptr ? nullptr : gain + i_chunk);
+        const int nSamplesEngine = mDownsampler.process(mOutputData.data(), nChunk, mResampleBuffer.data());
+
+        int i_sample = 0;
+        while (i_sample < nSamplesEngine)
         {
-            for (unsigned i_tone = 0u; i_tone < B; i_tone++)
+            const int nSegment = std::min(nSamplesEngine - i_sample, BlockSize - mHopPosition);
+            std::copy(mResampleBuffer.data() + i_sample, mResampleBuffer.data() + i_sample + nSegment, mInputData.data() + mHopPosition);
+            mHopPosition += nSegment;
+            i_sample += nSegment;
+            if (mHopPosition == BlockSize)
             {
-                mGainSum[i_octave][i_tone] = 0.;
-                mGainSumShifted[i_octave][i_tone] = 0.;
-                mGainSumMixed[i_octave][i_tone] = 0.;
-                mGainsIllustration[i_octave][i_tone] = 0.;
+                processHop();
+                mHopPosition = 0;
+                const int nSamplesOut = mUpsampler.process(mHopOutput, BlockSize, mUpsampleBuffer.data());
+                mOutputBuffer.pushBlock(mUpsampleBuffer.data(), nSamplesOut);
+                mOutputDataCounter += nSamplesOut;
             }
         }
 
-        // Determine current base (max) octave
-        double maxOctaveValue = 0.;
-        unsigned maxOctave = 0;
-        for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+        if (mOutputDataCounter >= static_cast<size_t>(nChunk))
         {
-            double octaveSum = 0.;
-            for (unsigned i_tone = 0u; i_tone < B; i_tone++)
-            {
-                octaveSum += mSmoothedFloats[i_octave][i_tone].getCurrentValue();
-            }
-            if (octaveSum > maxOctaveValue)
-            {
-                maxOctaveValue = octaveSum;
-                maxOctave = i_octave;
-            }
+            // oldest samples first
+            mOutputBuffer.pullDelayBlock(mOutputData.data(), mOutputDataCounter - 1, nChunk);
+            mOutputDataCounter -= nChunk;
         }
-        mBaseOctaveTracker.setTargetValue(static_cast<double>(maxOctave));
+        else
+        {
+            // not reached with the prefill, only a blob restored with less pending output could get here
+            std::fill(mOutputData.begin(), mOutputData.begin() + nChunk, 0.);
+        }
+        mixOutput(input + i_chunk, output + i_chunk, mOutputData.data(), nChunk,
+                  wet == nullptr ? nullptr : wet + i_chunk, dry == nullptr ? nullptr : dry + i_chunk);
+    }
+}
 
-        // Parameters for thresholding
-        double globalMax = 0.;
-        double globalMaxCurrent = 0.;
-        for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+template <typename SampleType>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::gatherInput(const SampleType *const input, double *const hopInput, const int nSamples, const double *const gain)
+{
+    if (gain == nullptr)
+    {
+        for (int i_sample = 0; i_sample < nSamples; i_sample++)
+            hopInput[i_sample] = static_cast<double>(input[i_sample]);
+    }
+    else
+    {
+        for (int i_sample = 0; i_sample < nSamples; i_sample++)
+            hopInput[i_sample] = static_cast<double>(input[i_sample]) * gain[i_sample];
+    }
+}
+
+// input and output may alias, every input sample is read before its output sample is written
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+template <typename SampleType>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::mixOutput(const SampleType *const input, SampleType *const output, const double *const engineOutput, const int nSamples, const double *const wet, const double *const dry)
+{
+    if (wet == nullptr)
+    {
+        for (int i_sample = 0; i_sample < nSamples; i_sample++)
+            output[i_sample] = static_cast<SampleType>(engineOutput[i_sample]);
+    }
+    else if (dry == nullptr)
+    {
+        for (int i_sample = 0; i_sample < nSamples; i_sample++)
+            output[i_sample] = static_cast<SampleType>(wet[i_sample] * engineOutput[i_sample]);
+    }
+    else
+    {
+        for (int i_sample = 0; i_sample < nSamples; i_sample++)
+            output[i_sample] = static_cast<SampleType>(wet[i_sample] * engineOutput[i_sample] + dry[i_sample] * static_cast<double>(input[i_sample]));
+    }
+}
+
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::processHop()
+{
+    ScopedTrace hopTrace("hop");
+    if (mFreeze)
+    {
+        // Input is discarded, only synthesis and the inverse transform run
+        processFrozenHop();
+        traceBegin("inverse");
+        mHopOutput = mCqt.outputBlock(BlockSize);
+        traceEnd("inverse");
+        if (mSpectralHistory != nullptr && mDisplayEnabled)
+            mSpectralHistory->push(mEnvelopes.getCurrentValues(0u));
+        mHopCount++;
+        return;
+    }
+    mFrozen = false;
+
+    applyOctaveWindow();
+    applyPitchClassMask();
+    updateControlSchedule();
+    traceBegin("analysis");
+    if (mAnalysisSource != nullptr)
+        readSharedAnalysis();
+    else
+        analyseHop();
+    for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+    {
+        if (mHopCount < mSettleUntil[i_octave])
+            std::fill(mCqtValues[i_octave], mCqtValues[i_octave] + B, 0.);
+    }
+    traceEnd("analysis");
+    traceBegin("features");
+    for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+    {
+        if (!mControlDue[i_octave])
+            continue;
+        for (unsigned i_tone = 0u; i_tone < B; i_tone++)
         {
-            for (unsigned i_tone = 0u; i_tone < B; i_tone++)
-            {
-                if (mCqtValues[i_octave][i_tone] > globalMax)
-                    globalMax = mCqtValues[i_octave][i_tone];
-                if (mSmoothedFloats[i_octave][i_tone].getCurrentValue() > globalMaxCurrent)
-                    globalMaxCurrent = mSmoothedFloats[i_octave][i_tone].getCurrentValue();
-            }
+            mGainSum[i_octave][i_tone] = 0.;
+            mGainSumShifted[i_octave][i_tone] = 0.;
+            mGainSumMixed[i_octave][i_tone] = 0.;
         }
-        for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+    }
+
+    // Determine current base (max) octave
+    double maxOctaveValue = 0.;
+    unsigned maxOctave = mFirstOctave;
+    for (unsigned i_octave = mFirstOctave; i_octave <= mLastOctave; i_octave++)
+    {
+        double octaveSum = 0.;
+        for (unsigned i_tone = 0u; i_tone < B; i_tone++)
         {
-            for (unsigned i_tone = 0u; i_tone < B; i_tone++)
-            {
-                mOctaveMean[i_octave] += mCqtValues[i_octave][i_tone];
-                mOctaveMeanCurrent[i_octave] += mSmoothedFloats[i_octave][i_tone].getCurrentValue();
-            }
-            mOctaveMean[i_octave] *= mOneDivB;
-            mOctaveMeanCurrent[i_octave] *= mOneDivB;
+            octaveSum += mEnvelopes.getCurrentValue(i_octave, i_tone);
         }
-        for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+        if (octaveSum > maxOctaveValue)
         {
-            mOctaveMax[i_octave] = 0.;
-            mOctaveMaxCurrent[i_octave] = 0.;
-            for (unsigned i_tone = 0u; i_tone < B; i_tone++)
-            {
-                if (mCqtValues[i_octave][i_tone] > mOctaveMax[i_octave])
-                    mOctaveMax[i_octave] = mCqtValues[i_octave][i_tone];
-                if (mSmoothedFloats[i_octave][i_tone].getCurrentValue() > mOctaveMaxCurrent[i_octave])
-                    mOctaveMaxCurrent[i_octave] = mSmoothedFloats[i_octave][i_tone].getCurrentValue();
-            }
+            maxOctaveValue = octaveSum;
+            maxOctave = i_octave;
         }
+    }
+    mBaseOctaveTarget = static_cast<double>(maxOctave);
+    mBaseOctave += mBaseOctaveCoefficient * (mBaseOctaveTarget - mBaseOctave);
 
-        // Thresholding and summation of gains
-        for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+    // Parameters for thresholding, the global maxima include the held values of octaves that are not due
+    double globalMax = 0.;
+    double globalMaxCurrent = 0.;
+    for (unsigned i_octave = mFirstOctave; i_octave <= mLastOctave; i_octave++)
+    {
+        for (unsigned i_tone = 0u; i_tone < B; i_tone++)
         {
-            const double threshold = mOctaveMax[i_octave] * MaxToneThresholdFactor * mSparsity;
-            const double globalMaxThreshold = globalMax * GlobalMaxThresholdFactor * mSparsity;
-            const double octaveMeanTreshold = mOctaveMean[i_octave] * OctaveMeanThresholdFactor * mSparsity;
+            if (mCqtValues[i_octave][i_tone] > globalMax)
+                globalMax = mCqtValues[i_octave][i_tone];
+            if (mEnvelopes.getCurrentValue(i_octave, i_tone) > globalMaxCurrent)
+                globalMaxCurrent = mEnvelopes.getCurrentValue(i_octave, i_tone);
+        }
+    }
+    for (unsigned i_octave = mFirstOctave; i_octave <= mLastOctave; i_octave++)
+    {
+        if (!mControlDue[i_octave])
+            continue;
+        for (unsigned i_tone = 0u; i_tone < B; i_tone++)
+        {
+            mOctaveMean[i_octave] += mCqtValues[i_octave][i_tone];
+            mOctaveMeanCurrent[i_octave] += mEnvelopes.getCurrentValue(i_octave, i_tone);
+        }
+        mOctaveMean[i_octave] *= mOneDivB;
+        mOctaveMeanCurrent[i_octave] *= mOneDivB;
+    }
+    for (unsigned i_octave = mFirstOctave; i_octave <= mLastOctave; i_octave++)
+    {
+        if (!mControlDue[i_octave])
+            continue;
+        mOctaveMax[i_octave] = 0.;
+        mOctaveMaxCurrent[i_octave] = 0.;
+        for (unsigned i_tone = 0u; i_tone < B; i_tone++)
+        {
+            if (mCqtValues[i_octave][i_tone] > mOctaveMax[i_octave])
+                mOctaveMax[i_octave] = mCqtValues[i_octave][i_tone];
+            if (mEnvelopes.getCurrentValue(i_octave, i_tone) > mOctaveMaxCurrent[i_octave])
+                mOctaveMaxCurrent[i_octave] = mEnvelopes.getCurrentValue(i_octave, i_tone);
+        }
+    }
 
-            const double thresholdCurrent = mOctaveMaxCurrent[i_octave] * MaxToneThresholdFactor * mSparsity;
-            const double globalMaxThresholdCurrent = globalMaxCurrent * GlobalMaxThresholdFactor * mSparsity;
-            const double octaveMeanTresholdCurrent = mOctaveMeanCurrent[i_octave] * OctaveMeanThresholdFactor * mSparsity;
+    // Thresholding and summation of gains
+    for (unsigned i_octave = mFirstOctave; i_octave <= mLastOctave; i_octave++)
+    {
+        if (!mControlDue[i_octave])
+            continue;
+        const double threshold = mOctaveMax[i_octave] * MaxToneThresholdFactor * mSparsity;
+        const double globalMaxThreshold = globalMax * GlobalMaxThresholdFactor * mSparsity;
+        const double octaveMeanTreshold = mOctaveMean[i_octave] * OctaveMeanThresholdFactor * mSparsity;
 
-            for (unsigned i_tone = 0u; i_tone < B; i_tone++)
-            {
-                if (
-                    mCqtValues[i_octave][i_tone] > threshold &&
-                    mCqtValues[i_octave][i_tone] > globalMaxThreshold &&
-                    mCqtValues[i_octave][i_tone] > octaveMeanTreshold &&
-                    mCqtValues[i_octave][i_tone] > thresholdCurrent &&
-                    mCqtValues[i_octave][i_tone] > globalMaxThresholdCurrent &&
-                    mCqtValues[i_octave][i_tone] > octaveMeanTresholdCurrent)
-                {
-                    mGainSum[i_octave][i_tone] += mCqtValues[i_octave][i_tone];
-                }
-            }
+        const double thresholdCurrent = mOctaveMaxCurrent[i_octave] * MaxToneThresholdFactor * mSparsity;
+        const double globalMaxThresholdCurrent = globalMaxCurrent * GlobalMaxThresholdFactor * mSparsity;
+        const double octaveMeanTresholdCurrent = mOctaveMeanCurrent[i_octave] * OctaveMeanThresholdFactor * mSparsity;
+
+        // a bin has to pass all thresholds, i.e. the largest one
+        const double combinedThreshold = std::max({threshold, globalMaxThreshold, octaveMeanTreshold,
+                                                   thresholdCurrent, globalMaxThresholdCurrent, octaveMeanTresholdCurrent});
+        mKernels->thresholdGains(mCqtValues[i_octave], mGainSum[i_octave], B, combinedThreshold);
+    }
+
+    // Octave shift and mixing, due octaves take the held gains of their neighbours
+    for (int i_octave = 0; i_octave < OctaveNumber; i_octave++)
+    {
+        if (!mControlDue[i_octave])
+            continue;
+        for (int i_tone = 0; i_tone < B; i_tone++)
+        {
+            mGainSumShifted[i_octave][i_tone] = 0.;
         }
+    }
+    for (int i_octave = 0; i_octave < OctaveNumber; i_octave++)
+    {
+        if (!mControlDue[i_octave])
+            continue;
+        for (int i_tone = 0; i_tone < B; i_tone++)
+        {
+            const int shiftOctaveLow = Cqt::Clip<int>(i_octave + mLowerOctaveShift, 0, OctaveNumber - 1);
+            const int shiftOctaveHigh = Cqt::Clip<int>(i_octave + mHigherOctaveShift, 0, OctaveNumber - 1);
+            mGainSumShifted[i_octave][i_tone] += mGainSum[shiftOctaveLow][i_tone] * mLowerShiftFrac;
+            mGainSumShifted[i_octave][i_tone] += mGainSum[shiftOctaveHigh][i_tone] * mHigherShiftFrac;
+        }
+    }
+    for (int i_octave = 0; i_octave < OctaveNumber; i_octave++)
+    {
+        if (!mControlDue[i_octave])
+            continue;
+        for (int i_tone = 0; i_tone < B; i_tone++)
+        {
+            mGainSumMixed[i_octave][i_tone] = mGainSum[i_octave][i_tone] * (1. - mOctaveMix) + mGainSumShifted[i_octave][i_tone] * mOctaveMix;
+        }
+    }
 
-        // Octave shift and mixing
-        for (int i_octave = 0; i_octave < OctaveNumber; i_octave++)
+    // Apply color parameter equalization
+    for (int i_octave = 0; i_octave < OctaveNumber; i_octave++)
+    {
+        if (!mControlDue[i_octave])
+            continue;
+        const double baseOctave = mBaseOctave;
+        const double octaveDouble = static_cast<double>(i_octave);
+        const double octaveNumberDouble = static_cast<double>(OctaveNumber);
+        double octaveFactor = 1.0;
+        if (octaveDouble < baseOctave) // Smaller octaves are the higher ones
         {
-            for (int i_tone = 0; i_tone < B; i_tone++)
+            if (mColour > 0.)
             {
-                mGainSumShifted[i_octave][i_tone] = 0.;
+                octaveFactor = 1.0 + std::abs(octaveDouble - baseOctave) / OctaveNumber * std::abs(mColour);
             }
-        }
-        for (int i_octave = 0; i_octave < OctaveNumber; i_octave++)
-        {
-            for (int i_tone = 0; i_tone < B; i_tone++)
+            else
             {
-                const int shiftOctaveLow = Cqt::Clip<int>(i_octave + mLowerOctaveShift, 0, OctaveNumber - 1);
-                const int shiftOctaveHigh = Cqt::Clip<int>(i_octave + mHigherOctaveShift, 0, OctaveNumber - 1);
-                mGainSumShifted[i_octave][i_tone] += mGainSum[shiftOctaveLow][i_tone] * mLowerShiftFrac;
-                mGainSumShifted[i_octave][i_tone] += mGainSum[shiftOctaveHigh][i_tone] * mHigherShiftFrac;
+                octaveFactor = 1.0 - std::abs(octaveDouble - baseOctave) / OctaveNumber * std::abs(mColour);
             }
         }
-        for (int i_octave = 0; i_octave < OctaveNumber; i_octave++)
+        else
         {
-            for (int i_tone = 0; i_tone < B; i_tone++)
+            if (mColour > 0.)
+            {
+                octaveFactor = 1.0 - std::abs(octaveDouble - baseOctave) / OctaveNumber * std::abs(mColour);
+            }
+            else
             {
-                mGainSumMixed[i_octave][i_tone] = mGainSum[i_octave][i_tone] * (1. - mOctaveMix) + mGainSumShifted[i_octave][i_tone] * mOctaveMix;
+                octaveFactor = 1.0 + std::abs(octaveDouble - baseOctave) / OctaveNumber * std::abs(mColour);
             }
         }
+        for (int i_tone = 0; i_tone < B; i_tone++)
+        {
+            mGainSumMixed[i_octave][i_tone] *= octaveFactor;
+        }
+    }
+
+    // Excluded octaves do not take shifted partials either
+    for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+    {
+        if (i_octave >= mFirstOctave && i_octave <= mLastOctave)
+            continue;
+        for (unsigned i_tone = 0u; i_tone < B; i_tone++)
+        {
+            mGainSumMixed[i_octave][i_tone] = 0.;
+        }
+    }
 
-        // Apply color parameter equalization
-        for (int i_octave = 0; i_octave < OctaveNumber; i_octave++)
+    // Masked pitches, after shifting so shifted partials are masked too
+    if (mAppliedPitchClassMask != AllPitchClasses)
+    {
+        for (unsigned i_octave = mFirstOctave; i_octave <= mLastOctave; i_octave++)
         {
-            const double baseOctave = mBaseOctaveTracker.getCurrentValue();
-            const double octaveDouble = static_cast<double>(i_octave);
-            const double octaveNumberDouble = static_cast<double>(OctaveNumber);
-            double octaveFactor = 1.0;
-            if (octaveDouble < baseOctave) // Smaller octaves are the higher ones
+            for (unsigned i_tone = 0u; i_tone < B; i_tone++)
             {
-                if (mColour > 0.)
-                {
-                    octaveFactor = 1.0 + std::abs(octaveDouble - baseOctave) / OctaveNumber * std::abs(mColour);
-                }
-                else
-                {
-                    octaveFactor = 1.0 - std::abs(octaveDouble - baseOctave) / OctaveNumber * std::abs(mColour);
-                }
+                if (mBinMasked[i_octave][i_tone])
+                    mGainSumMixed[i_octave][i_tone] = 0.;
             }
-            else
+        }
+    }
+
+    // Merged bins: in the lowest octaves each group of adjacent bins is synthesized by its loudest one, which takes
+    // the energy of the group. The loudest partial keeps its pitch, the others move by at most MergedBinGroup - 1
+    // bins and stay in their octave. The silent bins are then skipped as reduced partials. After masking, so the
+    // group never lands on a masked bin.
+    if (mQualityTier >= QualityMergedBins)
+    {
+        for (unsigned i_octave = std::max(mFirstOctave, OctaveNumber - std::min(MergedOctaveNumber, OctaveNumber)); i_octave <= mLastOctave; i_octave++)
+        {
+            if (!mControlDue[i_octave])
+                continue;
+            for (unsigned i_group = 0u; i_group < B; i_group += MergedBinGroup)
             {
-                if (mColour > 0.)
-                {
-                    octaveFactor = 1.0 - std::abs(octaveDouble - baseOctave) / OctaveNumber * std::abs(mColour);
-                }
-                else
+                const unsigned groupEnd = std::min(i_group + MergedBinGroup, B);
+                unsigned loudest = i_group;
+                double loudestGain = 0.;
+                double energy = 0.;
+                for (unsigned i_tone = i_group; i_tone < groupEnd; i_tone++)
                 {
-                    octaveFactor = 1.0 + std::abs(octaveDouble - baseOctave) / OctaveNumber * std::abs(mColour);
+                    const double gain = mGainSumMixed[i_octave][i_tone];
+                    energy += gain * gain;
+                    if (gain > loudestGain)
+                    {
+                        loudest = i_tone;
+                        loudestGain = gain;
+                    }
+                    mGainSumMixed[i_octave][i_tone] = 0.;
                 }
+                mGainSumMixed[i_octave][loudest] = std::sqrt(energy);
             }
-            for (int i_tone = 0; i_tone < B; i_tone++)
-            {
-                mGainSumMixed[i_octave][i_tone] *= octaveFactor;
-            }
         }
+    }
+
+    // Set smoother's target values, held ones included as partial selection may have cleared them
+    for (unsigned i_octave = mFirstOctave; i_octave <= mLastOctave; i_octave++)
+    {
+        for (unsigned i_tone = 0u; i_tone < B; i_tone++)
+        {
+            mEnvelopes.setTargetValue(i_octave, i_tone, mGainSumMixed[i_octave][i_tone]);
+        }
+    }
+    selectPartials();
 
-        // Set smoother's target values
+    // Reduced partials: bins whose envelope and target are both far below the loudest one are silent
+    mPartialFloor = 0.;
+    if (mQualityTier >= QualityReducedPartials)
+    {
         for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
         {
             for (unsigned i_tone = 0u; i_tone < B; i_tone++)
             {
-                mSmoothedFloats[i_octave][i_tone].setTargetValue(mGainSumMixed[i_octave][i_tone]);
+                mPartialFloor = std::max(mPartialFloor, std::max(mGainSumMixed[i_octave][i_tone], mEnvelopes.getCurrentValue(i_octave, i_tone)));
             }
         }
+        mPartialFloor *= PartialFloorFactor;
+    }
+    traceEnd("features");
 
-        // Process cqt data
+    // Process cqt data
+    traceBegin("synthesis");
+    if (mOctavePool != nullptr)
+    {
+        auto octaveTask = [this](const unsigned i_octave) { synthesizeOctave(i_octave); };
+        mOctavePool->parallelFor(OctaveNumber, octaveTask);
+    }
+    else
+    {
         for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
         {
-            const size_t nSamplesOctave = mCqt.getSamplesToProcess(i_octave);
-            CircularBuffer<std::complex<double>> *octaveCqtBuffer = mCqt.getOctaveCqtBuffer(i_octave);
+            synthesizeOctave(i_octave);
+        }
+    }
+    traceEnd("synthesis");
+    // output data, stays valid until the next hop
+    traceBegin("inverse");
+    mHopOutput = mCqt.outputBlock(BlockSize);
+    traceEnd("inverse");
+    // envelope rows are contiguous, octave 0 first
+    if (mSpectralHistory != nullptr && mDisplayEnabled)
+        mSpectralHistory->push(mEnvelopes.getCurrentValues(0u));
+    if (mRecorder != nullptr)
+        mRecorder->push(mRecorderChannel, mHopCount, mEnvelopes.getCurrentValues(0u), &mCqtValues[0][0]);
+    mHopCount++;
+}
 
-            // synthesis
-            // #pragma omp simd
-            for (unsigned i_tone = 0u; i_tone < B; i_tone++)
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::analyseHop()
+{
+    mCqt.inputBlock(mInputData.data(), BlockSize);
+
+    for (unsigned i_octave = mFirstOctave; i_octave <= mLastOctave; i_octave++)
+    {
+        if (!mControlDue[i_octave])
+            continue;
+        CircularBuffer<std::complex<double>> *octaveCqtBuffer = mCqt.getOctaveCqtBuffer(i_octave);
+
+        // acquire cqt values for feature calculations
+        for (unsigned i_tone = 0u; i_tone < B; i_tone++)
+        {
+            mCqtFrame[i_octave][i_tone] = octaveCqtBuffer[i_tone].pullDelaySample(0);
+        }
+        mKernels->magnitudes(mCqtFrame[i_octave], mCqtValues[i_octave], B);
+    }
+    // inactive rows stay zero, rows that are not due are held
+    for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+    {
+        mSamplesToProcess[i_octave] = mCqt.getSamplesToProcess(i_octave);
+    }
+
+    AnalysisFrame &frame = mAnalysisFrames[mHopCount % mAnalysisFrames.size()];
+    frame.hop = mHopCount;
+    std::copy(&mCqtValues[0][0], &mCqtValues[0][0] + OctaveNumber * B, &frame.values[0][0]);
+    std::copy(mSamplesToProcess, mSamplesToProcess + OctaveNumber, frame.samplesToProcess);
+}
+
+// The own transform only runs the inverse, its octave buffers are never written by analysis
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::readSharedAnalysis()
+{
+    const std::vector<AnalysisFrame> &frames = mAnalysisSource->mAnalysisFrames;
+    const AnalysisFrame *frame = frames.empty() ? nullptr : &frames[mHopCount % frames.size()];
+    if (frame != nullptr && frame->hop != mHopCount)
+        frame = nullptr;
+
+    for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+    {
+        mSamplesToProcess[i_octave] = frame != nullptr ? frame->samplesToProcess[i_octave] : static_cast<size_t>(mCqt.getOctaveBlockSize(i_octave));
+    }
+    for (unsigned i_octave = mFirstOctave; i_octave <= mLastOctave; i_octave++)
+    {
+        for (unsigned i_tone = 0u; i_tone < B; i_tone++)
+        {
+            mCqtValues[i_octave][i_tone] = frame != nullptr ? frame->values[i_octave][i_tone] : 0.;
+        }
+    }
+}
+
+// Only touches state of the given octave, so octaves can run concurrently
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::synthesizeOctave(const unsigned octave)
+{
+    ScopedTrace octaveTrace("octave", static_cast<int>(octave));
+    const size_t nSamplesOctave = mSamplesToProcess[octave];
+    CircularBuffer<std::complex<double>> *octaveCqtBuffer = mCqt.getOctaveCqtBuffer(octave);
+    const bool octaveFading = mOctaveFading[octave];
+    const bool octaveActive = (octave >= mFirstOctave && octave <= mLastOctave) || octaveFading;
+    bool synthesize[B];
+    for (unsigned i_tone = 0u; i_tone < B; i_tone++)
+    {
+        synthesize[i_tone] = octaveActive && (mPartialActive[octave][i_tone] || mPartialGain[octave][i_tone] > 0.) &&
+                             (mQualityTier < QualityReducedPartials ||
+                              std::max(mGainSumMixed[octave][i_tone], mEnvelopes.getCurrentValue(octave, i_tone)) > mPartialFloor) &&
+                             (!mBinMasked[octave][i_tone] || mEnvelopes.getCurrentValue(octave, i_tone) > 0.);
+    }
+
+    // synthesis, envelopes of excluded octaves are reset after their last hop and stay idle
+    if (octaveActive)
+        mEnvelopes.getNextBlock(octave, mModulationData[octave].data(), nSamplesOctave);
+    for (unsigned i_tone = 0u; i_tone < B; i_tone++)
+    {
+        if (synthesize[i_tone])
+            mOscillators[octave][i_tone].generateBlock(mOscillatorBuffer[octave][i_tone].data(), nSamplesOctave);
+    }
+    for (unsigned i_tone = 0u; i_tone < B; i_tone++)
+    {
+        if (!synthesize[i_tone])
+        {
+            // the analysis values still have to be replaced, silent bins keep pushing the same zeros. pullBlock is
+            // the only way back to the start of the hop in the buffer, the pulled samples are dropped. Engines on a
+            // shared analysis have nothing to replace and skip it.
+            if (mAnalysisSource == nullptr)
+                octaveCqtBuffer[i_tone].pullBlock(mOscillatorBuffer[octave][i_tone].data(), nSamplesOctave);
+            if (!mSynthSilent[octave][i_tone])
             {
-                mSmoothedFloats[i_octave][i_tone].getNextBlock(mModulationData[i_octave][i_tone].data(), nSamplesOctave);
-                mOscillators[i_octave][i_tone].generateBlock(mOscillatorBuffer[i_octave][i_tone].data(), nSamplesOctave);
+                std::fill(mSynthBuffer[octave][i_tone].begin(), mSynthBuffer[octave][i_tone].end(), std::complex<double>{0., 0.});
+                mSynthSilent[octave][i_tone] = true;
             }
-            for (unsigned i_tone = 0u; i_tone < B; i_tone++)
+            octaveCqtBuffer[i_tone].pushBlock(mSynthBuffer[octave][i_tone].data(), nSamplesOctave);
+            mPartialGain[octave][i_tone] = 0.;
+            continue;
+        }
+        // analysed buffers are replaced, with a shared analysis they are only pushed
+        if (mAnalysisSource == nullptr)
+            octaveCqtBuffer[i_tone].pullBlock(mSynthBuffer[octave][i_tone].data(), nSamplesOctave);
+        mKernels->modulate(mOscillatorBuffer[octave][i_tone].data(), mModulationData[octave].data() + i_tone, B,
+                           mSynthBuffer[octave][i_tone].data(), nSamplesOctave);
+        const double gainStart = mPartialGain[octave][i_tone];
+        const double gainEnd = mPartialActive[octave][i_tone] && !octaveFading ? 1. : 0.;
+        if (gainStart != gainEnd)
+        {
+            const double gainStep = (gainEnd - gainStart) / static_cast<double>(nSamplesOctave);
+            for (size_t i_sample = 0u; i_sample < nSamplesOctave; i_sample++)
             {
-                octaveCqtBuffer[i_tone].pullBlock(mSynthBuffer[i_octave][i_tone].data(), nSamplesOctave);
-                for (size_t i_sample = 0u; i_sample < nSamplesOctave; i_sample++)
-                {
-                    mSynthBuffer[i_octave][i_tone][i_sample] = mOscillatorBuffer[i_octave][i_tone][i_sample] * mModulationData[i_octave][i_tone][i_sample];
-                }
-                octaveCqtBuffer[i_tone].pushBlock(mSynthBuffer[i_octave][i_tone].data(), nSamplesOctave);
+                mSynthBuffer[octave][i_tone][i_sample] *= gainStart + gainStep * static_cast<double>(i_sample + 1u);
             }
+            mPartialGain[octave][i_tone] = gainEnd;
         }
-        // output data
-        const double *const dataOut = mCqt.outputBlock(BlockSize);
-        mOutputBuffer.pushBlock(dataOut, BlockSize);
-        mOutputDataCounter += BlockSize;
+        mSynthSilent[octave][i_tone] = false;
+        octaveCqtBuffer[i_tone].pushBlock(mSynthBuffer[octave][i_tone].data(), nSamplesOctave);
     }
-    if (mOutputDataCounter >= nSamples)
+    if (octaveFading)
     {
-        mOutputBuffer.pullDelayBlock(mOutputData.data(), nSamples - 1, nSamples);
-        mOutputDataCounter -= nSamples;
+        mEnvelopes.resetOctave(octave);
+        mOctaveFading[octave] = false;
     }
-    else
+}
+
+// Keeps the mMaxPartials strongest bins, ranked by target or current envelope so decaying tails still compete.
+// Bins that were selected in the previous hop get a bonus, so bins of similar level do not flicker in and out.
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::selectPartials()
+{
+    constexpr unsigned nBins = OctaveNumber * B;
+    if (mMaxPartials == 0u || mMaxPartials >= nBins)
     {
-        for (int i_sample = 0; i_sample < nSamples; i_sample++)
+        std::fill(&mPartialActive[0][0], &mPartialActive[0][0] + nBins, true);
+        return;
+    }
+
+    for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+    {
+        for (unsigned i_tone = 0u; i_tone < B; i_tone++)
         {
-            mOutputData[i_sample] = 0.;
+            const unsigned i_bin = i_octave * B + i_tone;
+            const double level = std::max(mGainSumMixed[i_octave][i_tone], mEnvelopes.getCurrentValue(i_octave, i_tone));
+            mPartialScores[i_bin] = mPartialActive[i_octave][i_tone] ? level * PartialHysteresis : level;
+            mPartialOrder[i_bin] = i_bin;
         }
     }
-    for (int i_sample = 0; i_sample < nSamples; i_sample++)
+    std::nth_element(mPartialOrder, mPartialOrder + mMaxPartials, mPartialOrder + nBins, [this](const unsigned a, const unsigned b)
+                     { return mPartialScores[a] > mPartialScores[b]; });
+
+    std::fill(&mPartialActive[0][0], &mPartialActive[0][0] + nBins, false);
+    for (unsigned i_partial = 0u; i_partial < mMaxPartials; i_partial++)
     {
-        data[i_sample] = mOutputData[i_sample];
+        const unsigned i_bin = mPartialOrder[i_partial];
+        if (mPartialScores[i_bin] > 0.)
+            mPartialActive[i_bin / B][i_bin % B] = true;
     }
 
-    // Spectral display
+    // Dropped bins ramp out over the next hop in synthesizeOctave. Their envelopes decay from where they are, so a
+    // bin selected again ramps back in at its current level.
     for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
     {
         for (unsigned i_tone = 0u; i_tone < B; i_tone++)
         {
-            mGainsIllustration[i_octave][i_tone] = mSmoothedFloats[i_octave][i_tone].getCurrentValue();
+            if (!mPartialActive[i_octave][i_tone])
+                mEnvelopes.setTargetValue(i_octave, i_tone, 0.);
         }
     }
 }
 
-template <unsigned B, unsigned OctaveNumber>
-inline void CqtReverb<B, OctaveNumber>::setAttack(const double attack)
+// Octaves leaving the window ramp out over the next hop like dropped partials, with the envelopes they had, and
+// restart from silence when they come back
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::applyOctaveWindow()
 {
-    mAttack = Cqt::Clip(attack, 0.0, 1.0);
-    mAttack = 1.0 - mAttack;
+    if (mRequestedFirstOctave == mFirstOctave && mRequestedLastOctave == mLastOctave)
+        return;
+    const unsigned previousFirst = mFirstOctave;
+    const unsigned previousLast = mLastOctave;
+    mFirstOctave = mRequestedFirstOctave;
+    mLastOctave = mRequestedLastOctave;
     for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
     {
+        if (i_octave >= mFirstOctave && i_octave <= mLastOctave)
+            continue;
+        mOctaveFading[i_octave] = i_octave >= previousFirst && i_octave <= previousLast;
         for (unsigned i_tone = 0u; i_tone < B; i_tone++)
         {
-            mSmoothedFloats[i_octave][i_tone].setSmoothingFactors(mAttack, mDecay);
+            mCqtFrame[i_octave][i_tone] = {0., 0.};
+            mCqtValues[i_octave][i_tone] = 0.;
+            mGainSum[i_octave][i_tone] = 0.; // not rewritten while excluded, but read by octave shift
         }
     }
 }
 
-template <unsigned B, unsigned OctaveNumber>
-inline void CqtReverb<B, OctaveNumber>::setDecay(const double decay)
+// Octaves are staggered, so the decimated ones do not all land on the same hop
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::updateControlSchedule()
 {
-    mDecay = Cqt::Clip(decay, 0.0, 1.0);
-    mDecay = 1.0 - mDecay;
     for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
     {
+        mControlDue[i_octave] = (mHopCount + i_octave) % mControlInterval[i_octave] == 0u;
+    }
+}
+
+// Each bin takes the pitch class of the nearest equal-tempered pitch, relative to A at the tuning frequency
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::applyPitchClassMask()
+{
+    if (mPitchClassMask == mAppliedPitchClassMask && mTuning == mMaskTuning)
+        return;
+    mAppliedPitchClassMask = mPitchClassMask;
+    mMaskTuning = mTuning;
+    for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+    {
+        const double *const binFreqs = mCqt.getOctaveBinFreqs(i_octave);
+        for (unsigned i_tone = 0u; i_tone < B; i_tone++)
+        {
+            const long semitones = std::lround(12. * std::log2(binFreqs[i_tone] / mTuning)) + 9;
+            const unsigned pitchClass = static_cast<unsigned>(((semitones % 12) + 12) % 12);
+            mBinMasked[i_octave][i_tone] = (mAppliedPitchClassMask & (1u << pitchClass)) == 0u;
+        }
+    }
+}
+
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::processFrozenHop()
+{
+    if (!mFrozen)
+    {
+        for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+        {
+            for (unsigned i_tone = 0u; i_tone < B; i_tone++)
+            {
+                mFrozenGains[i_octave][i_tone] = mEnvelopes.getCurrentValue(i_octave, i_tone);
+            }
+        }
+        mFrozen = true;
+    }
+
+    // No analysis ran, so the octave buffers are not advanced: synthesized samples are pushed instead of replaced.
+    // Sample counts come from the same place as in an analysed hop, engines with a shared analysis fall back to the
+    // octave block size like readSharedAnalysis does for hops the source did not analyse.
+    for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+    {
+        mSamplesToProcess[i_octave] = mAnalysisSource != nullptr ? static_cast<size_t>(mCqt.getOctaveBlockSize(i_octave))
+                                                                 : mCqt.getSamplesToProcess(i_octave);
+        const size_t nSamplesOctave = mSamplesToProcess[i_octave];
+        CircularBuffer<std::complex<double>> *octaveCqtBuffer = mCqt.getOctaveCqtBuffer(i_octave);
         for (unsigned i_tone = 0u; i_tone < B; i_tone++)
         {
-            mSmoothedFloats[i_octave][i_tone].setSmoothingFactors(mAttack, mDecay);
+            const double gain = mFrozenGains[i_octave][i_tone];
+            if (gain == 0.)
+            {
+                // also after a restore, which can start frozen
+                if (!mSynthSilent[i_octave][i_tone])
+                {
+                    std::fill(mSynthBuffer[i_octave][i_tone].begin(), mSynthBuffer[i_octave][i_tone].end(), std::complex<double>{0., 0.});
+                    mSynthSilent[i_octave][i_tone] = true;
+                }
+                octaveCqtBuffer[i_tone].pushBlock(mSynthBuffer[i_octave][i_tone].data(), nSamplesOctave);
+                continue;
+            }
+            mOscillators[i_octave][i_tone].generateBlock(mOscillatorBuffer[i_octave][i_tone].data(), nSamplesOctave);
+            for (size_t i_sample = 0u; i_sample < nSamplesOctave; i_sample++)
+            {
+                mOscillatorBuffer[i_octave][i_tone][i_sample] *= gain;
+            }
+            octaveCqtBuffer[i_tone].pushBlock(mOscillatorBuffer[i_octave][i_tone].data(), nSamplesOctave);
         }
     }
 }
 
-template <unsigned B, unsigned OctaveNumber>
-inline void CqtReverb<B, OctaveNumber>::setTuning(const double tuning)
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::setAttack(const double attack)
+{
+    mAttack = Cqt::Clip(attack, 0.0, 1.0);
+    mAttack = 1.0 - mAttack;
+    mEnvelopes.setSmoothingFactors(mAttack, mDecay);
+}
+
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::setDecay(const double decay)
+{
+    mDecay = Cqt::Clip(decay, 0.0, 1.0);
+    mDecay = 1.0 - mDecay;
+    mEnvelopes.setSmoothingFactors(mAttack, mDecay);
+}
+
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::setTuning(const double tuning)
 {
     mTuning = tuning;
     mCqt.setConcertPitch(mTuning);
 }
 
-template <unsigned B, unsigned OctaveNumber>
-inline void CqtReverb<B, OctaveNumber>::setOctaveShift(const double octaveShift)
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::setOctaveShift(const double octaveShift)
 {
     mOctaveShift = octaveShift;
     const double shiftFloor = std::floor(mOctaveShift);
@@ -410,21 +1155,266 @@ inline void CqtReverb<B, OctaveNumber>::setOctaveShift(const double octaveShift)
     mHigherOctaveShift = static_cast<int>(shiftCeil);
 }
 
-template <unsigned B, unsigned OctaveNumber>
-inline void CqtReverb<B, OctaveNumber>::setOctaveMix(const double octaveMix)
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::setOctaveMix(const double octaveMix)
 {
     mOctaveMix = octaveMix;
 }
 
-template <unsigned B, unsigned OctaveNumber>
-inline void CqtReverb<B, OctaveNumber>::setColour(const double colour)
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::setColour(const double colour)
 {
     mColour = colour;
     mColour = audio_utils::Clip<double>(mColour, -1., 1.);
 }
 
-template <unsigned B, unsigned OctaveNumber>
-inline void CqtReverb<B, OctaveNumber>::setSparsity(const double sparsity)
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::setSparsity(const double sparsity)
 {
     mSparsity = sparsity;
 }
+
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::setFreeze(const bool freeze)
+{
+    mFreeze = freeze;
+}
+
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::setQualityTier(const unsigned tier)
+{
+    if (tier == mQualityTier)
+        return;
+    mQualityTier = std::min(tier, static_cast<unsigned>(QualityTierNumber) - 1u);
+    mEnvelopes.setStride(mQualityTier >= QualityCoarseEnvelopes ? EnvelopeStride : 1u);
+}
+
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::setMaxPartials(const unsigned maxPartials)
+{
+    mMaxPartials = maxPartials;
+}
+
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::setActiveOctaves(const unsigned firstOctave, const unsigned lastOctave)
+{
+    mRequestedFirstOctave = std::min(firstOctave, OctaveNumber - 1u);
+    mRequestedLastOctave = std::clamp(lastOctave, mRequestedFirstOctave, OctaveNumber - 1u);
+}
+
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::writeStateHeader(StateWriter &writer, const uint64_t outputCount, const uint64_t frameCount) const
+{
+    writer.write(StateMagic);
+    writer.write(StateVersion);
+    writer.write(static_cast<uint32_t>(B));
+    writer.write(static_cast<uint32_t>(OctaveNumber));
+    writer.write(static_cast<int32_t>(BlockSize));
+    writer.write(mHostSampleRate);
+    writer.write(mEngineSampleRate);
+    writer.write(static_cast<uint8_t>(mResampling));
+    writer.write(outputCount);
+    writer.write(frameCount);
+}
+
+// Published analysis frames of the hops before the current one, which engines sharing this analysis may still read
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline uint64_t CqtReverb<B, OctaveNumber, OscillatorPolicy>::countAnalysisFrames() const
+{
+    const uint64_t nFrames = static_cast<uint64_t>(mAnalysisFrames.size());
+    uint64_t frameCount = 0u;
+    for (uint64_t hop = mHopCount - std::min(mHopCount, nFrames); hop < mHopCount; hop++)
+        frameCount += mAnalysisFrames[hop % nFrames].hop == hop ? 1u : 0u;
+    return frameCount;
+}
+
+// The blob covers everything the engine can reach: hop I/O, the internal rate FIFO and resamplers, the latest block of
+// every CQT bin, envelopes, oscillator phases, running octave statistics, held control values, the base octave,
+// settling, freeze, partial selection and the analysis published to engines sharing it. The filter states of the
+// sliding CQT analysis are private to rt-cqt. An engine that analysed the same input before the checkpoint continues
+// sample for sample, any other one reads its first analysis window from its own history.
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::saveState(std::vector<unsigned char> &state)
+{
+    state.clear();
+    StateWriter writer(state);
+    const uint64_t outputCount = mResampling ? static_cast<uint64_t>(mOutputDataCounter) : 0u;
+    const uint64_t frameCount = countAnalysisFrames();
+    writeStateHeader(writer, outputCount, frameCount);
+    writeStateBody(writer, outputCount, frameCount);
+}
+
+// Also sizes a blob when the writer only counts, the pending samples and frames are then read from wherever the FIFO
+// and the frames are
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverb<B, OctaveNumber, OscillatorPolicy>::writeStateBody(StateWriter &writer, const uint64_t outputCount, const uint64_t frameCount)
+{
+    writer.write(mHopPosition);
+    writer.write(mInputData.data(), BlockSize);
+    writer.write(mHopOutput, BlockSize);
+    if (mResampling)
+    {
+        mDownsampler.writeState(writer);
+        mUpsampler.writeState(writer);
+        // oldest samples first
+        for (uint64_t i_sample = 0u; i_sample < outputCount; i_sample++)
+            writer.write(mOutputBuffer.pullDelaySample(static_cast<int>(outputCount - 1u - i_sample)));
+    }
+
+    // the oscillator buffers are scratch between hops
+    for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+    {
+        const int nSamplesOctave = mCqt.getOctaveBlockSize(i_octave);
+        CircularBuffer<std::complex<double>> *octaveCqtBuffer = mCqt.getOctaveCqtBuffer(i_octave);
+        for (unsigned i_tone = 0u; i_tone < B; i_tone++)
+        {
+            octaveCqtBuffer[i_tone].pullDelayBlock(mOscillatorBuffer[i_octave][i_tone].data(), nSamplesOctave - 1, nSamplesOctave);
+            writer.write(mOscillatorBuffer[i_octave][i_tone].data(), static_cast<size_t>(nSamplesOctave));
+        }
+    }
+    if constexpr (HasOscillatorState<typename OscillatorPolicy::Oscillator>::value)
+    {
+        for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+        {
+            for (unsigned i_tone = 0u; i_tone < B; i_tone++)
+                mOscillators[i_octave][i_tone].writeState(writer);
+        }
+    }
+
+    mEnvelopes.writeState(writer);
+    writer.write(mOctaveMean, OctaveNumber);
+    writer.write(mOctaveMeanCurrent, OctaveNumber);
+    writer.write(&mCqtValues[0][0], OctaveNumber * B);
+    writer.write(&mGainSum[0][0], OctaveNumber * B);
+    writer.write(&mGainSumMixed[0][0], OctaveNumber * B);
+    writer.write(mBaseOctave);
+    writer.write(mBaseOctaveTarget);
+    writer.write(mSettleUntil, OctaveNumber);
+    writer.write(mFrozen);
+    writer.write(&mFrozenGains[0][0], OctaveNumber * B);
+    writer.write(&mPartialActive[0][0], OctaveNumber * B);
+    writer.write(&mPartialGain[0][0], OctaveNumber * B);
+    writer.write(mFirstOctave);
+    writer.write(mLastOctave);
+    writer.write(mHopCount);
+
+    // oldest hop first, frames a hop behind the engine are still read by engines sharing the analysis
+    const AnalysisFrame &anyFrame = mAnalysisFrames.front();
+    const uint64_t nFrames = static_cast<uint64_t>(mAnalysisFrames.size());
+    uint64_t hop = mHopCount - std::min(mHopCount, nFrames);
+    for (uint64_t i_frame = 0u; i_frame < frameCount; i_frame++)
+    {
+        while (hop < mHopCount && mAnalysisFrames[hop % nFrames].hop != hop)
+            hop++;
+        const AnalysisFrame &frame = hop < mHopCount ? mAnalysisFrames[hop % nFrames] : anyFrame;
+        writer.write(frame.hop);
+        writer.write(&frame.values[0][0], OctaveNumber * B);
+        writer.write(frame.samplesToProcess, OctaveNumber);
+        hop++;
+    }
+}
+
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline bool CqtReverb<B, OctaveNumber, OscillatorPolicy>::restoreState(const unsigned char *const data, const size_t size)
+{
+    // Header has to match this engine, and the blob has to be complete before anything is overwritten
+    StateReader reader(data, size);
+    uint32_t magic = 0u, version = 0u, bins = 0u, octaves = 0u;
+    int32_t blockSize = 0;
+    double hostRate = 0., engineRate = 0.;
+    uint8_t resampling = 0u;
+    uint64_t outputCount = 0u, frameCount = 0u;
+    reader.read(magic);
+    reader.read(version);
+    reader.read(bins);
+    reader.read(octaves);
+    reader.read(blockSize);
+    reader.read(hostRate);
+    reader.read(engineRate);
+    reader.read(resampling);
+    reader.read(outputCount);
+    reader.read(frameCount);
+    if (!reader.isValid() || magic != StateMagic || version != StateVersion || bins != B || octaves != OctaveNumber ||
+        blockSize != BlockSize || hostRate != mHostSampleRate || engineRate != mEngineSampleRate ||
+        (resampling != 0u) != mResampling || (mResampling && outputCount > static_cast<uint64_t>(mOutputCapacity)) ||
+        frameCount > size)
+        return false;
+
+    StateWriter sizer;
+    writeStateHeader(sizer, outputCount, frameCount);
+    writeStateBody(sizer, outputCount, frameCount);
+    if (size != sizer.getSize())
+        return false;
+
+    reader.read(mHopPosition);
+    reader.read(mInputData.data(), BlockSize);
+    reader.read(mRestoredHop.data(), BlockSize);
+    mHopOutput = mRestoredHop.data();
+    if (mResampling)
+    {
+        mDownsampler.readState(reader);
+        mUpsampler.readState(reader);
+        // pushed through the output scratch in host blocks
+        for (uint64_t i_sample = 0u; i_sample < outputCount; i_sample += mOutputData.size())
+        {
+            const size_t nChunk = static_cast<size_t>(std::min<uint64_t>(mOutputData.size(), outputCount - i_sample));
+            reader.read(mOutputData.data(), nChunk);
+            mOutputBuffer.pushBlock(mOutputData.data(), static_cast<int>(nChunk));
+        }
+        mOutputDataCounter = outputCount;
+    }
+
+    for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+    {
+        const int nSamplesOctave = mCqt.getOctaveBlockSize(i_octave);
+        CircularBuffer<std::complex<double>> *octaveCqtBuffer = mCqt.getOctaveCqtBuffer(i_octave);
+        for (unsigned i_tone = 0u; i_tone < B; i_tone++)
+        {
+            reader.read(mOscillatorBuffer[i_octave][i_tone].data(), static_cast<size_t>(nSamplesOctave));
+            octaveCqtBuffer[i_tone].pushBlock(mOscillatorBuffer[i_octave][i_tone].data(), nSamplesOctave);
+        }
+    }
+    if constexpr (HasOscillatorState<typename OscillatorPolicy::Oscillator>::value)
+    {
+        for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+        {
+            for (unsigned i_tone = 0u; i_tone < B; i_tone++)
+                mOscillators[i_octave][i_tone].readState(reader);
+        }
+    }
+
+    mEnvelopes.readState(reader);
+    reader.read(mOctaveMean, OctaveNumber);
+    reader.read(mOctaveMeanCurrent, OctaveNumber);
+    reader.read(&mCqtValues[0][0], OctaveNumber * B);
+    reader.read(&mGainSum[0][0], OctaveNumber * B);
+    reader.read(&mGainSumMixed[0][0], OctaveNumber * B);
+    reader.read(mBaseOctave);
+    reader.read(mBaseOctaveTarget);
+    reader.read(mSettleUntil, OctaveNumber);
+    reader.read(mFrozen);
+    reader.read(&mFrozenGains[0][0], OctaveNumber * B);
+    reader.read(&mPartialActive[0][0], OctaveNumber * B);
+    reader.read(&mPartialGain[0][0], OctaveNumber * B);
+    reader.read(mFirstOctave);
+    reader.read(mLastOctave);
+    reader.read(mHopCount);
+    // frames of the writer's hops only, its ring may have been sized for other host blocks: newer hops take the slot
+    for (AnalysisFrame &frame : mAnalysisFrames)
+        frame.hop = std::numeric_limits<uint64_t>::max();
+    for (uint64_t i_frame = 0u; i_frame < frameCount; i_frame++)
+    {
+        uint64_t hop = 0u;
+        reader.read(hop);
+        AnalysisFrame &frame = mAnalysisFrames[hop % mAnalysisFrames.size()];
+        frame.hop = hop;
+        reader.read(&frame.values[0][0], OctaveNumber * B);
+        reader.read(frame.samplesToProcess, OctaveNumber);
+    }
+    // the requested window is a parameter and stays, the next hop moves the restored one to it. Fades start and
+    // end within a hop, so there are none to restore.
+    mFirstOctave = std::min(mFirstOctave, OctaveNumber - 1u);
+    mLastOctave = std::clamp(mLastOctave, mFirstOctave, OctaveNumber - 1u);
+    mHopPosition = std::clamp(mHopPosition, 0, BlockSize - 1);
+    return reader.isValid() && reader.isAtEnd();
+}
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+
+#include "CqtReverb.h"
+#include "RealtimeWorkerPool.h"
+
+// Processes many independent mono streams with the same parameters in one call, e.g. stems of an offline render.
+// The engines sit in one contiguous array and share the process-wide wavetable and kernels, so a stream costs its
+// own state only. Contiguous groups of streams are spread over a worker pool, more groups than threads so threads
+// that finish early take the remaining ones. Every stream gives exactly the output of a separate CqtReverb, see
+// HarmonicReverb/BankBench.cpp.
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy = DefaultOscillatorPolicy>
+class CqtReverbBank
+{
+public:
+    using Engine = CqtReverb<B, OctaveNumber, OscillatorPolicy>;
+
+    CqtReverbBank() = default;
+    ~CqtReverbBank() = default;
+
+    // Allocates, the engines are rebuilt only if the stream count changed
+    void init(const unsigned nStreams, const double samplerate, const int blockSize, const double internalRate = 0.);
+    void reset();
+
+    // Streams are processed on the given pool, nullptr runs them inline. The pool has to outlive its use here.
+    void setWorkerPool(RealtimeWorkerPool *const pool) { mWorkerPool = pool; };
+
+    // input[i_stream] to output[i_stream], which may alias. Streams past the count passed to init are ignored.
+    template <typename SampleType>
+    void processBlock(const SampleType *const *const input, SampleType *const *const output, const unsigned nStreams, const int nSamples);
+
+    unsigned getStreamNumber() const { return mStreamNumber; };
+    Engine &getStream(const unsigned stream) { return mStreams[stream]; };
+
+    void setAttack(const double attack);
+    void setDecay(const double decay);
+    void setTuning(const double tuning);
+    void setOctaveShift(const double octaveShift);
+    void setOctaveMix(const double octaveMix);
+    void setColour(const double colour);
+    void setSparsity(const double sparsity);
+    void setFreeze(const bool freeze);
+    void setQualityTier(const unsigned tier);
+    void setMaxPartials(const unsigned maxPartials);
+    void setActiveOctaves(const unsigned firstOctave, const unsigned lastOctave);
+    void setPitchClassMask(const uint32_t mask);
+
+private:
+    static constexpr unsigned TasksPerThread{4u};
+
+    template <typename Setter>
+    void forEachStream(Setter setter);
+
+    std::unique_ptr<Engine[]> mStreams;
+    unsigned mStreamNumber{0u};
+    RealtimeWorkerPool *mWorkerPool{nullptr};
+};
+
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverbBank<B, OctaveNumber, OscillatorPolicy>::init(const unsigned nStreams, const double samplerate, const int blockSize, const double internalRate)
+{
+    if (nStreams != mStreamNumber)
+    {
+        mStreams = nStreams > 0u ? std::make_unique<Engine[]>(nStreams) : nullptr;
+        mStreamNumber = nStreams;
+    }
+    for (unsigned i_stream = 0u; i_stream < mStreamNumber; i_stream++)
+    {
+        mStreams[i_stream].init(samplerate, blockSize, internalRate);
+    }
+}
+
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverbBank<B, OctaveNumber, OscillatorPolicy>::reset()
+{
+    forEachStream([](Engine &stream)
+                  { stream.reset(); });
+}
+
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+template <typename SampleType>
+inline void CqtReverbBank<B, OctaveNumber, OscillatorPolicy>::processBlock(const SampleType *const *const input, SampleType *const *const output, const unsigned nStreams, const int nSamples)
+{
+    const unsigned nStreamsClipped = std::min(nStreams, mStreamNumber);
+    const unsigned nThreads = mWorkerPool != nullptr ? mWorkerPool->getNumWorkers() + 1u : 1u;
+    const unsigned nTasks = std::min(nStreamsClipped, nThreads * TasksPerThread);
+    if (nTasks == 0u)
+        return;
+
+    auto streamGroupTask = [this, input, output, nStreamsClipped, nTasks, nSamples](const unsigned i_task)
+    {
+        const unsigned first = (nStreamsClipped * i_task) / nTasks;
+        const unsigned last = (nStreamsClipped * (i_task + 1u)) / nTasks;
+        for (unsigned i_stream = first; i_stream < last; i_stream++)
+        {
+            ScopedTrace streamTrace("stream", static_cast<int>(i_stream));
+            mStreams[i_stream].processBlock(input[i_stream], output[i_stream], nSamples);
+        }
+    };
+    if (mWorkerPool != nullptr)
+    {
+        mWorkerPool->parallelFor(nTasks, streamGroupTask);
+    }
+    else
+    {
+        for (unsigned i_task = 0u; i_task < nTasks; i_task++)
+        {
+            streamGroupTask(i_task);
+        }
+    }
+}
+
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+template <typename Setter>
+inline void CqtReverbBank<B, OctaveNumber, OscillatorPolicy>::forEachStream(Setter setter)
+{
+    for (unsigned i_stream = 0u; i_stream < mStreamNumber; i_stream++)
+    {
+        setter(mStreams[i_stream]);
+    }
+}
+
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverbBank<B, OctaveNumber, OscillatorPolicy>::setAttack(const double attack)
+{
+    forEachStream([attack](Engine &stream)
+                  { stream.setAttack(attack); });
+}
+
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverbBank<B, OctaveNumber, OscillatorPolicy>::setDecay(const double decay)
+{
+    forEachStream([decay](Engine &stream)
+                  { stream.setDecay(decay); });
+}
+
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverbBank<B, OctaveNumber, OscillatorPolicy>::setTuning(const double tuning)
+{
+    forEachStream([tuning](Engine &stream)
+                  { stream.setTuning(tuning); });
+}
+
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverbBank<B, OctaveNumber, OscillatorPolicy>::setOctaveShift(const double octaveShift)
+{
+    forEachStream([octaveShift](Engine &stream)
+                  { stream.setOctaveShift(octaveShift); });
+}
+
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverbBank<B, OctaveNumber, OscillatorPolicy>::setOctaveMix(const double octaveMix)
+{
+    forEachStream([octaveMix](Engine &stream)
+                  { stream.setOctaveMix(octaveMix); });
+}
+
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverbBank<B, OctaveNumber, OscillatorPolicy>::setColour(const double colour)
+{
+    forEachStream([colour](Engine &stream)
+                  { stream.setColour(colour); });
+}
+
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverbBank<B, OctaveNumber, OscillatorPolicy>::setSparsity(const double sparsity)
+{
+    forEachStream([sparsity](Engine &stream)
+                  { stream.setSparsity(sparsity); });
+}
+
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverbBank<B, OctaveNumber, OscillatorPolicy>::setFreeze(const bool freeze)
+{
+    forEachStream([freeze](Engine &stream)
+                  { stream.setFreeze(freeze); });
+}
+
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverbBank<B, OctaveNumber, OscillatorPolicy>::setQualityTier(const unsigned tier)
+{
+    forEachStream([tier](Engine &stream)
+                  { stream.setQualityTier(tier); });
+}
+
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverbBank<B, OctaveNumber, OscillatorPolicy>::setMaxPartials(const unsigned maxPartials)
+{
+    forEachStream([maxPartials](Engine &stream)
+                  { stream.setMaxPartials(maxPartials); });
+}
+
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverbBank<B, OctaveNumber, OscillatorPolicy>::setActiveOctaves(const unsigned firstOctave, const unsigned lastOctave)
+{
+    forEachStream([firstOctave, lastOctave](Engine &stream)
+                  { stream.setActiveOctaves(firstOctave, lastOctave); });
+}
+
+template <unsigned B, unsigned OctaveNumber, typename OscillatorPolicy>
+inline void CqtReverbBank<B, OctaveNumber, OscillatorPolicy>::setPitchClassMask(const uint32_t mask)
+{
+    forEachStream([mask](Engine &stream)
+                  { stream.setPitchClassMask(mask); });
+}
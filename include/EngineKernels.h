@@ -0,0 +1,50 @@
+#pragma once
+
+#include <complex>
+#include <cstddef>
+
+// Hot inner loops of CqtReverb, built once per instruction set (HarmonicReverb/EngineKernels*.cpp) and picked at load time.
+// All variants give bit-identical results, only the vector width the compiler may use differs. That needs the kernel
+// files to be built without FMA contraction, see HarmonicReverb/CMakeLists.txt and EngineTest.cpp.
+constexpr double EnvelopeDenormalThreshold{1e-15};
+
+enum class EngineIsa
+{
+    Generic, // SSE2 on x86-64, the baseline of the build elsewhere
+    Avx2,
+    Avx512
+};
+
+struct EngineKernels
+{
+    EngineIsa isa;
+    const char *name;
+
+    // nSamples frames of nLanes one-pole up/down envelopes, output[i_sample * nLanes + i_lane].
+    // The envelopes advance once every stride samples and hold in between, phase carries the position over blocks.
+    void (*envelopeBlock)(double *current, const double *target, unsigned nLanes, double up, double down,
+                          double *output, std::size_t nSamples, unsigned stride, unsigned *phase);
+
+    // output[i] = |input[i]|
+    void (*magnitudes)(const std::complex<double> *input, double *output, std::size_t n);
+
+    // gains[i] = values[i] if above threshold, else 0
+    void (*thresholdGains)(const double *values, double *gains, std::size_t n, double threshold);
+
+    // output[i] = oscillator[i] * modulation[i * modulationStride]
+    void (*modulate)(const std::complex<double> *oscillator, const double *modulation, std::size_t modulationStride,
+                     std::complex<double> *output, std::size_t n);
+};
+
+// Best variant the CPU supports, unless overridden by forceEngineIsa or the HARMONIC_REVERB_ISA environment
+// variable (generic, avx2 or avx512). Resolved once, the reference stays valid for the whole process.
+const EngineKernels &getEngineKernels();
+
+// For benchmarking, returns false if the CPU or the build does not support the requested variant.
+// Engines pick up the kernels in init, so this has to be called before them.
+bool forceEngineIsa(const EngineIsa isa);
+
+// Individual variants, nullptr if not built for this architecture
+const EngineKernels *getEngineKernelsGeneric();
+const EngineKernels *getEngineKernelsAvx2();
+const EngineKernels *getEngineKernelsAvx512();
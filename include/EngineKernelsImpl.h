@@ -0,0 +1,82 @@
+#pragma once
+
+// Kernel bodies shared by all ISA variants. Only included by HarmonicReverb/EngineKernels*.cpp, each of which is
+// compiled with its own target flags; the unnamed namespace keeps the differently compiled copies apart.
+#include <cmath>
+
+#include "EngineKernels.h"
+
+namespace
+{
+    inline void advanceEnvelopes(double *current, const double *target, const unsigned nLanes, const double up, const double down)
+    {
+#pragma omp simd
+        for (unsigned i_lane = 0u; i_lane < nLanes; i_lane++)
+        {
+            const double difference = target[i_lane] - current[i_lane];
+            const double coefficient = difference > 0. ? up : down;
+            const double value = current[i_lane] + coefficient * difference;
+            current[i_lane] = std::abs(value) < EnvelopeDenormalThreshold ? 0. : value;
+        }
+    }
+
+    void envelopeBlockKernel(double *current, const double *target, const unsigned nLanes, const double up, const double down,
+                             double *output, const std::size_t nSamples, const unsigned stride, unsigned *phase)
+    {
+        unsigned position = *phase;
+        for (std::size_t i_sample = 0u; i_sample < nSamples; i_sample++)
+        {
+            if (position == 0u)
+                advanceEnvelopes(current, target, nLanes, up, down);
+            double *const frame = output + i_sample * nLanes;
+#pragma omp simd
+            for (unsigned i_lane = 0u; i_lane < nLanes; i_lane++)
+            {
+                frame[i_lane] = current[i_lane];
+            }
+            position = position + 1u >= stride ? 0u : position + 1u;
+        }
+        *phase = position;
+    }
+
+    void magnitudesKernel(const std::complex<double> *input, double *output, const std::size_t n)
+    {
+        // interleaved re/im, avoids the overflow-safe (and slow) hypot behind std::abs
+        const double *const values = reinterpret_cast<const double *>(input);
+#pragma omp simd
+        for (std::size_t i = 0u; i < n; i++)
+        {
+            const double re = values[2 * i];
+            const double im = values[2 * i + 1];
+            output[i] = std::sqrt(re * re + im * im);
+        }
+    }
+
+    void thresholdGainsKernel(const double *values, double *gains, const std::size_t n, const double threshold)
+    {
+#pragma omp simd
+        for (std::size_t i = 0u; i < n; i++)
+        {
+            gains[i] = values[i] > threshold ? values[i] : 0.;
+        }
+    }
+
+    void modulateKernel(const std::complex<double> *oscillator, const double *modulation, const std::size_t modulationStride,
+                        std::complex<double> *output, const std::size_t n)
+    {
+        const double *const in = reinterpret_cast<const double *>(oscillator);
+        double *const out = reinterpret_cast<double *>(output);
+#pragma omp simd
+        for (std::size_t i = 0u; i < n; i++)
+        {
+            const double gain = modulation[i * modulationStride];
+            out[2 * i] = in[2 * i] * gain;
+            out[2 * i + 1] = in[2 * i + 1] * gain;
+        }
+    }
+
+    constexpr EngineKernels makeEngineKernels(const EngineIsa isa, const char *name)
+    {
+        return EngineKernels{isa, name, envelopeBlockKernel, magnitudesKernel, thresholdGainsKernel, modulateKernel};
+    }
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include "EngineKernels.h"
+#include "StateBlob.h"
+
+// Attack/decay envelope followers for all bins, stored as structure of arrays.
+// All bins of an octave share one sample rate and therefore one coefficient pair, and run in parallel lanes
+// with a branchless up/down selection. Values that decay below EnvelopeDenormalThreshold are flushed to zero.
+// With a stride above one the envelopes only advance every stride samples, with coefficients scaled to keep their times.
+template <unsigned B, unsigned OctaveNumber>
+class EnvelopeBank
+{
+public:
+    EnvelopeBank() = default;
+    ~EnvelopeBank() = default;
+
+    void init(const double *const octaveRates);
+    void reset();
+    void resetOctave(const unsigned octave);
+
+    // Same smoothing factors as audio_utils::OnePoleUpDown::setSmoothingFactors, time constants in seconds
+    void setSmoothingFactors(const double attack, const double decay);
+    void setStride(const unsigned stride);
+
+    inline void setTargetValue(const unsigned octave, const unsigned tone, const double value) { mTarget[octave][tone] = value; };
+    inline double getCurrentValue(const unsigned octave, const unsigned tone) const { return mCurrent[octave][tone]; };
+    inline const double *getCurrentValues(const unsigned octave) const { return mCurrent[octave]; };
+
+    // Writes nSamples frames of B interleaved values, output[i_sample * B + i_tone]
+    void getNextBlock(const unsigned octave, double *const output, const size_t nSamples);
+
+    // Envelope values and targets, coefficients are configuration and not part of the state
+    void writeState(StateWriter &writer) const;
+    bool readState(StateReader &reader);
+
+private:
+    static double getCoefficient(const double time, const double rate);
+    void updateStrideCoefficients();
+
+    const EngineKernels *mKernels{nullptr};
+
+    double mOctaveRates[OctaveNumber]{};
+    double mUpCoefficients[OctaveNumber]{};
+    double mDownCoefficients[OctaveNumber]{};
+
+    unsigned mStride{1u};
+    unsigned mStridePhase[OctaveNumber]{};
+    double mUpCoefficientsStrided[OctaveNumber]{}; // equal to the per-sample ones at stride 1
+    double mDownCoefficientsStrided[OctaveNumber]{};
+
+    alignas(64) double mCurrent[OctaveNumber][B];
+    alignas(64) double mTarget[OctaveNumber][B];
+};
+
+template <unsigned B, unsigned OctaveNumber>
+inline void EnvelopeBank<B, OctaveNumber>::init(const double *const octaveRates)
+{
+    mKernels = &getEngineKernels();
+    for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+    {
+        mOctaveRates[i_octave] = octaveRates[i_octave];
+        mUpCoefficients[i_octave] = 1.;
+        mDownCoefficients[i_octave] = 1.;
+    }
+    updateStrideCoefficients();
+    reset();
+}
+
+template <unsigned B, unsigned OctaveNumber>
+inline void EnvelopeBank<B, OctaveNumber>::reset()
+{
+    for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+    {
+        for (unsigned i_tone = 0u; i_tone < B; i_tone++)
+        {
+            mCurrent[i_octave][i_tone] = 0.;
+            mTarget[i_octave][i_tone] = 0.;
+        }
+        mStridePhase[i_octave] = 0u;
+    }
+}
+
+template <unsigned B, unsigned OctaveNumber>
+inline void EnvelopeBank<B, OctaveNumber>::resetOctave(const unsigned octave)
+{
+    for (unsigned i_tone = 0u; i_tone < B; i_tone++)
+    {
+        mCurrent[octave][i_tone] = 0.;
+        mTarget[octave][i_tone] = 0.;
+    }
+    mStridePhase[octave] = 0u;
+}
+
+template <unsigned B, unsigned OctaveNumber>
+inline void EnvelopeBank<B, OctaveNumber>::setSmoothingFactors(const double attack, const double decay)
+{
+    for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+    {
+        if (mOctaveRates[i_octave] <= 0.) // not initialised yet
+            continue;
+        mUpCoefficients[i_octave] = getCoefficient(attack, mOctaveRates[i_octave]);
+        mDownCoefficients[i_octave] = getCoefficient(decay, mOctaveRates[i_octave]);
+    }
+    updateStrideCoefficients();
+}
+
+template <unsigned B, unsigned OctaveNumber>
+inline void EnvelopeBank<B, OctaveNumber>::setStride(const unsigned stride)
+{
+    const unsigned strideClipped = std::max(stride, 1u);
+    if (strideClipped == mStride)
+        return;
+    mStride = strideClipped;
+    for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+    {
+        mStridePhase[i_octave] = 0u;
+    }
+    updateStrideCoefficients();
+}
+
+// One step of the strided envelope covers stride steps of the original one-pole
+template <unsigned B, unsigned OctaveNumber>
+inline void EnvelopeBank<B, OctaveNumber>::updateStrideCoefficients()
+{
+    const double stride = static_cast<double>(mStride);
+    for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+    {
+        mUpCoefficientsStrided[i_octave] = 1. - std::pow(1. - mUpCoefficients[i_octave], stride);
+        mDownCoefficientsStrided[i_octave] = 1. - std::pow(1. - mDownCoefficients[i_octave], stride);
+    }
+}
+
+template <unsigned B, unsigned OctaveNumber>
+inline void EnvelopeBank<B, OctaveNumber>::getNextBlock(const unsigned octave, double *const output, const size_t nSamples)
+{
+    mKernels->envelopeBlock(mCurrent[octave], mTarget[octave], B, mUpCoefficientsStrided[octave], mDownCoefficientsStrided[octave],
+                            output, nSamples, mStride, &mStridePhase[octave]);
+}
+
+template <unsigned B, unsigned OctaveNumber>
+inline void EnvelopeBank<B, OctaveNumber>::writeState(StateWriter &writer) const
+{
+    writer.write(&mCurrent[0][0], OctaveNumber * B);
+    writer.write(&mTarget[0][0], OctaveNumber * B);
+    writer.write(mStridePhase, OctaveNumber);
+}
+
+template <unsigned B, unsigned OctaveNumber>
+inline bool EnvelopeBank<B, OctaveNumber>::readState(StateReader &reader)
+{
+    reader.read(&mCurrent[0][0], OctaveNumber * B);
+    reader.read(&mTarget[0][0], OctaveNumber * B);
+    reader.read(mStridePhase, OctaveNumber);
+    for (unsigned i_octave = 0u; i_octave < OctaveNumber; i_octave++)
+    {
+        mStridePhase[i_octave] = mStridePhase[i_octave] < mStride ? mStridePhase[i_octave] : 0u;
+    }
+    return reader.isValid();
+}
+
+// Per-sample coefficient of a one-pole with the given time constant, a time of zero follows the target at once.
+// HarmonicReverb/EngineTest.cpp checks the bank against the OnePoleUpDown it replaces.
+template <unsigned B, unsigned OctaveNumber>
+inline double EnvelopeBank<B, OctaveNumber>::getCoefficient(const double time, const double rate)
+{
+    return time > 0. ? 1. - std::exp(-1. / (time * rate)) : 1.;
+}
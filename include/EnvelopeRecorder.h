@@ -0,0 +1,327 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "EnvelopeRecording.h"
+
+// Streams the per-hop envelopes and CQT magnitudes of any number of engines into an EnvelopeRecording file.
+// Engines push from their audio threads into a bounded lock-free queue, a background thread drains it into a
+// memory-mapped file that grows in chunks. Frames are written in order, so only the header and the chunk being
+// filled are mapped. The audio threads never touch the file; if the writer falls behind, frames are dropped and
+// counted in the header.
+template <unsigned B, unsigned OctaveNumber>
+class EnvelopeRecorder
+{
+public:
+    EnvelopeRecorder() = default;
+    ~EnvelopeRecorder() { stop(); };
+
+    EnvelopeRecorder(const EnvelopeRecorder &) = delete;
+    EnvelopeRecorder &operator=(const EnvelopeRecorder &) = delete;
+
+    // Creates the file and starts the writer, returns false if the file cannot be created. Not realtime safe.
+    bool start(const std::string &path, const double engineSampleRate, const unsigned hopSize);
+    // Waits for pushes in flight, writes what is queued and closes the file
+    void stop();
+    bool isRecording() const { return mRecording.load(std::memory_order_relaxed); };
+
+    // Realtime safe, envelopes and magnitudes are [OctaveNumber][B]. Does nothing while not recording.
+    void push(const unsigned channel, const uint64_t hop, const double *const envelopes, const double *const magnitudes);
+
+private:
+    static constexpr size_t QueueCapacity{4096u}; // power of two, about a second of 16 engines at 48 kHz
+    static constexpr uint64_t FramesPerChunk{4096u}; // file growth step
+    static constexpr int WriterPeriodMs{10};
+    static constexpr size_t FrameSize{sizeof(EnvelopeFrameHeader) + 2u * OctaveNumber * B * sizeof(float)};
+
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        EnvelopeFrameHeader header;
+        float envelopes[OctaveNumber * B];
+        float magnitudes[OctaveNumber * B];
+    };
+
+    void writerLoop();
+    bool drain();
+    bool reserveFrames(const uint64_t nFrames);
+    void writeHeader();
+    void unmapChunk();
+    void closeFile();
+
+    // Bounded multi-producer queue, each slot's sequence tells whose turn it is
+    std::unique_ptr<Slot[]> mSlots;
+    std::atomic<size_t> mEnqueuePosition{0u};
+    size_t mDequeuePosition{0u}; // writer thread only
+
+    std::atomic<bool> mRecording{false};
+    std::atomic<unsigned> mProducers{0u};
+    std::atomic<uint64_t> mDroppedFrames{0u};
+    std::atomic<bool> mWriterRunning{false};
+    std::thread mWriter;
+
+    // File, writer thread only while recording
+    EnvelopeRecordingHeader mHeader{};
+    uint64_t mFrameCapacity{0u};
+    bool mWriteFailed{false};
+#if HARMONIC_REVERB_MMAP
+    int mFile{-1};
+    unsigned char *mHeaderMapping{nullptr};
+    unsigned char *mChunkMapping{nullptr}; // starts at the page that holds the chunk's first frame
+    size_t mChunkMappedSize{0u};
+    unsigned char *mChunkFrames{nullptr};
+    uint64_t mChunkFirstFrame{0u};
+#else
+    std::FILE *mFile{nullptr};
+#endif
+};
+
+template <unsigned B, unsigned OctaveNumber>
+inline bool EnvelopeRecorder<B, OctaveNumber>::start(const std::string &path, const double engineSampleRate, const unsigned hopSize)
+{
+    stop();
+
+    mHeader = EnvelopeRecordingHeader{};
+    mHeader.magic = EnvelopeRecordingMagic;
+    mHeader.version = EnvelopeRecordingVersion;
+    mHeader.bins = B;
+    mHeader.octaves = OctaveNumber;
+    mHeader.hopSize = hopSize;
+    mHeader.engineSampleRate = engineSampleRate;
+    mFrameCapacity = 0u;
+    mWriteFailed = false;
+#if HARMONIC_REVERB_MMAP
+    mFile = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (mFile < 0)
+        return false;
+#else
+    mFile = std::fopen(path.c_str(), "wb");
+    if (mFile == nullptr)
+        return false;
+#endif
+    if (!reserveFrames(FramesPerChunk))
+    {
+        closeFile();
+        return false;
+    }
+    writeHeader();
+
+    if (mSlots == nullptr)
+        mSlots = std::make_unique<Slot[]>(QueueCapacity);
+    for (size_t i_slot = 0u; i_slot < QueueCapacity; i_slot++)
+    {
+        mSlots[i_slot].sequence.store(i_slot, std::memory_order_relaxed);
+    }
+    mEnqueuePosition.store(0u, std::memory_order_relaxed);
+    mDequeuePosition = 0u;
+    mDroppedFrames.store(0u, std::memory_order_relaxed);
+
+    mWriterRunning.store(true);
+    mWriter = std::thread([this]
+                          { writerLoop(); });
+    mRecording.store(true);
+    return true;
+}
+
+template <unsigned B, unsigned OctaveNumber>
+inline void EnvelopeRecorder<B, OctaveNumber>::stop()
+{
+    if (!mWriter.joinable())
+        return;
+    // a producer that saw the recording flag is counted before it looks at the flag
+    mRecording.store(false);
+    while (mProducers.load() != 0u)
+        std::this_thread::yield();
+    mWriterRunning.store(false);
+    mWriter.join();
+    closeFile();
+}
+
+template <unsigned B, unsigned OctaveNumber>
+inline void EnvelopeRecorder<B, OctaveNumber>::push(const unsigned channel, const uint64_t hop, const double *const envelopes, const double *const magnitudes)
+{
+    if (!isRecording())
+        return;
+    mProducers.fetch_add(1u);
+    if (!mRecording.load())
+    {
+        mProducers.fetch_sub(1u);
+        return;
+    }
+
+    size_t position = mEnqueuePosition.load(std::memory_order_relaxed);
+    Slot *slot = nullptr;
+    while (slot == nullptr)
+    {
+        Slot &candidate = mSlots[position & (QueueCapacity - 1u)];
+        const size_t sequence = candidate.sequence.load(std::memory_order_acquire);
+        if (sequence == position)
+        {
+            if (mEnqueuePosition.compare_exchange_weak(position, position + 1u, std::memory_order_relaxed))
+                slot = &candidate;
+        }
+        else if (sequence < position)
+        {
+            // full, the writer has not freed this slot yet
+            mDroppedFrames.fetch_add(1u, std::memory_order_relaxed);
+            mProducers.fetch_sub(1u);
+            return;
+        }
+        else
+        {
+            position = mEnqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->header.hop = hop;
+    slot->header.channel = channel;
+    slot->header.reserved = 0u;
+    for (unsigned i_bin = 0u; i_bin < OctaveNumber * B; i_bin++)
+    {
+        slot->envelopes[i_bin] = static_cast<float>(envelopes[i_bin]);
+        slot->magnitudes[i_bin] = static_cast<float>(magnitudes[i_bin]);
+    }
+    slot->sequence.store(position + 1u, std::memory_order_release);
+    mProducers.fetch_sub(1u);
+}
+
+template <unsigned B, unsigned OctaveNumber>
+inline void EnvelopeRecorder<B, OctaveNumber>::writerLoop()
+{
+    while (mWriterRunning.load())
+    {
+        if (drain())
+            writeHeader();
+        std::this_thread::sleep_for(std::chrono::milliseconds(WriterPeriodMs));
+    }
+    drain();
+    writeHeader();
+}
+
+// Returns true if frames were written
+template <unsigned B, unsigned OctaveNumber>
+inline bool EnvelopeRecorder<B, OctaveNumber>::drain()
+{
+    bool written = false;
+    while (true)
+    {
+        Slot &slot = mSlots[mDequeuePosition & (QueueCapacity - 1u)];
+        if (slot.sequence.load(std::memory_order_acquire) != mDequeuePosition + 1u)
+            break;
+
+        if (!mWriteFailed && reserveFrames(mHeader.frameCount + 1u))
+        {
+#if HARMONIC_REVERB_MMAP
+            unsigned char *frame = mChunkFrames + (mHeader.frameCount - mChunkFirstFrame) * FrameSize;
+            std::memcpy(frame, &slot.header, sizeof(EnvelopeFrameHeader));
+            std::memcpy(frame + sizeof(EnvelopeFrameHeader), slot.envelopes, sizeof(slot.envelopes));
+            std::memcpy(frame + sizeof(EnvelopeFrameHeader) + sizeof(slot.envelopes), slot.magnitudes, sizeof(slot.magnitudes));
+#else
+            std::fwrite(&slot.header, sizeof(EnvelopeFrameHeader), 1u, mFile);
+            std::fwrite(slot.envelopes, sizeof(slot.envelopes), 1u, mFile);
+            std::fwrite(slot.magnitudes, sizeof(slot.magnitudes), 1u, mFile);
+#endif
+            mHeader.frameCount++;
+            written = true;
+        }
+        else
+        {
+            mWriteFailed = true;
+            mDroppedFrames.fetch_add(1u, std::memory_order_relaxed);
+        }
+        slot.sequence.store(mDequeuePosition + QueueCapacity, std::memory_order_release);
+        mDequeuePosition++;
+    }
+    return written;
+}
+
+// Grows the file by whole chunks and maps the frames it added, from the page they start in
+template <unsigned B, unsigned OctaveNumber>
+inline bool EnvelopeRecorder<B, OctaveNumber>::reserveFrames(const uint64_t nFrames)
+{
+    if (nFrames <= mFrameCapacity)
+        return true;
+    const uint64_t capacity = (nFrames + FramesPerChunk - 1u) / FramesPerChunk * FramesPerChunk;
+#if HARMONIC_REVERB_MMAP
+    const size_t begin = sizeof(EnvelopeRecordingHeader) + static_cast<size_t>(mFrameCapacity) * FrameSize;
+    const size_t end = sizeof(EnvelopeRecordingHeader) + static_cast<size_t>(capacity) * FrameSize;
+    unmapChunk();
+    if (ftruncate(mFile, static_cast<off_t>(end)) != 0)
+        return false;
+    if (mHeaderMapping == nullptr)
+    {
+        void *mapping = mmap(nullptr, sizeof(EnvelopeRecordingHeader), PROT_READ | PROT_WRITE, MAP_SHARED, mFile, 0);
+        if (mapping == MAP_FAILED)
+            return false;
+        mHeaderMapping = static_cast<unsigned char *>(mapping);
+    }
+    const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t offset = begin / pageSize * pageSize;
+    void *mapping = mmap(nullptr, end - offset, PROT_READ | PROT_WRITE, MAP_SHARED, mFile, static_cast<off_t>(offset));
+    if (mapping == MAP_FAILED)
+        return false;
+    mChunkMapping = static_cast<unsigned char *>(mapping);
+    mChunkMappedSize = end - offset;
+    mChunkFrames = mChunkMapping + (begin - offset);
+    mChunkFirstFrame = mFrameCapacity;
+#endif
+    mFrameCapacity = capacity;
+    return true;
+}
+
+template <unsigned B, unsigned OctaveNumber>
+inline void EnvelopeRecorder<B, OctaveNumber>::writeHeader()
+{
+    mHeader.droppedFrames = mDroppedFrames.load(std::memory_order_relaxed);
+#if HARMONIC_REVERB_MMAP
+    if (mHeaderMapping != nullptr)
+        std::memcpy(mHeaderMapping, &mHeader, sizeof(EnvelopeRecordingHeader));
+#else
+    if (mFile == nullptr)
+        return;
+    const long position = std::ftell(mFile);
+    std::fseek(mFile, 0, SEEK_SET);
+    std::fwrite(&mHeader, sizeof(EnvelopeRecordingHeader), 1u, mFile);
+    std::fseek(mFile, position > 0 ? position : static_cast<long>(sizeof(EnvelopeRecordingHeader)), SEEK_SET);
+#endif
+}
+
+template <unsigned B, unsigned OctaveNumber>
+inline void EnvelopeRecorder<B, OctaveNumber>::unmapChunk()
+{
+#if HARMONIC_REVERB_MMAP
+    if (mChunkMapping != nullptr)
+        munmap(mChunkMapping, mChunkMappedSize);
+    mChunkMapping = nullptr;
+    mChunkMappedSize = 0u;
+    mChunkFrames = nullptr;
+#endif
+}
+
+// Trims the last chunk to the frames actually written
+template <unsigned B, unsigned OctaveNumber>
+inline void EnvelopeRecorder<B, OctaveNumber>::closeFile()
+{
+#if HARMONIC_REVERB_MMAP
+    unmapChunk();
+    if (mHeaderMapping != nullptr)
+        munmap(mHeaderMapping, sizeof(EnvelopeRecordingHeader));
+    mHeaderMapping = nullptr;
+    if (mFile >= 0)
+    {
+        const size_t size = sizeof(EnvelopeRecordingHeader) + static_cast<size_t>(mHeader.frameCount) * FrameSize;
+        if (ftruncate(mFile, static_cast<off_t>(size)) != 0)
+            mWriteFailed = true; // the reader ignores the unused tail anyway
+        ::close(mFile);
+    }
+    mFile = -1;
+#else
+    if (mFile != nullptr)
+        std::fclose(mFile);
+    mFile = nullptr;
+#endif
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HARMONIC_REVERB_MMAP 1
+#else
+#define HARMONIC_REVERB_MMAP 0
+#endif
+
+// Binary recording of per-hop bin envelopes and CQT magnitudes, written by EnvelopeRecorder.
+// Layout, native byte order like the checkpoint blobs:
+//   EnvelopeRecordingHeader (64 bytes)
+//   frameCount frames of EnvelopeFrameHeader followed by octaves * bins envelopes and octaves * bins magnitudes,
+//   float32, octave-major with octave 0 the highest.
+constexpr uint32_t EnvelopeRecordingMagic{0x56455248u}; // "HREV"
+constexpr uint32_t EnvelopeRecordingVersion{1u};
+
+struct EnvelopeRecordingHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t bins;
+    uint32_t octaves;
+    uint32_t hopSize;
+    uint32_t reserved0;
+    double engineSampleRate;
+    uint64_t frameCount;    // updated while recording, so an interrupted recording stays readable
+    uint64_t droppedFrames; // frames lost to a full queue
+    uint8_t reserved[16];
+};
+static_assert(sizeof(EnvelopeRecordingHeader) == 64u, "header layout is part of the format");
+
+struct EnvelopeFrameHeader
+{
+    uint64_t hop;     // hop index of the engine since its init
+    uint32_t channel; // engine the frame comes from
+    uint32_t reserved;
+};
+static_assert(sizeof(EnvelopeFrameHeader) == 16u, "frame layout is part of the format");
+
+inline size_t getEnvelopeFrameSize(const uint32_t bins, const uint32_t octaves)
+{
+    return sizeof(EnvelopeFrameHeader) + 2u * static_cast<size_t>(bins) * octaves * sizeof(float);
+}
+
+// Read-only view of a recording, mapped into memory where the platform allows it
+class EnvelopeRecordingReader
+{
+public:
+    EnvelopeRecordingReader() = default;
+    ~EnvelopeRecordingReader() { close(); };
+
+    EnvelopeRecordingReader(const EnvelopeRecordingReader &) = delete;
+    EnvelopeRecordingReader &operator=(const EnvelopeRecordingReader &) = delete;
+
+    // Returns false if the file is missing, truncated or not a recording of a known version
+    bool open(const std::string &path);
+    void close();
+
+    const EnvelopeRecordingHeader &getHeader() const { return mHeader; };
+    uint64_t getFrameCount() const { return mFrameCount; };
+
+    const EnvelopeFrameHeader &getFrameHeader(const uint64_t frame) const { return *reinterpret_cast<const EnvelopeFrameHeader *>(getFrame(frame)); };
+    // octaves * bins values, [octave * bins + bin]
+    const float *getEnvelopes(const uint64_t frame) const { return reinterpret_cast<const float *>(getFrame(frame) + sizeof(EnvelopeFrameHeader)); };
+    const float *getMagnitudes(const uint64_t frame) const { return getEnvelopes(frame) + static_cast<size_t>(mHeader.bins) * mHeader.octaves; };
+
+private:
+    const unsigned char *getFrame(const uint64_t frame) const { return mData + sizeof(EnvelopeRecordingHeader) + frame * mFrameSize; };
+
+    EnvelopeRecordingHeader mHeader{};
+    uint64_t mFrameCount{0u};
+    size_t mFrameSize{0u};
+    const unsigned char *mData{nullptr};
+    size_t mSize{0u};
+#if HARMONIC_REVERB_MMAP
+    void *mMapping{nullptr};
+#else
+    std::vector<unsigned char> mBuffer;
+#endif
+};
+
+inline bool EnvelopeRecordingReader::open(const std::string &path)
+{
+    close();
+#if HARMONIC_REVERB_MMAP
+    const int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0)
+        return false;
+    struct stat status;
+    if (fstat(file, &status) != 0 || static_cast<size_t>(status.st_size) < sizeof(EnvelopeRecordingHeader))
+    {
+        ::close(file);
+        return false;
+    }
+    mSize = static_cast<size_t>(status.st_size);
+    void *mapping = mmap(nullptr, mSize, PROT_READ, MAP_SHARED, file, 0);
+    ::close(file);
+    if (mapping == MAP_FAILED)
+    {
+        mSize = 0u;
+        return false;
+    }
+    mMapping = mapping;
+    mData = static_cast<const unsigned char *>(mapping);
+#else
+    std::FILE *file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr)
+        return false;
+    std::fseek(file, 0, SEEK_END);
+    const long size = std::ftell(file);
+    std::fseek(file, 0, SEEK_SET);
+    mBuffer.resize(size > 0 ? static_cast<size_t>(size) : 0u);
+    const bool complete = std::fread(mBuffer.data(), 1u, mBuffer.size(), file) == mBuffer.size();
+    std::fclose(file);
+    if (!complete || mBuffer.size() < sizeof(EnvelopeRecordingHeader))
+    {
+        mBuffer.clear();
+        return false;
+    }
+    mSize = mBuffer.size();
+    mData = mBuffer.data();
+#endif
+
+    std::memcpy(&mHeader, mData, sizeof(EnvelopeRecordingHeader));
+    if (mHeader.magic != EnvelopeRecordingMagic || mHeader.version != EnvelopeRecordingVersion || mHeader.bins == 0u || mHeader.octaves == 0u)
+    {
+        close();
+        return false;
+    }
+    // the file is grown in chunks while recording, only counted frames are valid
+    mFrameSize = getEnvelopeFrameSize(mHeader.bins, mHeader.octaves);
+    const uint64_t framesInFile = (mSize - sizeof(EnvelopeRecordingHeader)) / mFrameSize;
+    mFrameCount = mHeader.frameCount < framesInFile ? mHeader.frameCount : framesInFile;
+    return true;
+}
+
+inline void EnvelopeRecordingReader::close()
+{
+#if HARMONIC_REVERB_MMAP
+    if (mMapping != nullptr)
+        munmap(mMapping, mSize);
+    mMapping = nullptr;
+#else
+    mBuffer.clear();
+#endif
+    mData = nullptr;
+    mSize = 0u;
+    mFrameCount = 0u;
+    mHeader = EnvelopeRecordingHeader{};
+}
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+
+#include "../submodules/rt-cqt/submodules/audio-utils/include/CplxWavetableOscillator.h"
+#include "StateBlob.h"
+
+// Oscillator policies for CqtReverb, chosen at compile time. A policy names the oscillator and the read-only
+// resource its instances share:
+//
+//   struct Policy
+//   {
+//       using Shared = ...;     // built once per process, see getSharedOscillatorResource
+//       using Oscillator = ...; // init(rate, const Shared*), setFrequency(hz), generateBlock(std::complex<double>*, n)
+//   };
+//
+// Oscillators produce exp(i * 2 pi * f * t) starting at phase zero. Oscillators whose phase is part of engine
+// checkpoints also provide writeState(StateWriter &) and readState(StateReader &), see CqtReverb::saveState.
+// HarmonicReverb/OscillatorBench.cpp measures cost and spurious tones of the policies below.
+
+// One resource of each type for all engines of the process, built on first use and released with the last engine
+template <typename Shared>
+inline std::shared_ptr<Shared> getSharedOscillatorResource()
+{
+    static std::mutex cacheMutex;
+    static std::weak_ptr<Shared> cachedResource;
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto resource = cachedResource.lock();
+    if (resource == nullptr)
+    {
+        resource = std::make_shared<Shared>();
+        cachedResource = resource;
+    }
+    return resource;
+}
+
+// The audio-utils wavetable oscillator, its phase is not accessible so checkpoints leave it running
+template <size_t TableSize>
+struct AudioUtilsWavetablePolicy
+{
+    using Shared = audio_utils::StaticCplxWavetable<TableSize>;
+    using Oscillator = audio_utils::CplxWavetableOscillator<TableSize>;
+};
+
+enum class TableInterpolation
+{
+    Nearest,
+    Linear
+};
+
+constexpr unsigned getTableBits(const size_t tableSize)
+{
+    unsigned bits = 0u;
+    for (size_t size = tableSize; size > 1u; size >>= 1u)
+        bits++;
+    return bits;
+}
+
+// One period of exp(i phi), with a guard point for interpolation
+template <size_t TableSize>
+class ComplexSineTable
+{
+public:
+    static_assert(TableSize >= 4u && (TableSize & (TableSize - 1u)) == 0u, "table size has to be a power of two");
+
+    ComplexSineTable()
+    {
+        const double twoPi = 6.283185307179586;
+        for (size_t i_entry = 0u; i_entry <= TableSize; i_entry++)
+        {
+            mTable[i_entry] = std::polar(1., twoPi * static_cast<double>(i_entry) / static_cast<double>(TableSize));
+        }
+    };
+
+    const std::complex<double> *data() const { return mTable.data(); };
+
+private:
+    std::array<std::complex<double>, TableSize + 1u> mTable;
+};
+
+// Table lookup with a 32 bit phase accumulator, the top bits index the table and the rest interpolate
+template <size_t TableSize, TableInterpolation Interpolation>
+class TableOscillator
+{
+public:
+    void init(const double samplerate, const ComplexSineTable<TableSize> *const table)
+    {
+        mSampleRate = samplerate;
+        mTable = table->data();
+        mPhase = 0u;
+    };
+
+    void setFrequency(const double frequency)
+    {
+        const double cycles = frequency / mSampleRate;
+        mIncrement = static_cast<uint32_t>(std::llround((cycles - std::floor(cycles)) * PhaseRange));
+    };
+
+    void generateBlock(std::complex<double> *const output, const size_t nSamples)
+    {
+        for (size_t i_sample = 0u; i_sample < nSamples; i_sample++)
+        {
+            if constexpr (Interpolation == TableInterpolation::Nearest)
+            {
+                // rounded, so the error is symmetric around each entry
+                output[i_sample] = mTable[((mPhase + (1u << (FracBits - 1u))) >> FracBits) & (TableSize - 1u)];
+            }
+            else
+            {
+                const uint32_t index = mPhase >> FracBits;
+                const double frac = static_cast<double>(mPhase & FracMask) * OneDivFracRange;
+                output[i_sample] = mTable[index] + (mTable[index + 1u] - mTable[index]) * frac;
+            }
+            mPhase += mIncrement;
+        }
+    };
+
+    void writeState(StateWriter &writer) const { writer.write(mPhase); };
+    bool readState(StateReader &reader) { return reader.read(mPhase); };
+
+private:
+    static constexpr unsigned FracBits{32u - getTableBits(TableSize)};
+    static constexpr uint32_t FracMask{(1u << FracBits) - 1u};
+    static constexpr double OneDivFracRange{1. / static_cast<double>(1ull << FracBits)};
+    static constexpr double PhaseRange{4294967296.};
+
+    const std::complex<double> *mTable{nullptr};
+    double mSampleRate{48000.};
+    uint32_t mPhase{0u};
+    uint32_t mIncrement{0u};
+};
+
+template <size_t TableSize, TableInterpolation Interpolation>
+struct WavetablePolicy
+{
+    using Shared = ComplexSineTable<TableSize>;
+    using Oscillator = TableOscillator<TableSize, Interpolation>;
+};
+
+// Recursive complex phasor, one complex multiply per sample and no table. The magnitude drifts with rounding,
+// so it is pulled back to one every RenormInterval samples by a Newton step.
+struct PhasorResource
+{
+};
+
+template <unsigned RenormInterval>
+class PhasorOscillator
+{
+public:
+    void init(const double samplerate, const PhasorResource *const)
+    {
+        mSampleRate = samplerate;
+        mPhasor = {1., 0.};
+        mCounter = 0u;
+    };
+
+    // keeps the current phase
+    void setFrequency(const double frequency)
+    {
+        mRotation = std::polar(1., 6.283185307179586 * frequency / mSampleRate);
+    };
+
+    void generateBlock(std::complex<double> *const output, const size_t nSamples)
+    {
+        for (size_t i_sample = 0u; i_sample < nSamples; i_sample++)
+        {
+            output[i_sample] = mPhasor;
+            mPhasor *= mRotation;
+            if (++mCounter == RenormInterval)
+            {
+                mPhasor *= 1.5 - 0.5 * std::norm(mPhasor);
+                mCounter = 0u;
+            }
+        }
+    };
+
+    void writeState(StateWriter &writer) const
+    {
+        writer.write(mPhasor);
+        writer.write(mCounter);
+    };
+    bool readState(StateReader &reader)
+    {
+        reader.read(mPhasor);
+        return reader.read(mCounter);
+    };
+
+private:
+    double mSampleRate{48000.};
+    std::complex<double> mPhasor{1., 0.};
+    std::complex<double> mRotation{1., 0.};
+    unsigned mCounter{0u};
+};
+
+template <unsigned RenormInterval>
+struct PhasorPolicy
+{
+    static_assert(RenormInterval > 0u, "renormalization interval has to be positive");
+    using Shared = PhasorResource;
+    using Oscillator = PhasorOscillator<RenormInterval>;
+};
+
+// Whether an oscillator's phase can be checkpointed
+template <typename Oscillator, typename = void>
+struct HasOscillatorState : std::false_type
+{
+};
+
+template <typename Oscillator>
+struct HasOscillatorState<Oscillator, std::void_t<decltype(std::declval<Oscillator &>().readState(std::declval<StateReader &>()))>> : std::true_type
+{
+};
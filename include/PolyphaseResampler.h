@@ -0,0 +1,161 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+#include "StateBlob.h"
+
+// Streaming rational resampler (Up / Down) with a Kaiser windowed sinc prototype split into polyphase branches.
+// Only the branch needed for each output sample is evaluated, so the cost is TapsPerPhase per output sample.
+class PolyphaseResampler
+{
+public:
+    PolyphaseResampler() = default;
+    ~PolyphaseResampler() = default;
+
+    // Returns false if the ratio of the (integer) rates needs more than MaxPhases branches
+    bool init(const double inputRate, const double outputRate);
+    void reset();
+
+    // Returns the number of samples written to output, at most getMaxOutputSamples(nInput)
+    int process(const double *const input, const int nInput, double *const output);
+
+    int getMaxOutputSamples(const int nInput) const { return (nInput * mUp) / mDown + 1; };
+    double getRatio() const { return static_cast<double>(mUp) / static_cast<double>(mDown); };
+
+    // Filter history and phase, the ratio has to match the one of the writing instance
+    void writeState(StateWriter &writer) const;
+    bool readState(StateReader &reader);
+
+private:
+    static constexpr int TapsPerPhase{32};
+    static constexpr int MaxPhases{1024};
+    static constexpr double KaiserBeta{8.};
+    static constexpr double PassbandFraction{0.9};
+    static constexpr double Pi{3.14159265358979323846};
+
+    static double besselI0(const double x);
+
+    int mUp{1};
+    int mDown{1};
+    int mPhase{0};
+
+    std::vector<double> mCoefficients; // [phase][tap], taps reversed so they run forward over the history
+    std::vector<double> mHistory;      // last TapsPerPhase samples, stored twice to always read a contiguous window
+    int mHistoryIndex{0};
+};
+
+inline bool PolyphaseResampler::init(const double inputRate, const double outputRate)
+{
+    const long inputRateInt = std::lround(inputRate);
+    const long outputRateInt = std::lround(outputRate);
+    if (inputRateInt <= 0 || outputRateInt <= 0)
+        return false;
+    const long divisor = std::gcd(inputRateInt, outputRateInt);
+    if (outputRateInt / divisor > MaxPhases || inputRateInt / divisor > MaxPhases)
+        return false;
+    mUp = static_cast<int>(outputRateInt / divisor);
+    mDown = static_cast<int>(inputRateInt / divisor);
+
+    // Prototype runs at the upsampled rate, cutoff below the lower of both Nyquist frequencies
+    const int nTaps = mUp * TapsPerPhase;
+    const double cutoff = 0.5 * PassbandFraction / static_cast<double>(std::max(mUp, mDown));
+    const double center = 0.5 * static_cast<double>(nTaps - 1);
+    const double oneDivI0Beta = 1. / besselI0(KaiserBeta);
+    std::vector<double> prototype(nTaps, 0.);
+    for (int i_tap = 0; i_tap < nTaps; i_tap++)
+    {
+        const double t = static_cast<double>(i_tap) - center;
+        const double x = 2. * cutoff * t;
+        const double sinc = std::abs(x) < 1e-12 ? 1. : std::sin(Pi * x) / (Pi * x);
+        const double windowPos = t / center;
+        const double window = besselI0(KaiserBeta * std::sqrt(std::max(0., 1. - windowPos * windowPos))) * oneDivI0Beta;
+        prototype[i_tap] = 2. * cutoff * sinc * window * static_cast<double>(mUp);
+    }
+
+    mCoefficients.resize(mUp * TapsPerPhase);
+    for (int i_phase = 0; i_phase < mUp; i_phase++)
+    {
+        for (int i_tap = 0; i_tap < TapsPerPhase; i_tap++)
+        {
+            mCoefficients[i_phase * TapsPerPhase + (TapsPerPhase - 1 - i_tap)] = prototype[i_phase + i_tap * mUp];
+        }
+    }
+    mHistory.resize(2 * TapsPerPhase);
+    reset();
+    return true;
+}
+
+inline void PolyphaseResampler::reset()
+{
+    std::fill(mHistory.begin(), mHistory.end(), 0.);
+    mHistoryIndex = 0;
+    mPhase = 0;
+}
+
+inline int PolyphaseResampler::process(const double *const input, const int nInput, double *const output)
+{
+    int nOutput = 0;
+    for (int i_sample = 0; i_sample < nInput; i_sample++)
+    {
+        mHistory[mHistoryIndex] = input[i_sample];
+        mHistory[mHistoryIndex + TapsPerPhase] = input[i_sample];
+        mHistoryIndex = mHistoryIndex + 1 == TapsPerPhase ? 0 : mHistoryIndex + 1;
+        const double *const window = mHistory.data() + mHistoryIndex; // oldest to newest
+
+        while (mPhase < mUp)
+        {
+            const double *const coefficients = mCoefficients.data() + mPhase * TapsPerPhase;
+            double sum = 0.;
+#pragma omp simd reduction(+ : sum)
+            for (int i_tap = 0; i_tap < TapsPerPhase; i_tap++)
+            {
+                sum += coefficients[i_tap] * window[i_tap];
+            }
+            output[nOutput++] = sum;
+            mPhase += mDown;
+        }
+        mPhase -= mUp;
+    }
+    return nOutput;
+}
+
+inline void PolyphaseResampler::writeState(StateWriter &writer) const
+{
+    writer.write(mUp);
+    writer.write(mDown);
+    writer.write(mPhase);
+    writer.write(mHistoryIndex);
+    writer.write(mHistory.data(), mHistory.size());
+}
+
+inline bool PolyphaseResampler::readState(StateReader &reader)
+{
+    int up = 0;
+    int down = 0;
+    reader.read(up);
+    reader.read(down);
+    if (!reader.isValid() || up != mUp || down != mDown)
+        return false;
+    reader.read(mPhase);
+    reader.read(mHistoryIndex);
+    reader.read(mHistory.data(), mHistory.size());
+    return reader.isValid();
+}
+
+inline double PolyphaseResampler::besselI0(const double x)
+{
+    double sum = 1.;
+    double term = 1.;
+    const double halfX = 0.5 * x;
+    for (int k = 1; k < 32; k++)
+    {
+        term *= (halfX / static_cast<double>(k)) * (halfX / static_cast<double>(k));
+        sum += term;
+        if (term < 1e-12 * sum)
+            break;
+    }
+    return sum;
+}
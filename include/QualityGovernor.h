@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+// Quality tiers, each one includes the reductions of the tiers below
+enum QualityTier : unsigned
+{
+    QualityFull = 0u,
+    QualityReducedPartials, // quiet partials are not synthesized
+    QualityCoarseEnvelopes, // envelopes advance once per EnvelopeStride samples
+    QualityMergedBins,      // bins of the lowest octaves are merged in groups, see MergedBinGroup
+    QualityTierNumber
+};
+
+// Measures the cost of each audio callback against its deadline and steps through the quality tiers.
+// A tier is dropped as soon as the smoothed load exceeds the budget or a single callback misses its deadline,
+// and only regained after the load stayed well below the budget for StepUpTime.
+class QualityGovernor
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    QualityGovernor() = default;
+    ~QualityGovernor() = default;
+
+    void init(const double samplerate);
+    void reset();
+
+    // Fraction of the callback deadline the engine may use, 0.1 .. 1
+    void setBudget(const double budget) { mBudget = std::clamp(budget, 0.1, 1.); };
+
+    Clock::time_point beginBlock() const { return Clock::now(); };
+    void endBlock(const Clock::time_point start, const int nSamples);
+
+    // Safe to call from any thread
+    unsigned getTier() const { return mTier.load(std::memory_order_relaxed); };
+    double getLoad() const { return mLoadDisplay.load(std::memory_order_relaxed); };
+
+private:
+    static constexpr double LoadSmoothing{0.1};   // one-pole factor per callback
+    static constexpr double StepUpHeadroom{0.6};  // load must stay below this fraction of the budget to step up
+    static constexpr double StepUpTime{2.};       // seconds
+    static constexpr double StepDownHoldTime{0.1}; // seconds between two downward steps, lets the load settle
+
+    double mSampleRate{48000.};
+    double mBudget{0.7};
+    double mLoad{0.};
+    double mTimeSinceStep{0.};
+    double mTimeWithHeadroom{0.};
+
+    std::atomic<unsigned> mTier{QualityFull};
+    std::atomic<double> mLoadDisplay{0.};
+};
+
+inline void QualityGovernor::init(const double samplerate)
+{
+    mSampleRate = samplerate;
+    reset();
+}
+
+inline void QualityGovernor::reset()
+{
+    mLoad = 0.;
+    mTimeSinceStep = 0.;
+    mTimeWithHeadroom = 0.;
+    mTier.store(QualityFull, std::memory_order_relaxed);
+    mLoadDisplay.store(0., std::memory_order_relaxed);
+}
+
+inline void QualityGovernor::endBlock(const Clock::time_point start, const int nSamples)
+{
+    if (nSamples <= 0)
+        return;
+    const double blockTime = static_cast<double>(nSamples) / mSampleRate;
+    const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    const double load = elapsed / blockTime;
+    mLoad += LoadSmoothing * (load - mLoad);
+    mLoadDisplay.store(mLoad, std::memory_order_relaxed);
+    mTimeSinceStep += blockTime;
+
+    unsigned tier = mTier.load(std::memory_order_relaxed);
+    const bool overshoot = mLoad > mBudget || load > 1.;
+    if (overshoot && tier + 1u < QualityTierNumber && mTimeSinceStep >= StepDownHoldTime)
+    {
+        tier++;
+        mTimeSinceStep = 0.;
+        mTimeWithHeadroom = 0.;
+    }
+    else if (!overshoot && mLoad < StepUpHeadroom * mBudget)
+    {
+        mTimeWithHeadroom += blockTime;
+        if (tier > QualityFull && mTimeWithHeadroom >= StepUpTime)
+        {
+            tier--;
+            mTimeSinceStep = 0.;
+            mTimeWithHeadroom = 0.;
+        }
+    }
+    else
+    {
+        mTimeWithHeadroom = 0.;
+    }
+    mTier.store(tier, std::memory_order_relaxed);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+// Debug checks for code that runs on the audio thread, enabled with the HARMONIC_REVERB_REALTIME_CHECKS build option.
+// While a ScopedRealtimeCheck is alive on a thread, every heap allocation, deallocation and blocking lock made by
+// that thread is reported with a stack trace. Without the option the scope compiles to nothing.
+// HarmonicReverb/RealtimeStressTest.cpp drives bare engines and the processor under these checks.
+class ScopedRealtimeCheck
+{
+public:
+#if HARMONIC_REVERB_REALTIME_CHECKS
+    ScopedRealtimeCheck() { enter(); };
+    ~ScopedRealtimeCheck() { leave(); };
+
+    // Number of violations reported since the start of the process
+    static unsigned long getViolationCount();
+
+private:
+    static void enter();
+    static void leave();
+#else
+    ScopedRealtimeCheck() = default;
+    ~ScopedRealtimeCheck() = default;
+
+    static unsigned long getViolationCount() { return 0ul; };
+#endif
+
+public:
+    ScopedRealtimeCheck(const ScopedRealtimeCheck &) = delete;
+    ScopedRealtimeCheck &operator=(const ScopedRealtimeCheck &) = delete;
+};
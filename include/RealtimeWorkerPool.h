@@ -0,0 +1,385 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <climits>
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <dispatch/dispatch.h>
+#include <pthread.h>
+#include <sched.h>
+#else
+#include <cerrno>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#endif
+
+#include "Tracing.h"
+
+// Fixed-size worker pool for the audio callback, shared by all plugin instances of the process.
+// Any number of threads may call parallelFor at the same time, up to MaxJobs jobs are published at once and idle
+// workers take tasks from whichever job has some left. This shared job table stands in for per-thread deques with
+// stealing: jobs are a few dozen equal tasks, so one claim counter per job balances them just as well. The calling thread always takes part in its own job, so a
+// dispatch never depends on a worker waking up: if no worker is idle or no job slot is free, all tasks simply run
+// inline. Calling threads never take a lock.
+// Waiting is spin first, then block: idle workers spin for WorkerSpinTime and then sleep on a condition variable until
+// the next job is published, without a timeout, so an idle pool costs nothing. A caller whose tasks are still running
+// on workers spins for CallerSpinTime and then waits on a semaphore the worker finishing the last task posts. Posting
+// and waiting on a semaphore take no lock, unlike a condition variable.
+// Workers ask for realtime priority, as the caller waits for the tasks they have taken. Where the system refuses it
+// (e.g. no rtprio limit on Linux) they keep the default priority.
+class RealtimeWorkerPool
+{
+public:
+    using TaskFunction = void (*)(void *context, const unsigned taskIndex);
+    using ThreadInitFunction = void (*)(void *context);
+
+    RealtimeWorkerPool() = default;
+    ~RealtimeWorkerPool() { stop(); };
+
+    RealtimeWorkerPool(const RealtimeWorkerPool &) = delete;
+    RealtimeWorkerPool &operator=(const RealtimeWorkerPool &) = delete;
+
+    void start(const unsigned nWorkers);
+    void stop();
+
+    unsigned getNumWorkers() const { return static_cast<unsigned>(mWorkers.size()); };
+
+    // Runs task(context, i) for i in [0, nTasks) and returns once all of them are finished.
+    // Tasks may call parallelFor themselves.
+    void parallelFor(const unsigned nTasks, TaskFunction task, void *context);
+
+    template <typename Callable>
+    void parallelFor(const unsigned nTasks, Callable &callable)
+    {
+        parallelFor(
+            nTasks, [](void *c, const unsigned i)
+            { (*static_cast<Callable *>(c))(i); },
+            &callable);
+    };
+
+    // Every worker calls function(context) on itself before its next job, e.g. to join the host's audio
+    // workgroup. Not realtime safe, the context has to outlive the pool or the next call.
+    void setThreadInit(ThreadInitFunction function, void *context);
+
+private:
+    using Clock = std::chrono::steady_clock;
+    static constexpr std::chrono::microseconds WorkerSpinTime{50};
+    static constexpr std::chrono::microseconds CallerSpinTime{20};
+    static constexpr unsigned MaxJobs{64u};
+
+    // Counting semaphore of the platform, post never blocks
+    class Semaphore
+    {
+    public:
+#if defined(_WIN32)
+        Semaphore() : mHandle(CreateSemaphore(nullptr, 0, LONG_MAX, nullptr)){};
+        ~Semaphore() { CloseHandle(mHandle); };
+        void post() { ReleaseSemaphore(mHandle, 1, nullptr); };
+        void wait() { WaitForSingleObject(mHandle, INFINITE); };
+
+    private:
+        HANDLE mHandle;
+#elif defined(__APPLE__)
+        Semaphore() : mSemaphore(dispatch_semaphore_create(0)){};
+        ~Semaphore() { dispatch_release(mSemaphore); };
+        void post() { dispatch_semaphore_signal(mSemaphore); };
+        void wait() { dispatch_semaphore_wait(mSemaphore, DISPATCH_TIME_FOREVER); };
+
+    private:
+        dispatch_semaphore_t mSemaphore;
+#else
+        Semaphore() { sem_init(&mSemaphore, 0, 0); };
+        ~Semaphore() { sem_destroy(&mSemaphore); };
+        void post() { sem_post(&mSemaphore); };
+        void wait()
+        {
+            while (sem_wait(&mSemaphore) != 0 && errno == EINTR)
+            {
+            }
+        };
+
+    private:
+        sem_t mSemaphore;
+#endif
+
+    public:
+        Semaphore(const Semaphore &) = delete;
+        Semaphore &operator=(const Semaphore &) = delete;
+    };
+
+    // One published parallelFor.
+    // nextTask holds the job generation in its upper 32 bits, so a worker that arrives late
+    // can never claim a task index of a newer job it has not seen being published.
+    // tasks carries the task count together with its generation, so a late claim never compares against the count of a newer job.
+    struct alignas(64) Job
+    {
+        std::atomic<bool> claimed{false};
+        std::atomic<uint32_t> generation{0u};
+        std::atomic<uint64_t> nextTask{0u};
+        std::atomic<uint64_t> tasks{0u};
+        std::atomic<unsigned> tasksPending{0u};
+        TaskFunction task{nullptr};
+        void *context{nullptr};
+        // Set by a caller about to wait, taken by whoever finishes the last task, who then posts finished
+        std::atomic<bool> callerWaiting{false};
+        Semaphore finished;
+    };
+
+    Job *claimJob();
+    bool runTasks(Job &job, const uint32_t generation);
+    void wakeWorkers();
+    void workerLoop();
+    static void setRealtimePriority(std::thread &thread);
+
+    std::vector<std::thread> mWorkers;
+    std::atomic<bool> mRunning{false};
+
+    Job mJobs[MaxJobs];
+    std::atomic<uint32_t> mPublished{0u}; // advances with every job, idle workers wait for it to move
+    std::atomic<unsigned> mIdleWorkers{0u};
+    std::atomic<unsigned> mSleepingWorkers{0u}; // parked on mWakeUp, only then does a dispatch notify
+
+    std::mutex mThreadInitMutex;
+    ThreadInitFunction mThreadInit{nullptr};
+    void *mThreadInitContext{nullptr};
+    std::atomic<uint32_t> mThreadInitGeneration{0u};
+
+    // Only used to park idle workers, the dispatching thread at most tries it
+    std::mutex mSleepMutex;
+    std::condition_variable mWakeUp;
+};
+
+// One pool for all instances in the process, one worker per core besides the calling thread.
+// Built on first use and stopped with its last user. Not realtime safe.
+inline std::shared_ptr<RealtimeWorkerPool> getSharedWorkerPool()
+{
+    static std::mutex poolMutex;
+    static std::weak_ptr<RealtimeWorkerPool> sharedPool;
+    std::lock_guard<std::mutex> lock(poolMutex);
+    auto pool = sharedPool.lock();
+    if (pool == nullptr)
+    {
+        pool = std::make_shared<RealtimeWorkerPool>();
+        pool->start(std::max(1u, std::thread::hardware_concurrency()) - 1u);
+        sharedPool = pool;
+    }
+    return pool;
+}
+
+inline void RealtimeWorkerPool::start(const unsigned nWorkers)
+{
+    if (nWorkers == getNumWorkers() && mRunning.load())
+        return;
+    stop();
+    mRunning.store(true);
+    mWorkers.reserve(nWorkers);
+    for (unsigned i_worker = 0u; i_worker < nWorkers; i_worker++)
+    {
+        mWorkers.emplace_back([this]
+                              { workerLoop(); });
+        setRealtimePriority(mWorkers.back());
+    }
+}
+
+// Between normal threads and the host's audio threads, which usually sit at the top of the range
+inline void RealtimeWorkerPool::setRealtimePriority(std::thread &thread)
+{
+#if defined(_WIN32)
+    SetThreadPriority(static_cast<HANDLE>(thread.native_handle()), THREAD_PRIORITY_TIME_CRITICAL);
+#else
+    const int minPriority = sched_get_priority_min(SCHED_FIFO);
+    const int maxPriority = sched_get_priority_max(SCHED_FIFO);
+    if (minPriority < 0 || maxPriority < minPriority)
+        return;
+    sched_param param{};
+    param.sched_priority = minPriority + (maxPriority - minPriority) / 2;
+    pthread_setschedparam(thread.native_handle(), SCHED_FIFO, &param);
+#endif
+}
+
+inline void RealtimeWorkerPool::stop()
+{
+    if (!mRunning.exchange(false))
+        return;
+    {
+        // parked workers see mRunning either before they sleep or in their wait
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+    }
+    mWakeUp.notify_all();
+    for (auto &worker : mWorkers)
+    {
+        if (worker.joinable())
+            worker.join();
+    }
+    mWorkers.clear();
+}
+
+inline void RealtimeWorkerPool::setThreadInit(ThreadInitFunction function, void *context)
+{
+    {
+        std::lock_guard<std::mutex> lock(mThreadInitMutex);
+        mThreadInit = function;
+        mThreadInitContext = context;
+        mThreadInitGeneration.fetch_add(1u, std::memory_order_release);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+    }
+    mWakeUp.notify_all();
+}
+
+inline void RealtimeWorkerPool::parallelFor(const unsigned nTasks, TaskFunction task, void *context)
+{
+    if (nTasks == 0u)
+        return;
+    Job *job = nullptr;
+    if (nTasks > 1u && mIdleWorkers.load(std::memory_order_relaxed) > 0u)
+        job = claimJob();
+    if (job == nullptr)
+    {
+        for (unsigned i_task = 0u; i_task < nTasks; i_task++)
+            task(context, i_task);
+        return;
+    }
+
+    const uint32_t generation = job->generation.load(std::memory_order_relaxed) + 1u;
+    job->task = task;
+    job->context = context;
+    job->tasks.store((static_cast<uint64_t>(generation) << 32) | nTasks, std::memory_order_relaxed);
+    job->tasksPending.store(nTasks, std::memory_order_relaxed);
+    job->nextTask.store(static_cast<uint64_t>(generation) << 32, std::memory_order_release);
+    job->generation.store(generation, std::memory_order_release);
+    // Pairs with the sleeping count and the wait predicate, either the worker sees the new job or this thread
+    // sees the worker parked. Spinning workers find the job without a system call.
+    mPublished.fetch_add(1u);
+    if (mSleepingWorkers.load() > 0u)
+        wakeWorkers();
+
+    runTasks(*job, generation);
+
+    // Remaining tasks are already running on workers, they take a few microseconds at most or a whole octave or channel
+    {
+        ScopedTrace waitTrace("wait");
+        const Clock::time_point spinEnd = Clock::now() + CallerSpinTime;
+        while (job->tasksPending.load(std::memory_order_acquire) != 0u && Clock::now() < spinEnd)
+            std::this_thread::yield();
+        if (job->tasksPending.load(std::memory_order_acquire) != 0u)
+        {
+            // Either the last task sees the flag and posts, or this thread sees the tasks finished and takes the flag
+            // back. If both race for the flag and the worker wins, its post is still coming and has to be consumed.
+            job->callerWaiting.store(true);
+            if (job->tasksPending.load() != 0u || !job->callerWaiting.exchange(false))
+                job->finished.wait();
+        }
+    }
+    job->claimed.store(false, std::memory_order_release);
+}
+
+// A worker between its predicate check and its wait holds the sleep mutex. If the dispatcher gets the mutex, no worker
+// is in that window and the notify reaches all sleepers. If not, one worker may miss this job and sleep until the next
+// one. That only costs parallelism: the dispatcher runs every task nobody claimed. Blocking on the mutex here would
+// make the audio thread wait for a worker's lock.
+inline void RealtimeWorkerPool::wakeWorkers()
+{
+    if (mSleepMutex.try_lock())
+        mSleepMutex.unlock();
+    mWakeUp.notify_all();
+}
+
+// Callers start their search at different slots, so concurrent callers rarely contend
+inline RealtimeWorkerPool::Job *RealtimeWorkerPool::claimJob()
+{
+    static thread_local unsigned firstSlot = static_cast<unsigned>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    for (unsigned i_slot = 0u; i_slot < MaxJobs; i_slot++)
+    {
+        Job &job = mJobs[(firstSlot + i_slot) % MaxJobs];
+        bool expected = false;
+        if (!job.claimed.load(std::memory_order_relaxed) && job.claimed.compare_exchange_strong(expected, true, std::memory_order_acquire))
+            return &job;
+    }
+    return nullptr;
+}
+
+// Returns whether any task was run
+inline bool RealtimeWorkerPool::runTasks(Job &job, const uint32_t generation)
+{
+    bool ranTask = false;
+    uint64_t next = job.nextTask.load(std::memory_order_acquire);
+    while (true)
+    {
+        // Finished and stale jobs are only read, so scanning workers do not bounce their cache lines.
+        // The claim compares the whole word, generation included, so a worker preempted after these checks
+        // fails against a newer job instead of taking its first index.
+        const uint64_t tasks = job.tasks.load(std::memory_order_acquire);
+        if (static_cast<uint32_t>(next >> 32) != generation || static_cast<uint32_t>(tasks >> 32) != generation ||
+            static_cast<unsigned>(next & 0xffffffffu) >= static_cast<unsigned>(tasks & 0xffffffffu))
+            return ranTask;
+        if (!job.nextTask.compare_exchange_weak(next, next + 1u, std::memory_order_acq_rel, std::memory_order_acquire))
+            continue;
+
+        const unsigned i_task = static_cast<unsigned>(next & 0xffffffffu);
+        next++;
+        {
+            ScopedTrace taskTrace("task", static_cast<int>(i_task));
+            job.task(job.context, i_task);
+        }
+        if (job.tasksPending.fetch_sub(1u) == 1u && job.callerWaiting.exchange(false))
+            job.finished.post();
+        ranTask = true;
+    }
+}
+
+inline void RealtimeWorkerPool::workerLoop()
+{
+    uint32_t threadInitGeneration = 0u;
+    while (mRunning.load(std::memory_order_relaxed))
+    {
+        if (mThreadInitGeneration.load(std::memory_order_acquire) != threadInitGeneration)
+        {
+            std::lock_guard<std::mutex> lock(mThreadInitMutex);
+            threadInitGeneration = mThreadInitGeneration.load(std::memory_order_relaxed);
+            if (mThreadInit != nullptr)
+                mThreadInit(mThreadInitContext);
+        }
+
+        // Jobs published after this point move the counter, so none is missed between the scan and the wait
+        const uint32_t published = mPublished.load(std::memory_order_acquire);
+        bool ranTask = false;
+        for (Job &job : mJobs)
+            ranTask = runTasks(job, job.generation.load(std::memory_order_acquire)) || ranTask;
+        if (ranTask)
+            continue;
+
+        // Spin shortly, the jobs of one callback follow each other closely
+        mIdleWorkers.fetch_add(1u, std::memory_order_relaxed);
+        const Clock::time_point spinEnd = Clock::now() + WorkerSpinTime;
+        while (mPublished.load(std::memory_order_acquire) == published && mRunning.load(std::memory_order_relaxed) && Clock::now() < spinEnd)
+            std::this_thread::yield();
+        if (mPublished.load(std::memory_order_acquire) == published)
+        {
+            // Sleeps until the next job, see wakeWorkers for the one wake-up that can be missed
+            std::unique_lock<std::mutex> lock(mSleepMutex);
+            mSleepingWorkers.fetch_add(1u);
+            mWakeUp.wait(lock, [this, published, threadInitGeneration]
+                         { return mPublished.load() != published || !mRunning.load() ||
+                                  mThreadInitGeneration.load(std::memory_order_acquire) != threadInitGeneration; });
+            mSleepingWorkers.fetch_sub(1u, std::memory_order_relaxed);
+        }
+        mIdleWorkers.fetch_sub(1u, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// History of per-hop bin gains for the waterfall display, written by one engine on the audio thread and read by
+// the GUI. Values are relaxed atomics, so neither side ever waits; a reader that falls more than Capacity frames
+// behind simply loses the oldest ones, and a frame overwritten while being read is reported as such.
+template <unsigned B, unsigned OctaveNumber, unsigned Capacity = 512u>
+class SpectralHistory
+{
+public:
+    SpectralHistory() = default;
+    ~SpectralHistory() = default;
+
+    // values are [OctaveNumber][B], audio thread only
+    void push(const double *const values)
+    {
+        const uint64_t frame = mWriteCount.load(std::memory_order_relaxed);
+        mWriteStarted.store(frame + 1u, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::atomic<float> *const slot = mFrames[frame % Capacity];
+        for (unsigned i_bin = 0u; i_bin < OctaveNumber * B; i_bin++)
+        {
+            slot[i_bin].store(static_cast<float>(values[i_bin]), std::memory_order_relaxed);
+        }
+        mWriteCount.store(frame + 1u, std::memory_order_release);
+    };
+
+    // Number of frames pushed so far, frame n is readable while n + Capacity > getWriteCount()
+    uint64_t getWriteCount() const { return mWriteCount.load(std::memory_order_acquire); };
+
+    // Copies frame n into values ([OctaveNumber][B]), false if it is no longer (or not yet) in the history
+    bool readFrame(const uint64_t frame, float *const values) const
+    {
+        if (frame >= getWriteCount())
+            return false;
+        const std::atomic<float> *const slot = mFrames[frame % Capacity];
+        for (unsigned i_bin = 0u; i_bin < OctaveNumber * B; i_bin++)
+        {
+            values[i_bin] = slot[i_bin].load(std::memory_order_relaxed);
+        }
+        // the writer may have started on frame + Capacity, which reuses the slot, during the copy
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return frame + Capacity >= mWriteStarted.load(std::memory_order_relaxed);
+    };
+
+private:
+    std::atomic<uint64_t> mWriteCount{0u};
+    std::atomic<uint64_t> mWriteStarted{0u}; // frames whose write has begun, seqlock style
+    std::atomic<float> mFrames[Capacity][OctaveNumber * B]{};
+};
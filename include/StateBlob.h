@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// Flat binary serialization of trivially copyable engine state, in native byte order.
+// Blobs are meant for checkpoints within one build on one machine, not as a portable file format.
+class StateWriter
+{
+public:
+    explicit StateWriter(std::vector<unsigned char> &blob) : mBlob(&blob) {};
+    // Only counts the bytes, e.g. to check the size of a blob without allocating
+    StateWriter() = default;
+
+    template <typename T>
+    void write(const T &value) { write(&value, 1u); };
+
+    template <typename T>
+    void write(const T *const values, const size_t n)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "state has to be trivially copyable");
+        mSize += n * sizeof(T);
+        if (mBlob == nullptr)
+            return;
+        const size_t offset = mBlob->size();
+        mBlob->resize(offset + n * sizeof(T));
+        if (n > 0u)
+            std::memcpy(mBlob->data() + offset, values, n * sizeof(T));
+    };
+
+    size_t getSize() const { return mSize; };
+
+private:
+    std::vector<unsigned char> *mBlob{nullptr};
+    size_t mSize{0u};
+};
+
+// Every read checks the remaining size, a failed read leaves the destination untouched and fails all further reads
+class StateReader
+{
+public:
+    StateReader(const unsigned char *const data, const size_t size) : mData(data), mSize(size) {};
+
+    template <typename T>
+    bool read(T &value) { return read(&value, 1u); };
+
+    template <typename T>
+    bool read(T *const values, const size_t n)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "state has to be trivially copyable");
+        if (!mValid || n * sizeof(T) > mSize - mPosition)
+        {
+            mValid = false;
+            return false;
+        }
+        if (n > 0u)
+            std::memcpy(values, mData + mPosition, n * sizeof(T));
+        mPosition += n * sizeof(T);
+        return true;
+    };
+
+    bool isValid() const { return mValid; };
+    bool isAtEnd() const { return mPosition == mSize; };
+
+private:
+    const unsigned char *const mData;
+    const size_t mSize;
+    size_t mPosition{0u};
+    bool mValid{true};
+};
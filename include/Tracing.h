@@ -0,0 +1,295 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Timeline tracing of audio callbacks, engine hops and stages and worker tasks, enabled with the
+// HARMONIC_REVERB_TRACING build option. Every thread writes begin/end events into its own lock-free ring, and a
+// background thread drains the rings into a Chrome trace-event JSON file that chrome://tracing or Perfetto open.
+// Event names have to be string literals. Without the option the trace scopes compile to nothing.
+//
+// A thread claims its ring with its first event while tracing, which registers a thread exit handler once and is
+// the only step that may allocate.
+class Tracer
+{
+public:
+    static Tracer &get()
+    {
+        static Tracer tracer;
+        return tracer;
+    };
+
+    // Starts a trace into path, or joins the one already running. Not realtime safe.
+    bool start(const std::string &path);
+    // The trace is closed when the last user stops
+    void stop();
+    bool isTracing() const { return mTracing.load(std::memory_order_relaxed); };
+
+    // Realtime safe, events of a full ring or of threads beyond MaxThreads are dropped and counted.
+    // index shows up as an argument of the event, e.g. the channel or octave, -1 leaves it out.
+    void begin(const char *const name, const int index = -1) { record(name, index, 'B'); };
+    void end(const char *const name, const int index = -1) { record(name, index, 'E'); };
+
+    Tracer(const Tracer &) = delete;
+    Tracer &operator=(const Tracer &) = delete;
+
+private:
+    static constexpr unsigned MaxThreads{32u};
+    static constexpr uint32_t RingCapacity{8192u}; // events per thread, power of two
+    static constexpr int FlushPeriodMs{10};
+
+    struct Event
+    {
+        const char *name;
+        uint64_t timestamp; // ns since the start of the trace
+        int32_t index;
+        char phase;
+    };
+
+    // Single producer, the owning thread, and single consumer, the flush thread
+    struct ThreadRing
+    {
+        std::atomic<bool> claimed{false};
+        std::atomic<bool> busy{false}; // the owner is between its tracing check and its write
+        std::atomic<uint32_t> writeIndex{0u};
+        std::atomic<uint32_t> readIndex{0u};
+        std::unique_ptr<Event[]> events;
+    };
+
+    // Gives the ring back when its thread exits
+    struct ThreadSlot
+    {
+        int ring{-1};
+        uint32_t generation{0u}; // trace in which claiming last failed
+        ~ThreadSlot()
+        {
+            if (ring >= 0)
+                Tracer::get().mRings[ring].claimed.store(false, std::memory_order_release);
+        };
+    };
+
+    Tracer() = default;
+    ~Tracer();
+
+    void record(const char *const name, const int index, const char phase);
+    int getThreadRing();
+    void flushLoop();
+    void flush();
+
+    ThreadRing mRings[MaxThreads];
+    std::atomic<bool> mTracing{false};
+    std::atomic<uint32_t> mGeneration{0u};
+    std::atomic<uint64_t> mDroppedEvents{0u};
+    std::chrono::steady_clock::time_point mStartTime;
+
+    // Start and stop only
+    std::mutex mControlMutex;
+    unsigned mUsers{0u};
+    std::atomic<bool> mFlushing{false};
+    std::thread mFlusher;
+
+    // Flush thread only while tracing
+    std::FILE *mFile{nullptr};
+    bool mFirstEvent{true};
+};
+
+inline Tracer::~Tracer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mControlMutex);
+        mUsers = mUsers > 0u ? 1u : 0u;
+    }
+    stop();
+}
+
+inline bool Tracer::start(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(mControlMutex);
+    if (mUsers > 0u)
+    {
+        mUsers++;
+        return true;
+    }
+    mFile = std::fopen(path.c_str(), "w");
+    if (mFile == nullptr)
+        return false;
+
+    // no producer writes while not tracing, see stop
+    for (ThreadRing &ring : mRings)
+    {
+        if (ring.events == nullptr)
+            ring.events = std::make_unique<Event[]>(RingCapacity);
+        ring.writeIndex.store(0u, std::memory_order_relaxed);
+        ring.readIndex.store(0u, std::memory_order_relaxed);
+    }
+    mDroppedEvents.store(0u, std::memory_order_relaxed);
+    mStartTime = std::chrono::steady_clock::now();
+    mFirstEvent = true;
+    std::fputs("[\n", mFile);
+
+    mUsers = 1u;
+    mGeneration.fetch_add(1u);
+    mFlushing.store(true);
+    mFlusher = std::thread([this]
+                           { flushLoop(); });
+    mTracing.store(true);
+    return true;
+}
+
+inline void Tracer::stop()
+{
+    std::lock_guard<std::mutex> lock(mControlMutex);
+    if (mUsers == 0u || --mUsers > 0u)
+        return;
+
+    // a producer that saw the tracing flag has raised its busy flag before looking at it
+    mTracing.store(false);
+    for (ThreadRing &ring : mRings)
+    {
+        while (ring.busy.load())
+            std::this_thread::yield();
+    }
+    mFlushing.store(false);
+    mFlusher.join();
+
+    const double endUs = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - mStartTime).count()) * 1e-3;
+    std::fprintf(mFile, "%s{\"name\":\"dropped events\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":0,\"args\":{\"count\":%llu}}\n]\n",
+                 mFirstEvent ? "" : ",\n", endUs, static_cast<unsigned long long>(mDroppedEvents.load()));
+    std::fclose(mFile);
+    mFile = nullptr;
+}
+
+inline void Tracer::record(const char *const name, const int index, const char phase)
+{
+    if (!mTracing.load(std::memory_order_relaxed))
+        return;
+    const int ringIndex = getThreadRing();
+    if (ringIndex < 0)
+    {
+        mDroppedEvents.fetch_add(1u, std::memory_order_relaxed);
+        return;
+    }
+    ThreadRing &ring = mRings[ringIndex];
+    ring.busy.store(true);
+    if (!mTracing.load())
+    {
+        ring.busy.store(false, std::memory_order_release);
+        return;
+    }
+    const uint32_t write = ring.writeIndex.load(std::memory_order_relaxed);
+    if (write - ring.readIndex.load(std::memory_order_acquire) >= RingCapacity)
+    {
+        mDroppedEvents.fetch_add(1u, std::memory_order_relaxed);
+    }
+    else
+    {
+        const auto elapsed = std::chrono::steady_clock::now() - mStartTime;
+        ring.events[write & (RingCapacity - 1u)] = Event{name, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()),
+                                                         static_cast<int32_t>(index), phase};
+        ring.writeIndex.store(write + 1u, std::memory_order_release);
+    }
+    ring.busy.store(false, std::memory_order_release);
+}
+
+// Threads keep their ring across traces, a thread that found none tries again in the next trace
+inline int Tracer::getThreadRing()
+{
+    static thread_local ThreadSlot slot;
+    if (slot.ring >= 0)
+        return slot.ring;
+    const uint32_t generation = mGeneration.load(std::memory_order_relaxed);
+    if (slot.generation == generation)
+        return -1;
+    for (unsigned i_ring = 0u; i_ring < MaxThreads; i_ring++)
+    {
+        bool expected = false;
+        if (mRings[i_ring].claimed.compare_exchange_strong(expected, true, std::memory_order_acquire))
+        {
+            slot.ring = static_cast<int>(i_ring);
+            return slot.ring;
+        }
+    }
+    slot.generation = generation;
+    return -1;
+}
+
+inline void Tracer::flushLoop()
+{
+    while (mFlushing.load())
+    {
+        flush();
+        std::this_thread::sleep_for(std::chrono::milliseconds(FlushPeriodMs));
+    }
+    flush();
+}
+
+// Rings are threads in the viewer, events carry their ring index as tid
+inline void Tracer::flush()
+{
+    for (unsigned i_ring = 0u; i_ring < MaxThreads; i_ring++)
+    {
+        ThreadRing &ring = mRings[i_ring];
+        const uint32_t write = ring.writeIndex.load(std::memory_order_acquire);
+        uint32_t read = ring.readIndex.load(std::memory_order_relaxed);
+        for (; read != write; read++)
+        {
+            const Event &event = ring.events[read & (RingCapacity - 1u)];
+            std::fprintf(mFile, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u", mFirstEvent ? "" : ",\n",
+                         event.name, event.phase, static_cast<double>(event.timestamp) * 1e-3, i_ring + 1u);
+            if (event.index >= 0)
+                std::fprintf(mFile, ",\"args\":{\"index\":%d}", static_cast<int>(event.index));
+            std::fputc('}', mFile);
+            mFirstEvent = false;
+        }
+        ring.readIndex.store(read, std::memory_order_release);
+    }
+    std::fflush(mFile);
+}
+
+// Begin and end events of the enclosing scope
+class ScopedTrace
+{
+public:
+#if HARMONIC_REVERB_TRACING
+    explicit ScopedTrace(const char *const name, const int index = -1) : mName(name), mIndex(index) { Tracer::get().begin(name, index); };
+    ~ScopedTrace() { Tracer::get().end(mName, mIndex); };
+
+private:
+    const char *mName;
+    int mIndex;
+#else
+    explicit ScopedTrace(const char *const, const int = -1){};
+    ~ScopedTrace() = default;
+#endif
+
+public:
+    ScopedTrace(const ScopedTrace &) = delete;
+    ScopedTrace &operator=(const ScopedTrace &) = delete;
+};
+
+// For stages that do not end with a scope
+inline void traceBegin(const char *const name, const int index = -1)
+{
+#if HARMONIC_REVERB_TRACING
+    Tracer::get().begin(name, index);
+#else
+    (void)name;
+    (void)index;
+#endif
+}
+
+inline void traceEnd(const char *const name, const int index = -1)
+{
+#if HARMONIC_REVERB_TRACING
+    Tracer::get().end(name, index);
+#else
+    (void)name;
+    (void)index;
+#endif
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "../SpectralHistory.h"
+
+// Scrolling spectrogram of the engine's bin envelopes, newest hop on the right and the highest bin on top.
+// Hops are rendered into a cached image one pixel column each; new hops shift the image and only their own
+// columns are drawn, painting just scales the image. The timer only runs while the view is visible.
+template <int B, int OctaveNumber>
+class WaterfallComponent : public juce::Component, private juce::Timer
+{
+public:
+    explicit WaterfallComponent(SpectralHistory<B, OctaveNumber>& history):
+    mHistory (history)
+    {
+        juce::ColourGradient gradient(juce::Colours::black, 0.f, 0.f, juce::Colours::white, 1.f, 0.f, false);
+        gradient.addColour(0.35, juce::Colour::fromHSV(0.66f, 0.98f, 0.6f, 1.f));
+        gradient.addColour(0.65, juce::Colour::fromHSV(0.57f, 0.98f, 0.725f, 1.f));
+        gradient.addColour(0.9, juce::Colour::fromHSV(0.15f, 0.9f, 1.f, 1.f));
+        for (int i_colour = 0; i_colour < ColourSteps; i_colour++)
+        {
+            mColourMap[i_colour] = gradient.getColourAtPosition(static_cast<double>(i_colour) / static_cast<double>(ColourSteps - 1));
+        }
+        setOpaque(true);
+    }
+
+    ~WaterfallComponent() override
+    {
+        stopTimer();
+    }
+
+    void paint (juce::Graphics& g) override
+    {
+        g.setImageResamplingQuality(juce::Graphics::lowResamplingQuality);
+        g.drawImage(mImage, getLocalBounds().toFloat());
+    }
+
+    void visibilityChanged() override
+    {
+        if (isVisible())
+        {
+            // hops from before the view was opened are not drawn
+            mReadFrame = mHistory.getWriteCount();
+            startTimerHz(RefreshRate);
+        }
+        else
+        {
+            stopTimer();
+        }
+    }
+
+    // Lower end of the displayed range in dB below the recent peak
+    void setRangeMin(const double rangeMin)
+    {
+        mRangeMin = juce::jmin(rangeMin, -1.);
+    }
+
+private:
+    static constexpr int HistoryWidth{1024}; // hops, about five seconds at 48 kHz
+    static constexpr int Rows{OctaveNumber * B};
+    static constexpr int ColourSteps{256};
+    static constexpr int RefreshRate{30};
+    static constexpr double PeakReleaseDb{0.02}; // per hop
+
+    void timerCallback() override
+    {
+        if (!isShowing())
+            return;
+        const uint64_t writeCount = mHistory.getWriteCount();
+        if (writeCount == mReadFrame)
+            return;
+        // hops that would scroll out right away are skipped
+        if (writeCount - mReadFrame > static_cast<uint64_t>(HistoryWidth))
+            mReadFrame = writeCount - static_cast<uint64_t>(HistoryWidth);
+
+        const int nColumns = static_cast<int>(writeCount - mReadFrame);
+        if (nColumns < HistoryWidth)
+            mImage.moveImageSection(0, 0, nColumns, 0, HistoryWidth - nColumns, Rows);
+
+        juce::Image::BitmapData pixels(mImage, HistoryWidth - nColumns, 0, nColumns, Rows, juce::Image::BitmapData::writeOnly);
+        for (int i_column = 0; i_column < nColumns; i_column++, mReadFrame++)
+        {
+            if (mHistory.readFrame(mReadFrame, mFrame))
+                drawColumn(pixels, i_column);
+            else
+                clearColumn(pixels, i_column);
+        }
+        repaint();
+    }
+
+    // Octave 0 is the highest, bins rise within an octave
+    void drawColumn(juce::Image::BitmapData& pixels, const int column)
+    {
+        float frameMax = 0.f;
+        for (int i_bin = 0; i_bin < Rows; i_bin++)
+            frameMax = juce::jmax(frameMax, mFrame[i_bin]);
+        mPeakDb = juce::jmax(static_cast<double>(juce::Decibels::gainToDecibels(frameMax, -200.f)), mPeakDb - PeakReleaseDb);
+
+        const double floorDb = mPeakDb + mRangeMin;
+        const double oneDivRange = 1. / -mRangeMin;
+        for (int octave = 0; octave < OctaveNumber; octave++)
+        {
+            for (int tone = 0; tone < B; tone++)
+            {
+                const double magLog = juce::Decibels::gainToDecibels(static_cast<double>(mFrame[octave * B + tone]), floorDb);
+                const double level = juce::jlimit(0., 1., (magLog - floorDb) * oneDivRange);
+                const int row = octave * B + (B - 1 - tone);
+                pixels.setPixelColour(column, row, mColourMap[static_cast<int>(level * (ColourSteps - 1))]);
+            }
+        }
+    }
+
+    void clearColumn(juce::Image::BitmapData& pixels, const int column)
+    {
+        for (int row = 0; row < Rows; row++)
+            pixels.setPixelColour(column, row, mColourMap[0]);
+    }
+
+    SpectralHistory<B, OctaveNumber>& mHistory;
+    uint64_t mReadFrame{0u};
+    float mFrame[OctaveNumber * B]{};
+
+    juce::Image mImage{juce::Image::RGB, HistoryWidth, Rows, true};
+    juce::Colour mColourMap[ColourSteps];
+    double mRangeMin{-80.};
+    double mPeakDb{-200.};
+};